@@ -0,0 +1,69 @@
+//
+// PxlsApplyKernel implementation
+//
+
+#include "PxlsApplyKernel.h"
+#include <algorithm>
+
+void PxlsApplyKernel::Apply(const PxlsRecordBatch &batch, const PxlsApplyPlanes &planes, std::vector<std::uint32_t> &indices,
+                            std::vector<PxlsApplyResult> &results) {
+    indices.resize(batch.count);
+    results.resize(batch.count);
+    Bounds bounds { 0, 0, planes.width, planes.height };
+    if (planes.clip_width != 0 && planes.clip_height != 0) {
+        bounds.min_x = std::min(planes.clip_x, planes.width);
+        bounds.min_y = std::min(planes.clip_y, planes.height);
+        bounds.max_x = std::min(planes.clip_width, planes.width - bounds.min_x) + bounds.min_x;
+        bounds.max_y = std::min(planes.clip_height, planes.height - bounds.min_y) + bounds.min_y;
+    }
+    ComputeIndices(batch.x, batch.y, batch.count, planes.width, bounds, indices.data(), results.data());
+    // changes of the checksum, the pixel is xored out before the write and back in after it
+    std::uint64_t checksum = 0;
+    // scatter in record order, which keeps the last write of duplicate pixels
+    if (batch.direction == FORWARD) {
+        for (std::size_t i = 0; i < batch.count; i++) {
+            if (results[i] == APPLY_SKIPPED) continue;
+            const auto index = indices[i];
+            checksum ^= PixelChecksum(batch.x[i], batch.y[i], planes.color_index[index], planes.manipulate_count[index]);
+            planes.color_index[index] = batch.color_index[i];
+            planes.manipulate_count[index]++;
+            checksum ^= PixelChecksum(batch.x[i], batch.y[i], planes.color_index[index], planes.manipulate_count[index]);
+            if (planes.last_time)
+                planes.last_time[index] = batch.time[i];
+        }
+    } else {
+        for (std::size_t i = 0; i < batch.count; i++) {
+            if (results[i] == APPLY_SKIPPED) continue;
+            const auto index = indices[i];
+            auto &manipulate_count = planes.manipulate_count[index];
+            checksum ^= PixelChecksum(batch.x[i], batch.y[i], planes.color_index[index], manipulate_count);
+            if (manipulate_count != 0)
+                manipulate_count--;
+            // revert to virgin pixel
+            if (manipulate_count == 0 || !batch.has_prev[i]) {
+                manipulate_count = 0;
+                planes.color_index[index] = 0;
+                if (planes.last_time)
+                    planes.last_time[index] = 0;
+                results[i] = APPLY_REVERTED;
+                continue;
+            }
+            planes.color_index[index] = batch.color_index[i];
+            checksum ^= PixelChecksum(batch.x[i], batch.y[i], planes.color_index[index], manipulate_count);
+            if (planes.last_time)
+                planes.last_time[index] = batch.time[i];
+        }
+    }
+    if (planes.checksum)
+        *planes.checksum ^= checksum;
+}
+
+void PxlsApplyKernel::ComputeIndices(const std::uint16_t *x, const std::uint16_t *y, const std::size_t count,
+                                     const unsigned width, const Bounds &bounds, std::uint32_t *indices,
+                                     PxlsApplyResult *results) {
+    for (std::size_t i = 0; i < count; i++) {
+        indices[i] = y[i] * width + x[i];
+        results[i] = x[i] >= bounds.min_x && x[i] < bounds.max_x && y[i] >= bounds.min_y && y[i] < bounds.max_y ?
+            APPLY_WRITTEN : APPLY_SKIPPED;
+    }
+}
@@ -0,0 +1,56 @@
+//
+// Provide the kernel that applies record batches to the canvas planes
+//
+
+#ifndef PXLSAPPLYKERNEL_H
+#define PXLSAPPLYKERNEL_H
+#include <vector>
+#include <cstdint>
+#include "PxlsLogColumns.h"
+
+// planes the kernel writes to, all of them are indexed by y * width + x
+struct PxlsApplyPlanes {
+    unsigned width { 0 }, height { 0 };
+    std::uint8_t *color_index { nullptr };
+    unsigned *manipulate_count { nullptr };
+    long long *last_time { nullptr };
+    // checksum of the planes, which is updated with the pixels changed if set
+    std::uint64_t *checksum { nullptr };
+    // rectangle the writes are clipped to, such as the region of interest. the whole planes if it is empty
+    unsigned clip_x { 0 }, clip_y { 0 }, clip_width { 0 }, clip_height { 0 };
+};
+
+// what the kernel did to the pixel of a record
+enum PxlsApplyResult : std::uint8_t { APPLY_SKIPPED, APPLY_WRITTEN, APPLY_REVERTED };
+
+class PxlsApplyKernel {
+public:
+    // apply a batch to the planes and store the plane index and the result of each record in indices and results.
+    // records out of bounds or the clip rectangle are APPLY_SKIPPED and their indices are undefined, pixels turned virgin by undoing are
+    // APPLY_REVERTED. duplicate pixels in a batch are applied in order, so the last write wins
+    static void Apply(const PxlsRecordBatch &batch, const PxlsApplyPlanes &planes, std::vector<std::uint32_t> &indices,
+                      std::vector<PxlsApplyResult> &results);
+    // checksum of a pixel, the checksum of planes is the xor of the ones of their pixels, so that it can be updated
+    // in O(1) per record. it covers the position, color index and action count, which are kept up to date by
+    // color-only replay as well. virgin pixels are 0, so that the checksum doesn't depend on the dimension
+    static std::uint64_t PixelChecksum(const unsigned x, const unsigned y, const std::uint8_t color_index, const unsigned manipulate_count) {
+        if (manipulate_count == 0) return 0;
+        // splitmix64 finalizer
+        auto z = (static_cast<std::uint64_t>(y) << 32 | x) * 0x9E3779B97F4A7C15ull ^
+            (static_cast<std::uint64_t>(manipulate_count) << 8 | color_index);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+private:
+    // the pixels written, min_x <= x < max_x and min_y <= y < max_y
+    struct Bounds {
+        unsigned min_x { 0 }, min_y { 0 }, max_x { 0 }, max_y { 0 };
+    };
+    // compute plane indices of records, marking the ones in bounds APPLY_WRITTEN and the others APPLY_SKIPPED.
+    // the loop has no dependency between records, so it is left to the auto-vectorization of the compiler
+    static void ComputeIndices(const std::uint16_t *x, const std::uint16_t *y, std::size_t count, unsigned width,
+                               const Bounds &bounds, std::uint32_t *indices, PxlsApplyResult *results);
+};
+
+#endif //PXLSAPPLYKERNEL_H
@@ -0,0 +1,327 @@
+//
+// Benchmark suite for ingestion, seek and render hot paths, results are written in JSON format
+//
+
+#include <vector>
+#include <array>
+#include <string>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+#include <format>
+#include "raylib.h"
+#include "PxlsLogDB.h"
+#include "PxlsCanvas.h"
+#include "PxlsOverlay.h"
+
+struct BenchOptions {
+    // synthetic log
+    unsigned width { 1000 }, height { 1000 };
+    unsigned long record_count { 1000000 };
+    // hot spots are areas that attract a share of placements, like artworks being built
+    unsigned hotspot_count { 8 };
+    float hotspot_ratio { 0.7f };
+    float hotspot_radius { 40.0f };
+    unsigned seed { 42 };
+    // bytes of log converted to each shard, 0 disables sharding
+    unsigned long long shard_bytes { PxlsLogDB::DEFAULT_SHARD_BYTES };
+    // bytes of canvas planes kept in memory before they are mapped from scratch files in work_dir, 0 disables it
+    std::size_t resident_budget { PxlsPlaneMemory::DEFAULT_RESIDENT_BUDGET };
+    // seek and render
+    unsigned seek_count { 200 };
+    unsigned frame_count { 300 };
+    // number of random seeks checked against forward replay, 0 disables the verifier
+    unsigned verify_count { 0 };
+    std::string work_dir { "pxls-bench-data" };
+    std::string output { "pxls-bench.json" };
+};
+
+using bench_clock = std::chrono::steady_clock;
+// dimension of the hidden window used for rendering
+constexpr unsigned RENDER_WINDOW_WIDTH = 1280;
+constexpr unsigned RENDER_WINDOW_HEIGHT = 960;
+
+double ElapsedMs(const bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+// summarize latencies in milliseconds
+json Percentiles(std::vector<double> latencies) {
+    json result = json::object();
+    if (latencies.empty()) return result;
+    std::ranges::sort(latencies);
+    const auto At = [&](const double q) {
+        return latencies[std::min(latencies.size() - 1, static_cast<std::size_t>(q * latencies.size()))];
+    };
+    result["count"] = latencies.size();
+    result["p50_ms"] = At(0.5);
+    result["p90_ms"] = At(0.9);
+    result["p99_ms"] = At(0.99);
+    result["max_ms"] = latencies.back();
+    return result;
+}
+
+// generate a synthetic pxls log with the same format as the real one
+bool GenerateLog(const BenchOptions &options, const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file) return false;
+    std::mt19937 rng(options.seed);
+    std::uniform_int_distribution<unsigned> x_dist(0, options.width - 1), y_dist(0, options.height - 1);
+    std::uniform_int_distribution<unsigned> color_dist(0, 31), user_dist(0, 4999), hotspot_dist(0, std::max(options.hotspot_count, 1u) - 1);
+    std::uniform_real_distribution<float> ratio_dist(0.0f, 1.0f);
+    std::normal_distribution<float> offset_dist(0.0f, options.hotspot_radius);
+    std::vector<std::pair<unsigned, unsigned>> hotspots;
+    for (unsigned i = 0; i < options.hotspot_count; i++)
+        hotspots.emplace_back(x_dist(rng), y_dist(rng));
+    constexpr std::array<std::string_view, 4> actions { "user place", "user undo", "mod overwrite", "rollback" };
+    std::discrete_distribution<unsigned> action_dist { 90, 7, 2, 1 };
+    auto time = sys_time_ms { std::chrono::sys_days { std::chrono::year(2021) / 6 / 1 } };
+    std::uniform_int_distribution<unsigned> time_step_dist(0, 200);
+    for (unsigned long i = 0; i < options.record_count; i++) {
+        unsigned x, y;
+        if (!hotspots.empty() && ratio_dist(rng) < options.hotspot_ratio) {
+            const auto &[hotspot_x, hotspot_y] = hotspots[hotspot_dist(rng)];
+            x = std::clamp(static_cast<long>(hotspot_x + offset_dist(rng)), 0l, static_cast<long>(options.width - 1));
+            y = std::clamp(static_cast<long>(hotspot_y + offset_dist(rng)), 0l, static_cast<long>(options.height - 1));
+        } else {
+            x = x_dist(rng);
+            y = y_dist(rng);
+        }
+        time += std::chrono::milliseconds(time_step_dist(rng));
+        const auto time_str = std::format("{:%F %T}", time);
+        // pxls log uses ',' as the decimal separator
+        file << time_str.substr(0, time_str.size() - 4) << ',' << time_str.substr(time_str.size() - 3) << '\t'
+            << std::format("{:064x}", user_dist(rng)) << '\t' << x << '\t' << y << '\t'
+            << color_dist(rng) << '\t' << actions[action_dist(rng)] << '\n';
+    }
+    return static_cast<bool>(file);
+}
+
+json BenchIngestion(const BenchOptions &options, PxlsLogDB &db, const std::string &log_path) {
+    json result = json::object();
+    result["record_count"] = options.record_count;
+    result["log_bytes"] = std::filesystem::file_size(log_path);
+    const auto start = bench_clock::now();
+    // snapshots are created while converting, the same way as the viewer does
+    PxlsSnapshotBuilder snapshot_builder;
+    if (!db.OpenLogRaw(log_path, [&](const long long time, const std::string_view hash, const unsigned x, const unsigned y,
+        const unsigned color_index, const std::string_view action) {
+        snapshot_builder.PerformAction(x, y, time, action, hash, color_index);
+    }, [&](std::vector<char> &snapshot_blob) {
+        return snapshot_builder.DumpSnapshot(snapshot_blob);
+    })) {
+        result["error"] = "failed to convert log";
+        return result;
+    }
+    const auto elapsed_ms = ElapsedMs(start);
+    result["open_log_raw_ms"] = elapsed_ms;
+    result["records_per_second"] = options.record_count / (elapsed_ms / 1000.0);
+    result["has_columns"] = db.HasColumns();
+    result["shards"] = db.ShardCount();
+    return result;
+}
+
+json BenchSeek(const BenchOptions &options, PxlsLogDB &db, PxlsCanvas &canvas, PxlsPlaybackPanel &playback_panel) {
+    json result = json::object();
+    std::mt19937 rng(options.seed + 1);
+    std::uniform_int_distribution<unsigned long> head_dist(0, db.RecordCount());
+    std::vector<unsigned long> heads(options.seek_count);
+    for (auto &head: heads)
+        head = head_dist(rng);
+    // replay through sqlite
+    std::vector<double> sqlite_latencies;
+    db.Seek(0);
+    canvas.ClearCanvas();
+    for (const auto head: heads) {
+        const auto start = bench_clock::now();
+        playback_panel.JumpToNearestSnapshot(head, db, canvas);
+        db.QueryRecords(head, [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+            const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
+            canvas.PerformAction(x, y, direction == FORWARD ? REDO : UNDO, time, action, hash, color_index);
+        });
+        sqlite_latencies.push_back(ElapsedMs(start));
+    }
+    result["sqlite"] = Percentiles(sqlite_latencies);
+    // replay through the columnar sidecar
+    if (db.HasColumns()) {
+        std::vector<double> columns_latencies;
+        db.Seek(0);
+        canvas.ClearCanvas();
+        for (const auto head: heads) {
+            const auto start = bench_clock::now();
+            playback_panel.JumpToNearestSnapshot(head, db, canvas);
+            db.QueryRecordBatches(head, [&](const PxlsRecordBatch &batch) {
+                canvas.PerformBatch(batch, db.Columns());
+            });
+            columns_latencies.push_back(ElapsedMs(start));
+        }
+        result["columns"] = Percentiles(columns_latencies);
+    }
+    return result;
+}
+
+// seek randomly forward and backward through snapshots, keyframes and both replay paths, and compare the checksum of the
+// canvas with the one reached by replaying forward from the beginning, which doesn't rely on snapshots or prev_id
+json VerifySeek(const BenchOptions &options, PxlsLogDB &db, PxlsCanvas &canvas, PxlsPlaybackPanel &playback_panel) {
+    json result = json::object();
+    std::mt19937 rng(options.seed + 2);
+    std::uniform_int_distribution<unsigned long> head_dist(0, db.RecordCount());
+    std::vector<unsigned long> heads(options.verify_count);
+    for (auto &head: heads)
+        head = head_dist(rng);
+    // ground truth
+    auto sorted_heads = heads;
+    std::ranges::sort(sorted_heads);
+    std::unordered_map<unsigned long, std::uint64_t> truth;
+    db.Seek(0);
+    canvas.ClearCanvas();
+    for (const auto head: sorted_heads) {
+        db.QueryRecords(head, [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+            const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
+            canvas.PerformAction(x, y, direction == FORWARD ? REDO : UNDO, time, action, hash, color_index);
+        });
+        truth[head] = canvas.Checksum();
+    }
+    // seek in random order, alternating the replay paths
+    json mismatches = json::array();
+    for (std::size_t i = 0; i < heads.size(); i++) {
+        playback_panel.JumpToNearestSnapshot(heads[i], db, canvas);
+        if (i % 2 == 0 || !db.QueryRecordBatches(heads[i], [&](const PxlsRecordBatch &batch) {
+            canvas.PerformBatch(batch, db.Columns());
+        }))
+            db.QueryRecords(heads[i], [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+                const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
+                canvas.PerformAction(x, y, direction == FORWARD ? REDO : UNDO, time, action, hash, color_index);
+            });
+        if (canvas.Checksum() != truth[heads[i]])
+            mismatches.push_back(heads[i]);
+    }
+    result["seeks"] = heads.size();
+    result["mismatches"] = mismatches;
+    return result;
+}
+
+json BenchRender(const BenchOptions &options, PxlsLogDB &db, PxlsCanvas &canvas) {
+    json result = json::object();
+    // render to a hidden window, which still requires a display to create the gl context
+    SetConfigFlags(FLAG_WINDOW_HIDDEN);
+    InitWindow(RENDER_WINDOW_WIDTH, RENDER_WINDOW_HEIGHT, "pxls-bench");
+    if (!IsWindowReady()) {
+        result["error"] = "failed to create window";
+        return result;
+    }
+    SetTargetFPS(0);
+    canvas.InitCanvas(db.Width(), db.Height(), RENDER_WINDOW_WIDTH, RENDER_WINDOW_HEIGHT);
+    db.Seek(0);
+    if (!db.QueryRecordBatches(db.RecordCount(), [&](const PxlsRecordBatch &batch) {
+        canvas.PerformBatch(batch, db.Columns());
+    }))
+        db.QueryRecords(db.RecordCount(), [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+            const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
+            canvas.PerformAction(x, y, direction == FORWARD ? REDO : UNDO, time, action, hash, color_index);
+        });
+    // measure both the whole canvas at 1.0 scale and a zoomed view
+    for (const auto &[name, scale]: { std::pair { "scale_1", 1.0f }, std::pair { "scale_8", 8.0f } }) {
+        canvas.Scale(scale);
+        std::vector<double> frame_latencies;
+        for (unsigned i = 0; i < options.frame_count; i++) {
+            const auto start = bench_clock::now();
+            BeginDrawing();
+            canvas.Render();
+            EndDrawing();
+            frame_latencies.push_back(ElapsedMs(start));
+        }
+        result[name] = Percentiles(frame_latencies);
+    }
+    canvas.UnloadTextures();
+    CloseWindow();
+    return result;
+}
+
+bool ParseOptions(const int argc, char **argv, BenchOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg { argv[i] };
+        if (i + 1 >= argc) return false;
+        const std::string value { argv[++i] };
+        try {
+            if (arg == "--width") options.width = std::stoul(value);
+            else if (arg == "--height") options.height = std::stoul(value);
+            else if (arg == "--records") options.record_count = std::stoul(value);
+            else if (arg == "--hotspots") options.hotspot_count = std::stoul(value);
+            else if (arg == "--hotspot-ratio") options.hotspot_ratio = std::stof(value);
+            else if (arg == "--hotspot-radius") options.hotspot_radius = std::stof(value);
+            else if (arg == "--seed") options.seed = std::stoul(value);
+            else if (arg == "--shard-bytes") options.shard_bytes = std::stoull(value);
+            else if (arg == "--resident-budget") options.resident_budget = std::stoull(value);
+            else if (arg == "--seeks") options.seek_count = std::stoul(value);
+            else if (arg == "--frames") options.frame_count = std::stoul(value);
+            else if (arg == "--verify") options.verify_count = std::stoul(value);
+            else if (arg == "--work-dir") options.work_dir = value;
+            else if (arg == "--output") options.output = value;
+            else return false;
+        } catch (std::logic_error&) {
+            return false;
+        }
+    }
+    return options.width > 0 && options.height > 0 && options.record_count > 0;
+}
+
+int main(const int argc, char **argv) {
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: pxls-bench [--width W] [--height H] [--records N] [--hotspots K] [--hotspot-ratio R] "
+                     "[--hotspot-radius PX] [--seed S] [--shard-bytes B] [--resident-budget B] [--seeks N] [--frames N] [--verify N] [--work-dir DIR] [--output FILE]\n";
+        return 1;
+    }
+    std::filesystem::create_directories(options.work_dir);
+    const auto log_path = (std::filesystem::path(options.work_dir) / "bench.log").string();
+    json report = json::object();
+    report["options"] = {
+        { "width", options.width }, { "height", options.height }, { "records", options.record_count },
+        { "hotspots", options.hotspot_count }, { "hotspot_ratio", options.hotspot_ratio },
+        { "hotspot_radius", options.hotspot_radius }, { "seed", options.seed }, { "shard_bytes", options.shard_bytes },
+        { "resident_budget", options.resident_budget },
+        { "seeks", options.seek_count }, { "frames", options.frame_count }, { "verify", options.verify_count }
+    };
+    std::cerr << "Generating synthetic log...\n";
+    auto start = bench_clock::now();
+    if (!GenerateLog(options, log_path)) {
+        std::cerr << "Failed to generate log\n";
+        return 2;
+    }
+    report["generate_ms"] = ElapsedMs(start);
+
+    PxlsPlaneMemory::Configure(options.work_dir, options.resident_budget);
+    PxlsLogDB db;
+    db.ShardBytes(options.shard_bytes);
+    PxlsCanvas canvas;
+    PxlsPlaybackPanel playback_panel(RENDER_WINDOW_WIDTH, RENDER_WINDOW_HEIGHT);
+    canvas.LoadPaletteFromJson("palette.json");
+    std::cerr << "Benchmarking ingestion...\n";
+    report["ingestion"] = BenchIngestion(options, db, log_path);
+    if (!db.IsOpen()) {
+        std::cerr << "Failed to convert log\n";
+        return 3;
+    }
+    canvas.InitCanvas(db.Width(), db.Height(), RENDER_WINDOW_WIDTH, RENDER_WINDOW_HEIGHT);
+    playback_panel.InitPlayback(db);
+    std::cerr << "Benchmarking seek...\n";
+    report["seek"] = BenchSeek(options, db, canvas, playback_panel);
+    if (options.verify_count > 0) {
+        std::cerr << "Verifying seek...\n";
+        report["verify"] = VerifySeek(options, db, canvas, playback_panel);
+    }
+    std::cerr << "Benchmarking render...\n";
+    report["render"] = BenchRender(options, db, canvas);
+
+    std::ofstream output(options.output);
+    output << report.dump(4) << '\n';
+    std::cout << report.dump(4) << '\n';
+    if (!output) return 4;
+    // the verifier fails the run if any seek doesn't match forward replay
+    return report.contains("verify") && !report["verify"]["mismatches"].empty() ? 5 : 0;
+}
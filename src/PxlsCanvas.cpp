@@ -3,6 +3,110 @@
 //
 
 #include "PxlsCanvas.h"
+#include "rlgl.h"
+
+namespace {
+    // look up the palette texture with the color index stored in the red channel of the index texture
+    constexpr auto PALETTE_FRAGMENT_SHADER = R"(#version 330
+in vec2 fragTexCoord;
+in vec4 fragColor;
+uniform sampler2D texture0;
+uniform sampler2D palette;
+out vec4 finalColor;
+void main() {
+    int color_index = int(texture(texture0, fragTexCoord).r * 255.0 + 0.5);
+    finalColor = texelFetch(palette, ivec2(color_index, 0), 0) * fragColor;
+}
+)";
+
+    // encode width * height pixels in row-major order into a snapshot. pixel_at(index) returns the snapshot pixel
+    // without string indices, along with its hash id and action name, which are collected into the string dictionary
+    template <typename PixelAt>
+    void EncodeSnapshot(const unsigned width, const unsigned height, const PixelAt &pixel_at, std::vector<char> &snapshot_blob) {
+        const std::size_t pixel_count = static_cast<std::size_t>(width) * height;
+        // build the string dictionary from the hashes and action names in use, pixels only store their indices
+        std::unordered_map<std::uint32_t, std::uint32_t> hash_indices;
+        std::unordered_map<std::string_view, std::uint32_t> action_indices;
+        std::vector<std::uint32_t> hash_ids;
+        std::vector<std::string_view> action_names;
+        std::vector<PxlsCanvasSnapshotPixel> snapshot_pixels(pixel_count);
+        std::uint64_t checksum = 0;
+        for (std::size_t i = 0; i < pixel_count; i++) {
+            auto [snapshot_pixel, hash_id, action_name] = pixel_at(i);
+            const auto [hash_it, hash_inserted] = hash_indices.try_emplace(hash_id, hash_ids.size());
+            if (hash_inserted)
+                hash_ids.push_back(hash_id);
+            const auto [action_it, action_inserted] = action_indices.try_emplace(action_name, action_names.size());
+            if (action_inserted)
+                action_names.push_back(action_name);
+            snapshot_pixel.hash_index = hash_it->second;
+            snapshot_pixel.action_index = action_it->second;
+            snapshot_pixels[i] = snapshot_pixel;
+            checksum ^= PxlsApplyKernel::PixelChecksum(i % width, i / width, snapshot_pixel.color_index, snapshot_pixel.manipulate_count);
+        }
+        std::string dictionary;
+        for (const auto hash_id: hash_ids)
+            dictionary.append(PxlsHashTable::Lookup(hash_id)).push_back('\0');
+        for (const auto action_name: action_names)
+            dictionary.append(action_name).push_back('\0');
+        PxlsCanvasSnapshotHeader header;
+        std::memcpy(header.magic, PxlsCanvas::SNAPSHOT_MAGIC, sizeof(PxlsCanvas::SNAPSHOT_MAGIC));
+        header.version = PxlsCanvas::SNAPSHOT_VERSION;
+        header.width = width; header.height = height;
+        header.hash_count = hash_ids.size();
+        header.action_count = action_names.size();
+        header.dictionary_bytes = dictionary.size();
+        header.checksum = checksum;
+        const auto pixels_bytes = pixel_count * sizeof(PxlsCanvasSnapshotPixel);
+        snapshot_blob.resize(sizeof(header) + pixels_bytes + dictionary.size());
+        std::memcpy(snapshot_blob.data(), &header, sizeof(header));
+        std::memcpy(snapshot_blob.data() + sizeof(header), snapshot_pixels.data(), pixels_bytes);
+        std::memcpy(snapshot_blob.data() + sizeof(header) + pixels_bytes, dictionary.data(), dictionary.size());
+    }
+
+    // read the header of a snapshot and return its size, which depends on the version. return 0 if there is no header
+    std::size_t ReadSnapshotHeader(const std::size_t snapshot_bytes, const SnapshotReadCallback &read, PxlsCanvasSnapshotHeader &header) {
+        constexpr auto header_bytes_no_checksum = offsetof(PxlsCanvasSnapshotHeader, checksum);
+        if (snapshot_bytes < header_bytes_no_checksum || !read(0, &header, header_bytes_no_checksum) ||
+            std::memcmp(header.magic, PxlsCanvas::SNAPSHOT_MAGIC, sizeof(PxlsCanvas::SNAPSHOT_MAGIC)) != 0)
+            return 0;
+        if (header.version == PxlsCanvas::SNAPSHOT_VERSION_NO_CHECKSUM)
+            return header_bytes_no_checksum;
+        if (snapshot_bytes < sizeof(header) || !read(header_bytes_no_checksum, &header.checksum, sizeof(header.checksum)))
+            return 0;
+        return sizeof(header);
+    }
+
+    // read count pixels of a snapshot starting from the first one in chunks, and pass them to on_pixel with their indices
+    template <typename Pixel, typename OnPixel>
+    bool ReadSnapshotPixels(const SnapshotReadCallback &read, const std::size_t pixels_offset, const std::size_t first,
+                            const std::size_t count, std::vector<Pixel> &chunk, const OnPixel &on_pixel) {
+        for (std::size_t chunk_first = first; chunk_first < first + count; chunk_first += chunk.size()) {
+            const auto chunk_count = std::min(chunk.size(), first + count - chunk_first);
+            if (!read(pixels_offset + chunk_first * sizeof(Pixel), chunk.data(), chunk_count * sizeof(Pixel)))
+                return false;
+            for (std::size_t i = 0; i < chunk_count; i++)
+                on_pixel(chunk_first + i, chunk[i]);
+        }
+        return true;
+    }
+
+    // call span_callback with the first index and the count of each span of a rectangle in a plane stored line by line,
+    // lines that are entirely inside the rectangle are merged into one span
+    template <typename SpanCallback>
+    bool ForEachSpan(const unsigned line_begin, const unsigned line_end, const unsigned offset_begin, const unsigned offset_end,
+                     const unsigned line_length, const SpanCallback &span_callback) {
+        if (line_begin >= line_end || offset_begin >= offset_end) return true;
+        if (offset_begin == 0 && offset_end == line_length)
+            return span_callback(static_cast<std::size_t>(line_begin) * line_length,
+                                 static_cast<std::size_t>(line_end - line_begin) * line_length);
+        for (unsigned line = line_begin; line < line_end; line++) {
+            if (!span_callback(static_cast<std::size_t>(line) * line_length + offset_begin, offset_end - offset_begin))
+                return false;
+        }
+        return true;
+    }
+}
 
 bool PxlsCanvas::LoadPaletteFromJson(const std::string &filename) {
     if (!std::filesystem::exists(filename) || std::filesystem::is_directory(filename)) return false;
@@ -46,6 +150,7 @@ bool PxlsCanvas::LoadPaletteFromJson(const std::string &filename) {
         new_palette.push_back({ palette_item["name"], palette_color });
     }
     palette = new_palette;
+    palette_dirty = true;
     return true;
 }
 
@@ -54,12 +159,44 @@ bool PxlsCanvas::InitCanvas(const unsigned canvas_w, const unsigned canvas_h, co
     canvas_width = canvas_w; canvas_height = canvas_h; window_width = window_w; window_height = window_h;
     view_center = { canvas_width / 2.0f, canvas_height / 2.0f };
     scale = 1.0f;
+    region = std::nullopt;
+    color_only = false;
     ClearCanvas();
     return true;
 }
 
 void PxlsCanvas::ClearCanvas() {
-    canvas = std::vector(canvas_width, std::vector(canvas_height, PxlsCanvasPixel()));
+    const PxlsCanvasPixel virgin_pixel;
+    const std::size_t pixel_count = static_cast<std::size_t>(canvas_width) * canvas_height;
+    color_plane.assign(pixel_count, virgin_pixel.color_index);
+    count_plane.assign(pixel_count, virgin_pixel.manipulate_count);
+    time_plane.assign(pixel_count, virgin_pixel.last_time.time_since_epoch().count());
+    action_plane.assign(pixel_count, virgin_pixel.last_action);
+    hash_plane.assign(pixel_count, virgin_pixel.last_hash_id);
+    stale_plane.assign(pixel_count, 0);
+    canvas_checksum = 0;
+    MarkColorsDirty(0, pixel_count);
+}
+
+PxlsCanvasPixel PxlsCanvas::Pixel(const unsigned x, const unsigned y) const {
+    const auto index = y * canvas_width + x;
+    return {
+        count_plane[index],
+        sys_time_ms { std::chrono::milliseconds(time_plane[index]) },
+        action_plane[index],
+        hash_plane[index],
+        color_plane[index]
+    };
+}
+
+std::uint64_t PxlsCanvas::PaletteHash() const {
+    auto palette_hash = PxlsLogDB::PREFIX_HASH_SEED;
+    for (const auto &palette_color: palette) {
+        const std::array<char, 4> rgba { static_cast<char>(palette_color.color.r), static_cast<char>(palette_color.color.g),
+            static_cast<char>(palette_color.color.b), static_cast<char>(palette_color.color.a) };
+        palette_hash = PxlsLogDB::HashBytes(rgba.data(), rgba.size(), palette_hash);
+    }
+    return palette_hash;
 }
 
 Color PxlsCanvas::GetPaletteColor(const unsigned color_index) const {
@@ -72,12 +209,13 @@ std::string PxlsCanvas::GetPaletteColorName(const unsigned color_index) const {
     return palette[color_index].name;
 }
 
-bool PxlsCanvas::PerformAction(const unsigned x, const unsigned y, const ActionDirection direction, std::optional<std::string> time_str,
+bool PxlsCanvas::PerformAction(const unsigned x, const unsigned y, const ActionDirection direction, const std::optional<long long> time,
                 const std::optional<std::string> &action, const std::optional<std::string> &hash, const std::optional<unsigned> &color_index) {
     if (x >= canvas_width || y >= canvas_height) return false;
-    sys_time_ms last_time;
-    std::istringstream { time_str ? *time_str : "1972-01-01 00:00:00.000" } >> date::parse("%F %T", last_time);
-    unsigned new_manipulate_count = canvas[x][y].manipulate_count;
+    PxlsProfileScope profile_scope(PxlsProfiler::PERFORM_ACTION, 1);
+    const auto index = y * canvas_width + x;
+    canvas_checksum ^= PxlsApplyKernel::PixelChecksum(x, y, color_plane[index], count_plane[index]);
+    unsigned new_manipulate_count = count_plane[index];
     if (direction == REDO) {
         new_manipulate_count++;
     }
@@ -86,14 +224,92 @@ bool PxlsCanvas::PerformAction(const unsigned x, const unsigned y, const ActionD
             new_manipulate_count--;
         // revert to virgin pixel
         if (new_manipulate_count == 0) {
-            canvas[x][y] = PxlsCanvasPixel();
+            const PxlsCanvasPixel virgin_pixel;
+            stale_plane[index] = 0;
+            count_plane[index] = virgin_pixel.manipulate_count;
+            time_plane[index] = virgin_pixel.last_time.time_since_epoch().count();
+            action_plane[index] = virgin_pixel.last_action;
+            hash_plane[index] = virgin_pixel.last_hash_id;
+            color_plane[index] = virgin_pixel.color_index;
+            MarkColorsDirty(index, index + 1);
             return true;
         }
     }
-    canvas[x][y] = { new_manipulate_count, last_time, *action, *hash, *color_index };
+    count_plane[index] = new_manipulate_count;
+    color_plane[index] = *color_index <= UINT8_MAX ? *color_index : FALLBACK_COLOR_INDEX;
+    canvas_checksum ^= PxlsApplyKernel::PixelChecksum(x, y, color_plane[index], count_plane[index]);
+    MarkColorsDirty(index, index + 1);
+    // skip copying strings, the metadata is restored on demand
+    if (color_only) {
+        stale_plane[index] = 1;
+        return true;
+    }
+    time_plane[index] = time.value_or(0);
+    action_plane[index] = *action;
+    hash_plane[index] = PxlsHashTable::Intern(*hash);
+    stale_plane[index] = 0;
     return true;
 }
 
+void PxlsCanvas::PerformBatch(const PxlsRecordBatch &batch, const PxlsLogColumns &columns) {
+    PxlsProfileScope profile_scope(PxlsProfiler::PERFORM_ACTION, batch.count);
+    // the pixels outside the region are never decoded from snapshots, so the records placed on them are skipped
+    const auto clip = region.value_or(PxlsRegion {});
+    PxlsApplyKernel::Apply(batch, {
+        canvas_width, canvas_height, color_plane.data(), count_plane.data(), color_only ? nullptr : time_plane.data(), &canvas_checksum,
+        clip.x, clip.y, clip.width, clip.height
+    }, batch_indices, batch_results);
+    for (std::size_t i = 0; i < batch.count; i++) {
+        if (batch_results[i] != APPLY_SKIPPED)
+            MarkColorsDirty(batch_indices[i], batch_indices[i] + 1);
+    }
+    if (color_only) {
+        for (std::size_t i = 0; i < batch.count; i++) {
+            if (batch_results[i] != APPLY_SKIPPED)
+                stale_plane[batch_indices[i]] = 1;
+        }
+        return;
+    }
+    // update metadata planes in record order, using the indices and results of the kernel
+    const PxlsCanvasPixel virgin_pixel;
+    for (std::size_t i = 0; i < batch.count; i++) {
+        if (batch_results[i] == APPLY_SKIPPED) continue;
+        const auto index = batch_indices[i];
+        stale_plane[index] = 0;
+        // the pixels reverted to virgin by the kernel
+        if (batch_results[i] == APPLY_REVERTED) {
+            action_plane[index] = virgin_pixel.last_action;
+            hash_plane[index] = virgin_pixel.last_hash_id;
+            continue;
+        }
+        // assign in place to reuse the string buffers of the pixel
+        action_plane[index] = columns.ActionName(batch.action_id[i]);
+        hash_plane[index] = columns.UserHashId(batch.user_id[i]);
+    }
+}
+
+void PxlsCanvas::ApplyCorrections(const std::vector<PxlsFilterCorrection> &corrections, const PxlsLogColumns &columns) {
+    std::vector<PxlsFilterCorrection> replaced;
+    for (const auto &correction: corrections) {
+        if (correction.x >= canvas_width || correction.y >= canvas_height ||
+            (region && !region->Contains(correction.x, correction.y)))
+            continue;
+        const auto index = correction.y * canvas_width + correction.x;
+        auto &manipulate_count = count_plane[index];
+        canvas_checksum ^= PxlsApplyKernel::PixelChecksum(correction.x, correction.y, color_plane[index], manipulate_count);
+        manipulate_count -= std::min(manipulate_count, correction.excluded_count);
+        if (correction.record_id != PxlsFilterCorrection::KEEP_RECORD) {
+            // the replacing record is applied like undoing, which takes one from the count
+            manipulate_count++;
+            replaced.push_back(correction);
+        }
+        canvas_checksum ^= PxlsApplyKernel::PixelChecksum(correction.x, correction.y, color_plane[index], manipulate_count);
+    }
+    columns.QueryCorrectionBatches(replaced, [&](const PxlsRecordBatch &batch) {
+        PerformBatch(batch, columns);
+    });
+}
+
 void PxlsCanvas::ViewCenter(Vector2 center) {
     center.x = std::clamp(center.x, 0.0f, static_cast<float>(canvas_width));
     center.y = std::clamp(center.y, 0.0f, static_cast<float>(canvas_height));
@@ -104,6 +320,19 @@ void PxlsCanvas::Scale(const float s) {
     scale = std::clamp(s, MIN_SCALE, MAX_SCALE);
 }
 
+void PxlsCanvas::Region(const std::optional<PxlsRegion> &r) {
+    if (r && (r->x >= canvas_width || r->y >= canvas_height || r->width == 0 || r->height == 0)) {
+        region = std::nullopt;
+        return;
+    }
+    region = r;
+    // clip region to the canvas
+    if (region) {
+        region->width = std::min(region->width, canvas_width - region->x);
+        region->height = std::min(region->height, canvas_height - region->y);
+    }
+}
+
 bool PxlsCanvas::Highlight(const unsigned x, const unsigned y) {
     if (x >= canvas_width || y >= canvas_height) return false;
     do_highlight = true;
@@ -145,6 +374,7 @@ bool PxlsCanvas::GetNearestPixelPos(const Vector2 window_pos, unsigned &canvas_x
 }
 
 void PxlsCanvas::Render(){
+    PxlsProfileScope profile_scope(PxlsProfiler::RENDER);
     // respond to mouse input
     Scale(Scale() + GetMouseWheelMove() / 3.0f);
     // right click or middle click to move view
@@ -198,57 +428,357 @@ void PxlsCanvas::Render(){
         window_view_center.x - (canvas_view_center_x - canvas_view_origin_x) * scale,
         window_view_center.y - (canvas_view_center_y - canvas_view_origin_y) * scale
     };
-    for (unsigned x = 0; x < canvas_view_width; x++) {
-        for (unsigned y = 0; y < canvas_view_height; y++) {
-            // optimization for 1.0f scale
-            if (scale == 1.0f) {
-                DrawPixelV({ window_view_origin.x + x, window_view_origin.y + y },
-                    GetPaletteColor(canvas[canvas_view_origin_x + x][canvas_view_origin_y + y].color_index));
-            } else {
-                DrawRectangleRec({
-                        window_view_origin.x + x * scale, window_view_origin.y + y * scale,
-                        scale, scale
-                    }, GetPaletteColor(canvas[canvas_view_origin_x + x][canvas_view_origin_y + y].color_index));
-                if (do_highlight && highlight_x == canvas_view_origin_x + x && highlight_y == canvas_view_origin_y + y) {
-                    DrawRectangleLinesEx({
-                        window_view_origin.x + x * scale, window_view_origin.y + y * scale,
-                        scale, scale
-                    }, 1.5f, BLACK);
+    if (UpdateTextures()) {
+        // draw the visible part of the index texture inside the region of interest
+        auto source_left = canvas_view_origin_x, source_top = canvas_view_origin_y;
+        auto source_right = canvas_view_origin_x + canvas_view_width, source_bottom = canvas_view_origin_y + canvas_view_height;
+        if (region) {
+            source_left = std::max(source_left, region->x); source_top = std::max(source_top, region->y);
+            source_right = std::min(source_right, region->x + region->width);
+            source_bottom = std::min(source_bottom, region->y + region->height);
+        }
+        if (source_left < source_right && source_top < source_bottom) {
+            BeginShaderMode(palette_shader);
+            SetShaderValueTexture(palette_shader, palette_location, palette_texture);
+            DrawTexturePro(index_texture, {
+                    static_cast<float>(source_left), static_cast<float>(source_top),
+                    static_cast<float>(source_right - source_left), static_cast<float>(source_bottom - source_top)
+                }, {
+                    window_view_origin.x + static_cast<float>(source_left - canvas_view_origin_x) * scale,
+                    window_view_origin.y + static_cast<float>(source_top - canvas_view_origin_y) * scale,
+                    static_cast<float>(source_right - source_left) * scale, static_cast<float>(source_bottom - source_top) * scale
+                }, { 0.0f, 0.0f }, 0.0f, WHITE);
+            EndShaderMode();
+        }
+        if (scale != 1.0f && do_highlight && (!region || region->Contains(highlight_x, highlight_y))) {
+            DrawRectangleLinesEx({
+                window_view_origin.x + static_cast<float>(highlight_x - canvas_view_origin_x) * scale,
+                window_view_origin.y + static_cast<float>(highlight_y - canvas_view_origin_y) * scale,
+                scale, scale
+            }, 1.5f, BLACK);
+        }
+    } else {
+        for (unsigned x = 0; x < canvas_view_width; x++) {
+            for (unsigned y = 0; y < canvas_view_height; y++) {
+                // skip pixels outside the region of interest
+                if (region && !region->Contains(canvas_view_origin_x + x, canvas_view_origin_y + y)) continue;
+                // optimization for 1.0f scale
+                if (scale == 1.0f) {
+                    DrawPixelV({ window_view_origin.x + x, window_view_origin.y + y },
+                        GetPaletteColor(color_plane[(canvas_view_origin_y + y) * canvas_width + canvas_view_origin_x + x]));
+                } else {
+                    DrawRectangleRec({
+                            window_view_origin.x + x * scale, window_view_origin.y + y * scale,
+                            scale, scale
+                        }, GetPaletteColor(color_plane[(canvas_view_origin_y + y) * canvas_width + canvas_view_origin_x + x]));
+                    if (do_highlight && highlight_x == canvas_view_origin_x + x && highlight_y == canvas_view_origin_y + y) {
+                        DrawRectangleLinesEx({
+                            window_view_origin.x + x * scale, window_view_origin.y + y * scale,
+                            scale, scale
+                        }, 1.5f, BLACK);
+                    }
                 }
             }
         }
     }
+    // outline the region of interest
+    if (region) {
+        DrawRectangleLinesEx({
+            window_view_origin.x + (static_cast<float>(region->x) - canvas_view_origin_x) * scale - 1.0f,
+            window_view_origin.y + (static_cast<float>(region->y) - canvas_view_origin_y) * scale - 1.0f,
+            region->width * scale + 2.0f, region->height * scale + 2.0f
+        }, 1.0f, REGION_OUTLINE_COLOR);
+    }
+    if (GetTime() - last_trim_time >= TRIM_INTERVAL) {
+        TrimPlanes(canvas_view_origin_y, canvas_view_origin_y + canvas_view_height - 1);
+        last_trim_time = GetTime();
+    }
 }
 
-bool PxlsCanvas::DumpSnapshot(std::shared_ptr<PxlsCanvasSnapshotPixel[]> &snapshot_blob) const {
-    if (canvas_width == 0 || canvas_height == 0) return false;
-    snapshot_blob = std::make_shared<PxlsCanvasSnapshotPixel[]>(canvas_width * canvas_height);
-    unsigned i = 0;
-    for (const auto &col: canvas) {
-        for (const auto &[manipulate_count, last_time, last_action, last_hash, color_index]: col) {
-            snapshot_blob[i] = {
-                manipulate_count, last_time.time_since_epoch().count(), {}, {}, color_index
-            };
-            last_action.copy(snapshot_blob[i].last_action, sizeof(snapshot_blob[i].last_action) - 1);
-            last_hash.copy(snapshot_blob[i].last_hash, sizeof(snapshot_blob[i].last_hash) - 1);
-            i++;
-        }
+void PxlsCanvas::TrimPlanes(const unsigned first_row, const unsigned last_row) {
+    if (!PxlsPlaneMemory::Enabled() || first_row > last_row || last_row >= canvas_height) return;
+    const auto EvictPlane = [&]<typename T>(const PxlsPlane<T> &plane) {
+        const std::size_t row_bytes = static_cast<std::size_t>(canvas_width) * sizeof(T);
+        PxlsPlaneMemory::Evict(plane.data(), first_row * row_bytes);
+        PxlsPlaneMemory::Evict(plane.data() + static_cast<std::size_t>(last_row + 1) * canvas_width,
+            (canvas_height - 1 - last_row) * row_bytes);
+    };
+    EvictPlane(color_plane);
+    EvictPlane(count_plane);
+    EvictPlane(time_plane);
+    EvictPlane(action_plane);
+    EvictPlane(hash_plane);
+    EvictPlane(stale_plane);
+}
+
+void PxlsCanvas::UnloadTextures() {
+    if (shader_loaded)
+        UnloadShader(palette_shader);
+    if (index_texture.id != 0)
+        UnloadTexture(index_texture);
+    if (palette_texture.id != 0)
+        UnloadTexture(palette_texture);
+    palette_shader = {}; palette_location = -1; shader_loaded = false;
+    index_texture = {}; palette_texture = {};
+    texture_width = texture_height = 0;
+    palette_dirty = true;
+}
+
+bool PxlsCanvas::UpdateTextures() {
+    // the shader is only tried once, raylib falls back to its default shader if it fails to compile
+    if (!shader_loaded) {
+        palette_shader = LoadShaderFromMemory(nullptr, PALETTE_FRAGMENT_SHADER);
+        palette_location = GetShaderLocation(palette_shader, "palette");
+        shader_loaded = true;
+    }
+    if (palette_shader.id == rlGetShaderIdDefault() || palette_location == -1) return false;
+    if (texture_width != canvas_width || texture_height != canvas_height) {
+        if (index_texture.id != 0)
+            UnloadTexture(index_texture);
+        index_texture = LoadTextureFromImage({
+            color_plane.data(), static_cast<int>(canvas_width), static_cast<int>(canvas_height), 1, PIXELFORMAT_UNCOMPRESSED_GRAYSCALE
+        });
+        texture_width = canvas_width; texture_height = canvas_height;
+        dirty_begin = dirty_end = 0;
+    } else if (index_texture.id != 0 && dirty_begin < dirty_end) {
+        // upload the rows containing the changed pixels
+        const auto first_row = dirty_begin / canvas_width, last_row = (dirty_end - 1) / canvas_width;
+        UpdateTextureRec(index_texture, {
+            0.0f, static_cast<float>(first_row), static_cast<float>(canvas_width), static_cast<float>(last_row - first_row + 1)
+        }, color_plane.data() + first_row * canvas_width);
+        dirty_begin = dirty_end = 0;
+    }
+    if (palette_dirty) {
+        std::array<Color, PALETTE_TEXTURE_SIZE> palette_colors;
+        for (unsigned color_index = 0; color_index < PALETTE_TEXTURE_SIZE; color_index++)
+            palette_colors[color_index] = GetPaletteColor(color_index);
+        if (palette_texture.id == 0)
+            palette_texture = LoadTextureFromImage({ palette_colors.data(), PALETTE_TEXTURE_SIZE, 1, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 });
+        else
+            UpdateTexture(palette_texture, palette_colors.data());
+        palette_dirty = false;
     }
+    // textures larger than the gpu supports can't be created
+    return index_texture.id != 0 && palette_texture.id != 0;
+}
+
+bool PxlsCanvas::DumpSnapshot(std::vector<char> &snapshot_blob) const {
+    if (canvas_width == 0 || canvas_height == 0) return false;
+    EncodeSnapshot(canvas_width, canvas_height, [&](const std::size_t i) {
+        PxlsCanvasSnapshotPixel snapshot_pixel;
+        snapshot_pixel.last_time = time_plane[i];
+        snapshot_pixel.manipulate_count = count_plane[i];
+        snapshot_pixel.color_index = color_plane[i];
+        return std::make_tuple(snapshot_pixel, hash_plane[i], std::string_view { action_plane[i] });
+    }, snapshot_blob);
     return true;
 }
 
-bool PxlsCanvas::LoadSnapshot(const PxlsCanvasSnapshotPixel *snapshot_blob) {
+bool PxlsCanvas::LoadSnapshot(const std::size_t snapshot_bytes, const SnapshotReadCallback &read) {
     if (canvas_width == 0 || canvas_height == 0) return false;
-    for (unsigned x = 0; x < canvas_width; x++) {
-        for (unsigned y = 0; y < canvas_height; y++) {
-            canvas[x][y] = {
-                snapshot_blob[x * canvas_height + y].manipulate_count,
-                sys_time_ms { std::chrono::milliseconds(snapshot_blob[x * canvas_height + y].last_time) },
-                snapshot_blob[x * canvas_height + y].last_action,
-                snapshot_blob[x * canvas_height + y].last_hash,
-                snapshot_blob[x * canvas_height + y].color_index
-            };
+    PxlsProfileScope profile_scope(PxlsProfiler::LOAD_SNAPSHOT);
+    // the canvas only keeps the pixels inside the region, which never match the checksum of the whole snapshot
+    if (const auto checksum = SnapshotChecksum(snapshot_bytes, read); !region && checksum && *checksum == canvas_checksum)
+        return true;
+    // decode into the canvas planes in place, so that no second copy of the canvas is allocated
+    PxlsCanvasState state;
+    state.width = canvas_width; state.height = canvas_height;
+    state.color_plane = std::move(color_plane);
+    state.count_plane = std::move(count_plane);
+    state.time_plane = std::move(time_plane);
+    state.action_plane = std::move(action_plane);
+    state.hash_plane = std::move(hash_plane);
+    state.stale_plane = std::move(stale_plane);
+    const bool decoded = DecodeSnapshot(snapshot_bytes, read, state, region);
+    color_plane = std::move(state.color_plane);
+    count_plane = std::move(state.count_plane);
+    time_plane = std::move(state.time_plane);
+    action_plane = std::move(state.action_plane);
+    hash_plane = std::move(state.hash_plane);
+    stale_plane = std::move(state.stale_plane);
+    canvas_checksum = state.checksum;
+    MarkColorsDirty(0, color_plane.size());
+    // the planes may be decoded partially
+    if (!decoded)
+        ClearCanvas();
+    return decoded;
+}
+
+bool PxlsCanvas::DecodeSnapshot(const std::size_t snapshot_bytes, const SnapshotReadCallback &read, PxlsCanvasState &state,
+                                const std::optional<PxlsRegion> &decoded_region) {
+    const std::size_t pixel_count = static_cast<std::size_t>(state.width) * state.height;
+    PxlsCanvasSnapshotHeader header;
+    const auto header_bytes = ReadSnapshotHeader(snapshot_bytes, read, header);
+    const bool has_header = header_bytes != 0;
+    if (!has_header && snapshot_bytes != pixel_count * sizeof(PxlsCanvasLegacySnapshotPixel)) return false;
+    const auto pixels_bytes = has_header ? static_cast<std::size_t>(header.width) * header.height * sizeof(PxlsCanvasSnapshotPixel) : 0;
+    if (has_header && ((header.version != SNAPSHOT_VERSION && header.version != SNAPSHOT_VERSION_NO_CHECKSUM) ||
+        header.width > state.width || header.height > state.height ||
+        snapshot_bytes != header_bytes + pixels_bytes + header.dictionary_bytes))
+        return false;
+    // split the string dictionary before touching the planes, hashes are converted to the ids of the process-wide hash table
+    std::string dictionary;
+    std::vector<std::uint32_t> hash_ids;
+    std::vector<std::string_view> action_names;
+    if (has_header) {
+        dictionary.resize(header.dictionary_bytes);
+        if (!read(header_bytes + pixels_bytes, dictionary.data(), dictionary.size())) return false;
+        std::size_t str_begin = 0;
+        for (std::uint64_t i = 0; i < static_cast<std::uint64_t>(header.hash_count) + header.action_count; i++) {
+            const auto str_end = dictionary.find('\0', str_begin);
+            if (str_end == std::string::npos) return false;
+            const std::string_view str { dictionary.data() + str_begin, str_end - str_begin };
+            if (i < header.hash_count)
+                hash_ids.push_back(PxlsHashTable::Intern(str));
+            else
+                action_names.push_back(str);
+            str_begin = str_end + 1;
         }
     }
+    const PxlsCanvasPixel virgin_pixel;
+    // pixels outside a smaller snapshot or the decoded region stay virgin
+    state.color_plane.assign(pixel_count, virgin_pixel.color_index);
+    state.count_plane.assign(pixel_count, virgin_pixel.manipulate_count);
+    state.time_plane.assign(pixel_count, virgin_pixel.last_time.time_since_epoch().count());
+    state.action_plane.assign(pixel_count, virgin_pixel.last_action);
+    state.hash_plane.assign(pixel_count, virgin_pixel.last_hash_id);
+    state.stale_plane.assign(pixel_count, 0);
+    state.checksum = 0;
+    // bounds of the decoded pixels
+    const auto snapshot_width = has_header ? header.width : state.width;
+    const auto snapshot_height = has_header ? header.height : state.height;
+    const auto bounds = decoded_region.value_or(PxlsRegion { 0, 0, snapshot_width, snapshot_height });
+    const auto x_begin = std::min(bounds.x, snapshot_width), y_begin = std::min(bounds.y, snapshot_height);
+    const auto x_end = x_begin + std::min(bounds.width, snapshot_width - x_begin);
+    const auto y_end = y_begin + std::min(bounds.height, snapshot_height - y_begin);
+    if (!has_header) {
+        // legacy pixels are stored column by column
+        std::vector<PxlsCanvasLegacySnapshotPixel> chunk(std::max<std::size_t>(SNAPSHOT_CHUNK_BYTES / sizeof(PxlsCanvasLegacySnapshotPixel), 1));
+        return ForEachSpan(x_begin, x_end, y_begin, y_end, state.height, [&](const std::size_t first, const std::size_t count) {
+            return ReadSnapshotPixels(read, 0, first, count, chunk, [&](const std::size_t snapshot_index, const PxlsCanvasLegacySnapshotPixel &snapshot_pixel) {
+                const auto i = snapshot_index % state.height * state.width + snapshot_index / state.height;
+                state.count_plane[i] = snapshot_pixel.manipulate_count;
+                state.time_plane[i] = snapshot_pixel.last_time;
+                state.action_plane[i] = snapshot_pixel.last_action;
+                state.hash_plane[i] = PxlsHashTable::Intern(
+                    { snapshot_pixel.last_hash, strnlen(snapshot_pixel.last_hash, sizeof(snapshot_pixel.last_hash)) });
+                state.color_plane[i] = snapshot_pixel.color_index <= UINT8_MAX ? snapshot_pixel.color_index : FALLBACK_COLOR_INDEX;
+                state.checksum ^= PxlsApplyKernel::PixelChecksum(i % state.width, i / state.width, state.color_plane[i], state.count_plane[i]);
+            });
+        });
+    }
+    std::vector<PxlsCanvasSnapshotPixel> chunk(SNAPSHOT_CHUNK_BYTES / sizeof(PxlsCanvasSnapshotPixel));
+    const bool decoded = ForEachSpan(y_begin, y_end, x_begin, x_end, header.width, [&](const std::size_t first, const std::size_t count) {
+        return ReadSnapshotPixels(read, header_bytes, first, count, chunk, [&](const std::size_t snapshot_index, const PxlsCanvasSnapshotPixel &snapshot_pixel) {
+            const auto i = snapshot_index / header.width * state.width + snapshot_index % header.width;
+            state.count_plane[i] = snapshot_pixel.manipulate_count;
+            state.time_plane[i] = snapshot_pixel.last_time;
+            state.color_plane[i] = snapshot_pixel.color_index;
+            state.hash_plane[i] = snapshot_pixel.hash_index < hash_ids.size() ? hash_ids[snapshot_pixel.hash_index] : virgin_pixel.last_hash_id;
+            if (snapshot_pixel.action_index < action_names.size())
+                state.action_plane[i] = action_names[snapshot_pixel.action_index];
+            else
+                state.action_plane[i] = virgin_pixel.last_action;
+            state.checksum ^= PxlsApplyKernel::PixelChecksum(snapshot_index % header.width, snapshot_index / header.width,
+                snapshot_pixel.color_index, snapshot_pixel.manipulate_count);
+        });
+    });
+    // the checksum only covers the whole snapshot
+    const bool decoded_entirely = x_begin == 0 && y_begin == 0 && x_end == snapshot_width && y_end == snapshot_height;
+    return decoded && (header.version == SNAPSHOT_VERSION_NO_CHECKSUM || !decoded_entirely || state.checksum == header.checksum);
+}
+
+std::optional<std::uint64_t> PxlsCanvas::SnapshotChecksum(const std::size_t snapshot_bytes, const SnapshotReadCallback &read) {
+    PxlsCanvasSnapshotHeader header;
+    if (ReadSnapshotHeader(snapshot_bytes, read, header) == 0 || header.version != SNAPSHOT_VERSION) return std::nullopt;
+    return header.checksum;
+}
+
+void PxlsCanvas::SaveState(PxlsCanvasState &state) const {
+    state.width = canvas_width; state.height = canvas_height;
+    state.color_plane = color_plane;
+    state.count_plane = count_plane;
+    state.time_plane = time_plane;
+    state.action_plane = action_plane;
+    state.hash_plane = hash_plane;
+    state.stale_plane = stale_plane;
+    state.checksum = canvas_checksum;
+}
+
+bool PxlsCanvas::LoadState(const PxlsCanvasState &state) {
+    if (canvas_width == 0 || canvas_height == 0 || state.width != canvas_width || state.height != canvas_height) return false;
+    if (state.checksum == canvas_checksum) return true;
+    PxlsProfileScope profile_scope(PxlsProfiler::LOAD_SNAPSHOT);
+    color_plane = state.color_plane;
+    count_plane = state.count_plane;
+    time_plane = state.time_plane;
+    action_plane = state.action_plane;
+    hash_plane = state.hash_plane;
+    stale_plane = state.stale_plane;
+    canvas_checksum = state.checksum;
+    MarkColorsDirty(0, color_plane.size());
     return true;
 }
+
+std::size_t PxlsCanvasState::MemoryUsage() const {
+    std::size_t bytes = (color_plane.capacity() + stale_plane.capacity()) * sizeof(std::uint8_t) + count_plane.capacity() * sizeof(unsigned) +
+        time_plane.capacity() * sizeof(long long) + hash_plane.capacity() * sizeof(std::uint32_t) +
+        action_plane.capacity() * sizeof(std::string);
+    // count heap allocated string buffers, short strings are stored inline
+    const std::string empty_string;
+    for (const auto &str: action_plane) {
+        if (str.capacity() > empty_string.capacity())
+            bytes += str.capacity() + 1;
+    }
+    return bytes;
+}
+
+void PxlsSnapshotBuilder::PerformAction(const unsigned x, const unsigned y, const long long time, const std::string_view action,
+                                        const std::string_view hash, const unsigned color_index) {
+    if (x >= width || y >= height)
+        Grow(std::max(width, x + 1), std::max(height, y + 1));
+    auto &pixel = pixels[static_cast<std::size_t>(y) * stride + x];
+    pixel.manipulate_count++;
+    pixel.last_time = time;
+    pixel.color_index = color_index <= UINT8_MAX ? color_index : PxlsCanvas::FALLBACK_COLOR_INDEX;
+    pixel.hash_index = PxlsHashTable::Intern(hash);
+    // there are only a few kinds of actions, so a linear search is enough
+    std::uint32_t action_index = 0;
+    while (action_index < action_names.size() && action_names[action_index] != action)
+        action_index++;
+    if (action_index == action_names.size())
+        action_names.emplace_back(action);
+    pixel.action_index = action_index;
+}
+
+bool PxlsSnapshotBuilder::DumpSnapshot(std::vector<char> &snapshot_blob) const {
+    if (width == 0 || height == 0) return false;
+    EncodeSnapshot(width, height, [&](const std::size_t i) {
+        const auto &pixel = pixels[i / width * stride + i % width];
+        return std::make_tuple(pixel, pixel.hash_index, std::string_view { action_names[pixel.action_index] });
+    }, snapshot_blob);
+    return true;
+}
+
+void PxlsSnapshotBuilder::Clear() {
+    pixels.clear();
+    action_names.resize(1);
+    width = height = stride = rows = 0;
+}
+
+void PxlsSnapshotBuilder::Grow(const unsigned new_width, const unsigned new_height) {
+    width = new_width; height = new_height;
+    if (width <= stride && height <= rows) return;
+    const auto new_stride = std::max(width, stride + stride / 4), new_rows = std::max(height, rows + rows / 4);
+    const PxlsCanvasPixel virgin_pixel;
+    PxlsCanvasSnapshotPixel virgin_snapshot_pixel;
+    virgin_snapshot_pixel.last_time = virgin_pixel.last_time.time_since_epoch().count();
+    virgin_snapshot_pixel.manipulate_count = virgin_pixel.manipulate_count;
+    virgin_snapshot_pixel.hash_index = virgin_pixel.last_hash_id;
+    virgin_snapshot_pixel.color_index = virgin_pixel.color_index;
+    std::vector<PxlsCanvasSnapshotPixel> new_pixels(static_cast<std::size_t>(new_stride) * new_rows, virgin_snapshot_pixel);
+    for (std::size_t y = 0; y < rows; y++)
+        std::copy_n(pixels.begin() + y * stride, stride, new_pixels.begin() + y * new_stride);
+    pixels = std::move(new_pixels);
+    stride = new_stride; rows = new_rows;
+}
@@ -12,9 +12,19 @@
 #include <sstream>
 #include <optional>
 #include <memory>
+#include <array>
+#include <tuple>
+#include <algorithm>
+#include <unordered_map>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
 #include "raylib.h"
 #include "nlohmann/json.hpp"
-#include "date/date.h"
+#include "PxlsLogDB.h"
+#include "PxlsApplyKernel.h"
+#include "PxlsHashTable.h"
+#include "PxlsPlaneMemory.h"
 using json = nlohmann::ordered_json;
 using sys_time_ms = std::chrono::sys_time<std::chrono::milliseconds>;
 using hh_mm_ss = std::chrono::hh_mm_ss<std::chrono::milliseconds>;
@@ -31,14 +41,38 @@ struct PxlsCanvasPixel {
     sys_time_ms last_time {};
     // last action name
     std::string last_action = "none";
-    // last action hash, used to distinguish one user's pixels from others
-    std::string last_hash = "<empty>";
+    // id of last action hash in the hash table, used to distinguish one user's pixels from others
+    std::uint32_t last_hash_id { PxlsHashTable::EMPTY_ID };
     // color index in the palette
     unsigned color_index { 0 };
 };
 
+// header of snapshot blobs, followed by the pixels in row-major order and the string dictionary of the snapshot,
+// which consists of hash_count hashes and action_count action names, each terminated by '\0'
+struct PxlsCanvasSnapshotHeader {
+    char magic[8] {};
+    std::uint32_t version { 0 };
+    std::uint32_t width { 0 }, height { 0 };
+    std::uint32_t hash_count { 0 }, action_count { 0 };
+    std::uint32_t reserved { 0 };
+    std::uint64_t dictionary_bytes { 0 };
+    // checksum of the pixels, which the header of version 2 ends before
+    std::uint64_t checksum { 0 };
+};
+
 // used for storing canvas pixels in the snapshot
 struct PxlsCanvasSnapshotPixel {
+    long long last_time {};
+    unsigned manipulate_count { 0 };
+    // index of hash and action name in the string dictionary of the snapshot
+    std::uint32_t hash_index { 0 };
+    std::uint32_t action_index { 0 };
+    std::uint8_t color_index { 0 };
+    std::uint8_t reserved[3] {};
+};
+
+// pixels of snapshots created by older versions, which have no header and are stored column by column
+struct PxlsCanvasLegacySnapshotPixel {
     unsigned manipulate_count { 0 };
     long long last_time {};
     char last_action[14] {};
@@ -46,6 +80,21 @@ struct PxlsCanvasSnapshotPixel {
     unsigned color_index { 0 };
 };
 
+// decoded canvas planes, used for keeping canvas states in memory
+struct PxlsCanvasState {
+    unsigned width { 0 }, height { 0 };
+    PxlsPlane<std::uint8_t> color_plane;
+    PxlsPlane<unsigned> count_plane;
+    PxlsPlane<long long> time_plane;
+    PxlsPlane<std::string> action_plane;
+    PxlsPlane<std::uint32_t> hash_plane;
+    PxlsPlane<std::uint8_t> stale_plane;
+    // checksum of the planes, see PxlsApplyKernel::PixelChecksum
+    std::uint64_t checksum { 0 };
+    // approximate memory usage in bytes
+    [[nodiscard]] std::size_t MemoryUsage() const;
+};
+
 enum ActionDirection { REDO, UNDO };
 
 class PxlsCanvas {
@@ -58,42 +107,125 @@ public:
     void ClearCanvas();
     // get readonly access to palette
     [[nodiscard]] const auto& Palette() const { return palette; }
-    // get readonly access to canvas
-    [[nodiscard]] const auto& Canvas() const { return canvas; }
+    // hash of palette colors, used for telling if the logdb was created with another palette. snapshots store color
+    // indices, so they are rendered with the current palette either way
+    [[nodiscard]] std::uint64_t PaletteHash() const;
+    // get a pixel of the canvas, the position must be in bounds
+    [[nodiscard]] PxlsCanvasPixel Pixel(unsigned x, unsigned y) const;
+    // get color index of a pixel, the position must be in bounds
+    [[nodiscard]] unsigned ColorIndex(const unsigned x, const unsigned y) const { return color_plane[y * canvas_width + x]; }
     // get palette color by color index
     [[nodiscard]] Color GetPaletteColor(unsigned color_index) const;
     // get palette color name by color index
     [[nodiscard]] std::string GetPaletteColorName(unsigned color_index) const;
     // perform action on the specified pixel, either redo or undo, return false if out of bounds
-    bool PerformAction(unsigned x, unsigned y, ActionDirection direction, std::optional<std::string> time_str,
+    // time is the epoch time in milliseconds
+    bool PerformAction(unsigned x, unsigned y, ActionDirection direction, std::optional<long long> time,
                     const std::optional<std::string> &action, const std::optional<std::string> &hash, const std::optional<unsigned> &color_index);
+    // perform a batch of actions queried from the columnar sidecar using the apply kernel, records out of bounds are skipped
+    void PerformBatch(const PxlsRecordBatch &batch, const PxlsLogColumns &columns);
+    // correct the canvas state at a record id into the state of the records selected by a filter,
+    // the pixels outside the region of interest are skipped since they are not decoded from snapshots
+    void ApplyCorrections(const std::vector<PxlsFilterCorrection> &corrections, const PxlsLogColumns &columns);
+    // checksum of the canvas, which is updated incrementally by every change of colors and action counts.
+    // canvas states with the same checksum are regarded as identical
+    [[nodiscard]] std::uint64_t Checksum() const { return canvas_checksum; }
+    // enable/disable color-only replay, which only keeps colors and action counts up to date.
+    // the metadata of the pixels changed meanwhile becomes stale until they are changed by a full replay
+    void ColorOnly(const bool enable) { color_only = enable; }
+    [[nodiscard]] bool ColorOnly() const { return color_only; }
+    // is the metadata of a pixel stale, the position must be in bounds
+    [[nodiscard]] bool IsMetadataStale(const unsigned x, const unsigned y) const { return stale_plane[y * canvas_width + x]; }
     // get/set canvas view
     void ViewCenter(Vector2 center);
     [[nodiscard]] const Vector2& ViewCenter() const { return view_center; }
     void Scale(float s);
     [[nodiscard]] float Scale() const { return scale; }
+    // get/set region of interest, pixels outside the region are not rendered since they are not kept up to date
+    void Region(const std::optional<PxlsRegion> &r);
+    [[nodiscard]] const auto& Region() const { return region; }
     // highlight and de-highlight a pixel
     bool Highlight(unsigned x, unsigned y);
     void DeHighlight();
     // given a position in the window, calc the position of the nearest pixel in the canvas, return false if out of bounds
     bool GetNearestPixelPos(Vector2 window_pos, unsigned &canvas_x, unsigned &canvas_y) const;
-    // render canvas using raylib
+    // render canvas using raylib. the color plane is uploaded as a palette index texture, whose colors are looked up from
+    // a palette texture by a shader, so the per-frame cost doesn't depend on the canvas size. falls back to drawing
+    // pixels one by one if the shader or the textures can't be created
     void Render();
-    // dump/load canvas snapshot
-    bool DumpSnapshot(std::shared_ptr<PxlsCanvasSnapshotPixel[]> &snapshot_blob) const;
-    bool LoadSnapshot(const PxlsCanvasSnapshotPixel *snapshot_blob);
+    // release the textures and the shader, which must be done before closing the window
+    void UnloadTextures();
+    // dump/load canvas snapshot, snapshots created by older versions can still be loaded
+    bool DumpSnapshot(std::vector<char> &snapshot_blob) const;
+    // the snapshot is read in chunks and decoded into the canvas planes directly, only the pixels inside the region of
+    // interest are read if it is set. decoding is skipped if the checksum of the snapshot matches the canvas.
+    // return false if the snapshot is unusable, the canvas is cleared then
+    bool LoadSnapshot(std::size_t snapshot_bytes, const SnapshotReadCallback &read);
+    // decode snapshot into a canvas state whose dimension is set, return false if the snapshot doesn't fit into it.
+    // snapshots created while converting pxls log may be smaller, the pixels outside them are virgin, and so are the
+    // pixels outside decoded_region. the state is untouched if the snapshot is rejected before decoding pixels.
+    // a snapshot decoded entirely is rejected if its pixels don't match the checksum in its header
+    static bool DecodeSnapshot(std::size_t snapshot_bytes, const SnapshotReadCallback &read, PxlsCanvasState &state,
+                               const std::optional<PxlsRegion> &decoded_region = std::nullopt);
+    // get the checksum stored in a snapshot, snapshots created by older versions have none
+    static std::optional<std::uint64_t> SnapshotChecksum(std::size_t snapshot_bytes, const SnapshotReadCallback &read);
+    // save/load decoded canvas state, the state must have the same dimension when loading.
+    // loading is skipped if the state has the same checksum as the canvas
+    void SaveState(PxlsCanvasState &state) const;
+    bool LoadState(const PxlsCanvasState &state);
     // background color of the canvas
     static constexpr Color BACKGROUND_COLOR { 0xC5, 0xC5, 0xC5 };
     // pixel color used when the palette is empty or the color index is out of range
     static constexpr auto FALLBACK_PIXEL_COLOR { WHITE };
+    // color index stored in the color plane when the color index doesn't fit into it
+    static constexpr std::uint8_t FALLBACK_COLOR_INDEX { UINT8_MAX };
+    // outline color of the region of interest
+    static constexpr Color REGION_OUTLINE_COLOR { 0xFF, 0x40, 0x40, 0xFF };
+    // magic and version of the snapshot format
+    static constexpr char SNAPSHOT_MAGIC[8] { 'P', 'X', 'S', 'N', 'A', 'P', '\0', '\0' };
+    static constexpr std::uint32_t SNAPSHOT_VERSION { 3 };
+    // the version before checksums were added, whose header is shorter
+    static constexpr std::uint32_t SNAPSHOT_VERSION_NO_CHECKSUM { 2 };
+    // bytes of snapshot read at a time when decoding
+    static constexpr std::size_t SNAPSHOT_CHUNK_BYTES { 1 << 20 };
+    // number of palette texture entries, which covers all color indices in the color plane
+    static constexpr unsigned PALETTE_TEXTURE_SIZE { UINT8_MAX + 1 };
+    // seconds between evictions of the pages of mapped planes outside the window
+    static constexpr double TRIM_INTERVAL { 1.0 };
     // scale limit
     static constexpr float MAX_SCALE { 50.0f };
     static constexpr float MIN_SCALE { 1.0f };
 private:
+    // create the shader and the textures if necessary and upload the changes, return false if they are unavailable
+    bool UpdateTextures();
+    // evict the pages of mapped planes outside the rows from first_row to last_row, which are shown in the window.
+    // the rows touched by replaying since the last time are resident again until the next time
+    void TrimPlanes(unsigned first_row, unsigned last_row);
+    // mark the color plane changed from begin to end, which is uploaded when rendering
+    void MarkColorsDirty(const std::size_t begin, const std::size_t end) {
+        if (dirty_begin >= dirty_end) {
+            dirty_begin = begin; dirty_end = end;
+        } else {
+            dirty_begin = std::min(dirty_begin, begin); dirty_end = std::max(dirty_end, end);
+        }
+    }
     // palette
     std::vector<PxlsCanvasColor> palette;
-    // canvas
-    std::vector<std::vector<PxlsCanvasPixel>> canvas;
+    // canvas planes, indexed by y * canvas_width + x so that records can be scattered into them directly.
+    // they are mapped from scratch files when the planes exceed the resident budget of PxlsPlaneMemory
+    PxlsPlane<std::uint8_t> color_plane;
+    PxlsPlane<unsigned> count_plane;
+    PxlsPlane<long long> time_plane;
+    PxlsPlane<std::string> action_plane;
+    PxlsPlane<std::uint32_t> hash_plane;
+    // whether the metadata of pixels is left behind by color-only replay
+    PxlsPlane<std::uint8_t> stale_plane;
+    bool color_only { false };
+    // checksum of the planes
+    std::uint64_t canvas_checksum { 0 };
+    // plane indices and kernel results of the last applied batch
+    std::vector<std::uint32_t> batch_indices;
+    std::vector<PxlsApplyResult> batch_results;
     // canvas dimension
     unsigned canvas_width { 0 }, canvas_height { 0 };
     // window dimension
@@ -102,9 +234,48 @@ private:
     Vector2 view_center { 0.0, 0.0 };
     // scale of the view, it is actually the width of pixel
     float scale { 1.0f };
+    // region of interest
+    std::optional<PxlsRegion> region { std::nullopt };
     // highlight pixel info
     bool do_highlight { false };
     unsigned highlight_x { 0 }, highlight_y { 0 };
+    // gpu resources for rendering, created lazily since the canvas is initialized before the window
+    Shader palette_shader {};
+    int palette_location { -1 };
+    bool shader_loaded { false };
+    Texture2D index_texture {}, palette_texture {};
+    // dimension of the index texture, which is recreated when the canvas is initialized with another dimension
+    unsigned texture_width { 0 }, texture_height { 0 };
+    bool palette_dirty { true };
+    // range of the color plane changed since the last upload
+    std::size_t dirty_begin { 0 }, dirty_end { 0 };
+    // time of the last eviction of mapped planes
+    double last_trim_time { 0.0 };
+};
+
+// a canvas without rendering and view state, which grows with the records applied to it.
+// used for creating snapshots in the same pass as converting pxls log
+class PxlsSnapshotBuilder {
+public:
+    // apply a record, the canvas grows to contain it. time is the epoch time in milliseconds
+    void PerformAction(unsigned x, unsigned y, long long time, std::string_view action, std::string_view hash, unsigned color_index);
+    // dump snapshot of the records applied so far, whose dimension is based on the maximum coordinates among them
+    bool DumpSnapshot(std::vector<char> &snapshot_blob) const;
+    // drop all pixels
+    void Clear();
+    [[nodiscard]] unsigned Width() const { return width; }
+    [[nodiscard]] unsigned Height() const { return height; }
+private:
+    // grow the dimension, planes are reallocated geometrically so that growing a row or a column at a time is cheap
+    void Grow(unsigned new_width, unsigned new_height);
+    // pixels indexed by y * stride + x, which are kept together since a record updates all fields of a pixel.
+    // hash_index is the id in the hash table and action_index is the index in action_names
+    std::vector<PxlsCanvasSnapshotPixel> pixels;
+    // the first one is the action of virgin pixels
+    std::vector<std::string> action_names { PxlsCanvasPixel {}.last_action };
+    unsigned width { 0 }, height { 0 };
+    // allocated dimension of planes
+    unsigned stride { 0 }, rows { 0 };
 };
 
 #endif //PXLSCANVAS_H
@@ -0,0 +1,38 @@
+//
+// PxlsHashTable implementation
+//
+
+#include "PxlsHashTable.h"
+
+std::shared_mutex PxlsHashTable::mutex;
+std::deque<std::string> PxlsHashTable::hashes;
+std::unordered_map<std::string_view, std::uint32_t> PxlsHashTable::ids;
+
+std::uint32_t PxlsHashTable::Intern(const std::string_view hash) {
+    if (hash == EMPTY_HASH) return EMPTY_ID;
+    {
+        // most hashes are interned already, so try with the shared lock first
+        std::shared_lock lock(mutex);
+        if (const auto it = ids.find(hash); it != ids.end())
+            return it->second;
+    }
+    std::unique_lock lock(mutex);
+    // the hash may be added by others after releasing the shared lock
+    if (const auto it = ids.find(hash); it != ids.end())
+        return it->second;
+    const auto &interned_hash = hashes.emplace_back(hash);
+    const auto id = static_cast<std::uint32_t>(hashes.size());
+    ids.emplace(interned_hash, id);
+    return id;
+}
+
+std::string_view PxlsHashTable::Lookup(const std::uint32_t id) {
+    std::shared_lock lock(mutex);
+    if (id == EMPTY_ID || id > hashes.size()) return EMPTY_HASH;
+    return hashes[id - 1];
+}
+
+std::size_t PxlsHashTable::Size() {
+    std::shared_lock lock(mutex);
+    return hashes.size();
+}
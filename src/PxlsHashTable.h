@@ -0,0 +1,33 @@
+//
+// Provide a process-wide table that interns user hashes into compact ids
+//
+
+#ifndef PXLSHASHTABLE_H
+#define PXLSHASHTABLE_H
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+
+class PxlsHashTable {
+public:
+    // get the id of a hash, adding it to the table if necessary. the empty hash always gets EMPTY_ID
+    static std::uint32_t Intern(std::string_view hash);
+    // get the hash of an id, which stays valid for the lifetime of the process. unknown ids get the empty hash
+    static std::string_view Lookup(std::uint32_t id);
+    // number of interned hashes, excluding the empty hash
+    static std::size_t Size();
+    // id and hash of virgin pixels
+    static constexpr std::uint32_t EMPTY_ID { 0 };
+    static constexpr std::string_view EMPTY_HASH { "<empty>" };
+private:
+    static std::shared_mutex mutex;
+    // interned hashes indexed by id - 1, a deque never moves its elements so that the views stay valid
+    static std::deque<std::string> hashes;
+    static std::unordered_map<std::string_view, std::uint32_t> ids;
+};
+
+#endif //PXLSHASHTABLE_H
@@ -0,0 +1,75 @@
+//
+// PxlsKeyframeCache implementation
+//
+
+#include "PxlsKeyframeCache.h"
+
+void PxlsKeyframeCache::Budget(const std::size_t budget_bytes) {
+    budget = budget_bytes;
+    Evict();
+}
+
+bool PxlsKeyframeCache::Insert(const unsigned long id, PxlsCanvasState &&state) {
+    const auto checksum = state.checksum;
+    if (const auto state_it = states.find(checksum); state_it == states.end()) {
+        const auto bytes = state.MemoryUsage();
+        if (bytes > budget) return false;
+        if (const auto it = entries.find(id); it != entries.end())
+            Erase(it);
+        states[checksum] = { std::move(state), bytes, 0 };
+        usage += bytes;
+    } else {
+        // states with the same checksum but another dimension belong to another canvas
+        if (state_it->second.state.width != state.width || state_it->second.state.height != state.height) return false;
+        if (const auto it = entries.find(id); it != entries.end()) {
+            if (it->second.checksum == checksum) {
+                lru.splice(lru.begin(), lru, it->second.lru_it);
+                return true;
+            }
+            Erase(it);
+        }
+    }
+    states[checksum].ref_count++;
+    lru.push_front(id);
+    entries[id] = { checksum, lru.begin() };
+    Evict();
+    return true;
+}
+
+std::optional<unsigned long> PxlsKeyframeCache::Nearest(const unsigned long id) const {
+    if (entries.empty()) return std::nullopt;
+    // the nearest keyframe is either the first one not before id or the one before it
+    const auto next_it = entries.lower_bound(id);
+    if (next_it == entries.end()) return std::prev(next_it)->first;
+    if (next_it == entries.begin()) return next_it->first;
+    const auto prev_it = std::prev(next_it);
+    return id - prev_it->first <= next_it->first - id ? prev_it->first : next_it->first;
+}
+
+const PxlsCanvasState* PxlsKeyframeCache::Get(const unsigned long id) {
+    const auto it = entries.find(id);
+    if (it == entries.end()) return nullptr;
+    lru.splice(lru.begin(), lru, it->second.lru_it);
+    return &states.at(it->second.checksum).state;
+}
+
+void PxlsKeyframeCache::Clear() {
+    entries.clear();
+    states.clear();
+    lru.clear();
+    usage = 0;
+}
+
+void PxlsKeyframeCache::Evict() {
+    while (usage > budget && !lru.empty())
+        Erase(entries.find(lru.back()));
+}
+
+void PxlsKeyframeCache::Erase(const std::map<unsigned long, Entry>::iterator it) {
+    lru.erase(it->second.lru_it);
+    if (const auto state_it = states.find(it->second.checksum); --state_it->second.ref_count == 0) {
+        usage -= state_it->second.bytes;
+        states.erase(state_it);
+    }
+    entries.erase(it);
+}
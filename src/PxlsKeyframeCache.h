@@ -0,0 +1,59 @@
+//
+// Provide an in-memory LRU cache of decoded canvas states bounded by a memory budget, identical states are kept once
+//
+
+#ifndef PXLSKEYFRAMECACHE_H
+#define PXLSKEYFRAMECACHE_H
+#include <map>
+#include <list>
+#include <unordered_map>
+#include <optional>
+#include <cstddef>
+#include "PxlsCanvas.h"
+
+class PxlsKeyframeCache {
+public:
+    explicit PxlsKeyframeCache(std::size_t budget_bytes = DEFAULT_BUDGET) : budget(budget_bytes) {}
+    // get/set memory budget in bytes, least recently used keyframes are evicted when it is exceeded
+    void Budget(std::size_t budget_bytes);
+    [[nodiscard]] std::size_t Budget() const { return budget; }
+    // approximate memory used by cached keyframes in bytes
+    [[nodiscard]] std::size_t MemoryUsage() const { return usage; }
+    // cache the canvas state at a record id, return false if the state is larger than the whole budget.
+    // states with the same checksum as a cached one share it, which costs no memory
+    bool Insert(unsigned long id, PxlsCanvasState &&state);
+    // find the id of the cached keyframe nearest to the record id in either direction
+    [[nodiscard]] std::optional<unsigned long> Nearest(unsigned long id) const;
+    // get a cached keyframe and mark it as recently used, return nullptr if it isn't cached
+    const PxlsCanvasState* Get(unsigned long id);
+    [[nodiscard]] bool Contains(const unsigned long id) const { return entries.contains(id); }
+    // drop all keyframes, which is necessary when they no longer match the canvas
+    void Clear();
+    // default memory budget
+    static constexpr std::size_t DEFAULT_BUDGET { 512ull << 20 };
+private:
+    struct Entry {
+        std::uint64_t checksum { 0 };
+        std::list<unsigned long>::iterator lru_it;
+    };
+    struct SharedState {
+        PxlsCanvasState state;
+        std::size_t bytes { 0 };
+        // number of keyframes sharing the state
+        unsigned ref_count { 0 };
+    };
+    // evict least recently used keyframes until the usage fits into the budget
+    void Evict();
+    // drop a keyframe, and the state if no other keyframe shares it
+    void Erase(std::map<unsigned long, Entry>::iterator it);
+    // keyframes ordered by record id, so that the nearest one can be found quickly
+    std::map<unsigned long, Entry> entries;
+    // cached states by checksum
+    std::unordered_map<std::uint64_t, SharedState> states;
+    // record ids of keyframes, the most recently used one comes first
+    std::list<unsigned long> lru;
+    std::size_t budget { DEFAULT_BUDGET };
+    std::size_t usage { 0 };
+};
+
+#endif //PXLSKEYFRAMECACHE_H
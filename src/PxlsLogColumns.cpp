@@ -0,0 +1,615 @@
+//
+// PxlsLogColumns implementation
+//
+
+#include "PxlsLogColumns.h"
+
+namespace bip = boost::interprocess;
+
+namespace {
+    // align section offsets to 8 bytes
+    std::uint64_t AlignOffset(const std::uint64_t offset) { return (offset + 7) & ~7ull; }
+
+    // append a zigzag-encoded varint
+    void WriteDelta(std::vector<std::uint8_t> &data, const long long delta) {
+        auto value = (static_cast<std::uint64_t>(delta) << 1) ^ static_cast<std::uint64_t>(delta >> 63);
+        while (value >= 0x80) {
+            data.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        data.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    // read a zigzag-encoded varint and advance pos
+    long long ReadDelta(const std::uint8_t *data, std::uint64_t &pos) {
+        std::uint64_t value = 0;
+        unsigned shift = 0;
+        std::uint8_t byte;
+        do {
+            byte = data[pos++];
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        return static_cast<long long>(value >> 1) ^ -static_cast<long long>(value & 1);
+    }
+
+    // write a string section, which consists of count + 1 offsets followed by string data
+    void WriteStrings(std::ostream &file, const std::vector<std::string> &strings) {
+        std::uint32_t str_offset = 0;
+        for (const auto &str: strings) {
+            file.write(reinterpret_cast<const char*>(&str_offset), sizeof(str_offset));
+            str_offset += str.size();
+        }
+        file.write(reinterpret_cast<const char*>(&str_offset), sizeof(str_offset));
+        for (const auto &str: strings)
+            file.write(str.data(), static_cast<std::streamsize>(str.size()));
+    }
+
+    std::uint64_t StringsBytes(const std::vector<std::string> &strings) {
+        std::uint64_t bytes = (strings.size() + 1) * sizeof(std::uint32_t);
+        for (const auto &str: strings)
+            bytes += str.size();
+        return bytes;
+    }
+
+    // a batch of records gathered from scattered positions, which is handed out when it is full
+    class BatchGatherer {
+    public:
+        BatchGatherer(const QueryDirection direction, const RecordBatchQueryCallback &callback) : callback(callback) {
+            batch.direction = direction;
+            batch.x = x_buf.data(); batch.y = y_buf.data();
+            batch.color_index = color_buf.data(); batch.action_id = action_buf.data();
+            batch.user_id = user_buf.data(); batch.time = time_buf.data();
+            if (direction == BACKWARD)
+                batch.has_prev = has_prev_buf.data();
+        }
+        // add a record, or a pixel becoming virgin when querying backwards
+        void Push(const std::uint16_t x, const std::uint16_t y) {
+            x_buf[batch.count] = x; y_buf[batch.count] = y;
+            has_prev_buf[batch.count] = 0;
+            Advance();
+        }
+        void Push(const std::uint16_t x, const std::uint16_t y, const std::uint8_t color_index, const std::uint8_t action_id,
+                  const std::uint32_t user_id, const long long time) {
+            x_buf[batch.count] = x; y_buf[batch.count] = y;
+            color_buf[batch.count] = color_index; action_buf[batch.count] = action_id;
+            user_buf[batch.count] = user_id; time_buf[batch.count] = time;
+            has_prev_buf[batch.count] = 1;
+            Advance();
+        }
+        void Flush() {
+            if (batch.count == 0) return;
+            callback(batch);
+            batch.count = 0;
+        }
+    private:
+        void Advance() {
+            if (++batch.count == PxlsLogColumns::BATCH_SIZE)
+                Flush();
+        }
+        std::vector<std::uint16_t> x_buf = std::vector<std::uint16_t>(PxlsLogColumns::BATCH_SIZE);
+        std::vector<std::uint16_t> y_buf = std::vector<std::uint16_t>(PxlsLogColumns::BATCH_SIZE);
+        std::vector<std::uint8_t> color_buf = std::vector<std::uint8_t>(PxlsLogColumns::BATCH_SIZE);
+        std::vector<std::uint8_t> action_buf = std::vector<std::uint8_t>(PxlsLogColumns::BATCH_SIZE);
+        std::vector<std::uint8_t> has_prev_buf = std::vector<std::uint8_t>(PxlsLogColumns::BATCH_SIZE);
+        std::vector<std::uint32_t> user_buf = std::vector<std::uint32_t>(PxlsLogColumns::BATCH_SIZE);
+        std::vector<long long> time_buf = std::vector<long long>(PxlsLogColumns::BATCH_SIZE);
+        PxlsRecordBatch batch;
+        const RecordBatchQueryCallback &callback;
+    };
+
+    // serialize a bitmap section, which consists of count + 1 offsets relative to the section followed by bitmaps
+    std::vector<char> SerializeBitmaps(const std::vector<PxlsRecordBitmap> &bitmaps) {
+        std::vector<char> bytes((bitmaps.size() + 1) * sizeof(std::uint64_t));
+        for (std::size_t i = 0; i < bitmaps.size(); i++) {
+            const std::uint64_t bitmap_offset = bytes.size();
+            std::memcpy(bytes.data() + i * sizeof(std::uint64_t), &bitmap_offset, sizeof(bitmap_offset));
+            bitmaps[i].Serialize(bytes);
+        }
+        const std::uint64_t end_offset = bytes.size();
+        std::memcpy(bytes.data() + bitmaps.size() * sizeof(std::uint64_t), &end_offset, sizeof(end_offset));
+        return bytes;
+    }
+}
+
+bool PxlsLogColumns::Build(sqlite3 *log_db, const std::string &filename) {
+    if (!log_db) return false;
+    // fetch record count and dimension
+    PxlsLogColumnsHeader new_header;
+    std::memcpy(new_header.magic, MAGIC, sizeof(MAGIC));
+    new_header.version = VERSION;
+    if (sqlite3_exec(log_db, "SELECT IFNULL(MAX(x),0),IFNULL(MAX(y),0),COUNT(*) FROM log", [](void* header_ptr, int, char **argv, char**) -> int {
+        auto *h = static_cast<PxlsLogColumnsHeader*>(header_ptr);
+        h->width = std::stoul(argv[0]) + 1;
+        h->height = std::stoul(argv[1]) + 1;
+        h->record_count = std::stoull(argv[2]);
+        return 0;
+    }, &new_header, nullptr) != SQLITE_OK)
+        return false;
+    // coordinates must fit into the packed columns
+    if (new_header.width > UINT16_MAX + 1u || new_header.height > UINT16_MAX + 1u || new_header.record_count > UINT32_MAX)
+        return false;
+    // lay out fixed-width columns
+    const auto record_count = new_header.record_count;
+    const auto block_count = (record_count + TIME_BLOCK_SIZE - 1) / TIME_BLOCK_SIZE;
+    std::uint64_t offset = AlignOffset(sizeof(PxlsLogColumnsHeader));
+    new_header.x_offset = offset; offset = AlignOffset(offset + record_count * sizeof(std::uint16_t));
+    new_header.y_offset = offset; offset = AlignOffset(offset + record_count * sizeof(std::uint16_t));
+    new_header.color_offset = offset; offset = AlignOffset(offset + record_count * sizeof(std::uint8_t));
+    new_header.action_offset = offset; offset = AlignOffset(offset + record_count * sizeof(std::uint8_t));
+    new_header.user_offset = offset; offset = AlignOffset(offset + record_count * sizeof(std::uint32_t));
+    new_header.prev_offset = offset; offset = AlignOffset(offset + record_count * sizeof(std::uint32_t));
+    new_header.time_base_offset = offset; offset = AlignOffset(offset + block_count * sizeof(long long));
+    new_header.time_pos_offset = offset; offset = AlignOffset(offset + block_count * sizeof(std::uint64_t));
+    const std::uint64_t fixed_bytes = offset;
+    // create the file and map the fixed-width part, so that columns don't have to be held in memory while building
+    if (std::filesystem::exists(filename))
+        std::filesystem::remove(filename);
+    { std::ofstream create_file(filename, std::ios::binary); }
+    std::filesystem::resize_file(filename, fixed_bytes);
+    std::vector<std::uint8_t> time_data;
+    std::vector<std::string> user_hashes, action_names;
+    std::vector<PxlsRecordBitmap> new_action_bitmaps;
+    std::vector<char> bitmap_bytes;
+    try {
+        bip::file_mapping build_file(filename.c_str(), bip::read_write);
+        bip::mapped_region build_region(build_file, bip::read_write);
+        auto *base = static_cast<char*>(build_region.get_address());
+        auto *x_col = reinterpret_cast<std::uint16_t*>(base + new_header.x_offset);
+        auto *y_col = reinterpret_cast<std::uint16_t*>(base + new_header.y_offset);
+        auto *color_col = reinterpret_cast<std::uint8_t*>(base + new_header.color_offset);
+        auto *action_col = reinterpret_cast<std::uint8_t*>(base + new_header.action_offset);
+        auto *user_col = reinterpret_cast<std::uint32_t*>(base + new_header.user_offset);
+        auto *prev_col = reinterpret_cast<std::uint32_t*>(base + new_header.prev_offset);
+        auto *time_base_col = reinterpret_cast<long long*>(base + new_header.time_base_offset);
+        auto *time_pos_col = reinterpret_cast<std::uint64_t*>(base + new_header.time_pos_offset);
+        // intern user hashes and action names
+        std::unordered_map<std::string, std::uint32_t> user_map;
+        std::unordered_map<std::string, std::uint8_t> action_map;
+        sqlite3_stmt *sql_stmt;
+        if (sqlite3_prepare_v2(log_db, "SELECT id,IFNULL(prev_id,0),date,hash,x,y,color_index,action FROM log ORDER BY id;",
+            -1, &sql_stmt, nullptr) != SQLITE_OK) {
+            std::filesystem::remove(filename);
+            return false;
+        }
+        std::uint64_t i = 0;
+        long long prev_time = 0;
+        bool succeeded = true;
+        while (sqlite3_step(sql_stmt) == SQLITE_ROW) {
+            long long time;
+            const auto color_index = sqlite3_column_int64(sql_stmt, 6);
+            const std::string hash { reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, 3)) };
+            const std::string action { reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, 7)) };
+            // ids must be continuous and values must fit into the packed columns
+            if (i >= record_count || sqlite3_column_int64(sql_stmt, 0) != static_cast<long long>(i + 1) ||
+                color_index < 0 || color_index > UINT8_MAX ||
+                !ReadTimeColumn(sql_stmt, 2, time)) {
+                succeeded = false;
+                break;
+            }
+            if (!action_map.contains(action)) {
+                if (action_names.size() > UINT8_MAX) {
+                    succeeded = false;
+                    break;
+                }
+                action_map[action] = action_names.size();
+                action_names.push_back(action);
+                new_action_bitmaps.emplace_back();
+            }
+            if (!user_map.contains(hash)) {
+                user_map[hash] = user_hashes.size();
+                user_hashes.push_back(hash);
+            }
+            x_col[i] = sqlite3_column_int(sql_stmt, 4);
+            y_col[i] = sqlite3_column_int(sql_stmt, 5);
+            color_col[i] = color_index;
+            action_col[i] = action_map[action];
+            new_action_bitmaps[action_col[i]].Add(i + 1);
+            user_col[i] = user_map[hash];
+            prev_col[i] = sqlite3_column_int64(sql_stmt, 1);
+            // each time block starts with its own base
+            if (i % TIME_BLOCK_SIZE == 0) {
+                time_base_col[i / TIME_BLOCK_SIZE] = prev_time = time;
+                time_pos_col[i / TIME_BLOCK_SIZE] = time_data.size();
+            }
+            WriteDelta(time_data, time - prev_time);
+            prev_time = time;
+            i++;
+        }
+        sqlite3_finalize(sql_stmt);
+        if (!succeeded || i != record_count) {
+            build_region = bip::mapped_region();
+            std::filesystem::remove(filename);
+            return false;
+        }
+        // lay out variable-length sections after the fixed-width part
+        new_header.user_count = user_hashes.size();
+        new_header.action_count = action_names.size();
+        new_header.time_data_offset = fixed_bytes;
+        new_header.user_str_offset = AlignOffset(new_header.time_data_offset + time_data.size());
+        new_header.action_str_offset = AlignOffset(new_header.user_str_offset + StringsBytes(user_hashes));
+        new_header.bitmap_offset = AlignOffset(new_header.action_str_offset + StringsBytes(action_names));
+        bitmap_bytes = SerializeBitmaps(new_action_bitmaps);
+        new_header.file_size = new_header.bitmap_offset + bitmap_bytes.size();
+        std::memcpy(base, &new_header, sizeof(new_header));
+        build_region.flush();
+    } catch (bip::interprocess_exception&) {
+        std::filesystem::remove(filename);
+        return false;
+    }
+    // append variable-length sections
+    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+    const auto PadTo = [&](const std::uint64_t section_offset) {
+        const auto pos = static_cast<std::uint64_t>(file.tellp());
+        for (auto p = pos; p < section_offset; p++)
+            file.put('\0');
+    };
+    file.seekp(0, std::ios::end);
+    file.write(reinterpret_cast<const char*>(time_data.data()), static_cast<std::streamsize>(time_data.size()));
+    PadTo(new_header.user_str_offset);
+    WriteStrings(file, user_hashes);
+    PadTo(new_header.action_str_offset);
+    WriteStrings(file, action_names);
+    PadTo(new_header.bitmap_offset);
+    file.write(bitmap_bytes.data(), static_cast<std::streamsize>(bitmap_bytes.size()));
+    file.close();
+    if (!file) {
+        std::filesystem::remove(filename);
+        return false;
+    }
+    return true;
+}
+
+bool PxlsLogColumns::Open(const std::string &filename) {
+    Close();
+    if (!std::filesystem::exists(filename) || std::filesystem::is_directory(filename)) return false;
+    try {
+        bip::file_mapping new_file(filename.c_str(), bip::read_only);
+        bip::mapped_region new_region(new_file, bip::read_only);
+        // validate header and sections before using them
+        const auto file_size = new_region.get_size();
+        if (file_size < sizeof(PxlsLogColumnsHeader)) return false;
+        const auto *new_header = static_cast<const PxlsLogColumnsHeader*>(new_region.get_address());
+        const auto n = new_header->record_count;
+        const auto block_count = (n + TIME_BLOCK_SIZE - 1) / TIME_BLOCK_SIZE;
+        if (std::memcmp(new_header->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+            new_header->version < MIN_VERSION || new_header->version > VERSION ||
+            new_header->file_size != file_size ||
+            new_header->x_offset + n * sizeof(std::uint16_t) > file_size ||
+            new_header->y_offset + n * sizeof(std::uint16_t) > file_size ||
+            new_header->color_offset + n * sizeof(std::uint8_t) > file_size ||
+            new_header->action_offset + n * sizeof(std::uint8_t) > file_size ||
+            new_header->user_offset + n * sizeof(std::uint32_t) > file_size ||
+            new_header->prev_offset + n * sizeof(std::uint32_t) > file_size ||
+            new_header->time_base_offset + block_count * sizeof(long long) > file_size ||
+            new_header->time_pos_offset + block_count * sizeof(std::uint64_t) > file_size ||
+            new_header->time_data_offset > file_size ||
+            new_header->user_str_offset + (new_header->user_count + 1ull) * sizeof(std::uint32_t) > file_size ||
+            new_header->action_str_offset + (new_header->action_count + 1ull) * sizeof(std::uint32_t) > file_size ||
+            (new_header->version >= 2 &&
+            new_header->bitmap_offset + (new_header->action_count + 1ull) * sizeof(std::uint64_t) > file_size))
+            return false;
+        mapped_file.swap(new_file);
+        mapped_region.swap(new_region);
+    } catch (bip::interprocess_exception&) {
+        return false;
+    }
+    header = static_cast<const PxlsLogColumnsHeader*>(mapped_region.get_address());
+    x_column = Section<std::uint16_t>(header->x_offset);
+    y_column = Section<std::uint16_t>(header->y_offset);
+    color_column = Section<std::uint8_t>(header->color_offset);
+    action_column = Section<std::uint8_t>(header->action_offset);
+    user_column = Section<std::uint32_t>(header->user_offset);
+    prev_column = Section<std::uint32_t>(header->prev_offset);
+    time_base_column = Section<long long>(header->time_base_offset);
+    time_pos_column = Section<std::uint64_t>(header->time_pos_offset);
+    time_data = Section<std::uint8_t>(header->time_data_offset);
+    // intern all user hashes up front, so that replaying only copies their ids
+    user_hash_ids.resize(header->user_count);
+    for (std::uint32_t user_id = 0; user_id < header->user_count; user_id++)
+        user_hash_ids[user_id] = PxlsHashTable::Intern(UserHash(user_id));
+    action_bitmaps.resize(header->action_count);
+    if (header->version < 2) {
+        // older sidecars don't have action bitmaps, build them from the action column
+        for (std::uint64_t i = 0; i < header->record_count; i++) {
+            if (action_column[i] >= header->action_count) {
+                Close();
+                return false;
+            }
+            action_bitmaps[action_column[i]].Add(i + 1);
+        }
+        return true;
+    }
+    const auto *bitmap_offsets = Section<std::uint64_t>(header->bitmap_offset);
+    for (std::uint32_t action_id = 0; action_id < header->action_count; action_id++) {
+        const auto begin = bitmap_offsets[action_id], end = bitmap_offsets[action_id + 1];
+        if (begin > end || header->bitmap_offset + end > header->file_size ||
+            !action_bitmaps[action_id].Deserialize(Section<char>(header->bitmap_offset + begin), end - begin)) {
+            Close();
+            return false;
+        }
+    }
+    return true;
+}
+
+void PxlsLogColumns::Close() {
+    mapped_region = bip::mapped_region();
+    mapped_file = bip::file_mapping();
+    header = nullptr;
+    x_column = y_column = nullptr;
+    color_column = action_column = nullptr;
+    user_column = prev_column = nullptr;
+    time_base_column = nullptr;
+    time_pos_column = nullptr;
+    time_data = nullptr;
+    user_hash_ids.clear();
+    action_bitmaps.clear();
+}
+
+long long PxlsLogColumns::Time(const unsigned long id) const {
+    if (!header || id == 0 || id > header->record_count) return 0;
+    const auto index = id - 1;
+    const auto block = index / TIME_BLOCK_SIZE;
+    auto pos = time_pos_column[block];
+    auto time = time_base_column[block];
+    for (auto i = block * TIME_BLOCK_SIZE; i <= index; i++)
+        time += ReadDelta(time_data, pos);
+    return time;
+}
+
+std::string_view PxlsLogColumns::SectionString(const std::uint64_t section_offset, const std::uint32_t count, const std::uint32_t index) const {
+    if (!header || index >= count) return {};
+    const auto *str_offsets = Section<std::uint32_t>(section_offset);
+    const auto *str_data = Section<char>(section_offset + (count + 1ull) * sizeof(std::uint32_t));
+    return { str_data + str_offsets[index], str_offsets[index + 1] - str_offsets[index] };
+}
+
+std::string_view PxlsLogColumns::UserHash(const std::uint32_t user_id) const {
+    return header ? SectionString(header->user_str_offset, header->user_count, user_id) : std::string_view {};
+}
+
+std::string_view PxlsLogColumns::ActionName(const std::uint8_t action_id) const {
+    return header ? SectionString(header->action_str_offset, header->action_count, action_id) : std::string_view {};
+}
+
+bool PxlsLogColumns::QueryBatches(const unsigned long current_id, const unsigned long dest_id, const RecordBatchQueryCallback &callback) const {
+    if (!header || current_id > header->record_count || dest_id > header->record_count) return false;
+    if (callback == nullptr || current_id == dest_id) return true;
+    std::vector<long long> time_buf(BATCH_SIZE);
+    PxlsRecordBatch batch;
+    batch.time = time_buf.data();
+    if (dest_id > current_id) {
+        batch.direction = FORWARD;
+        // decode time deltas from the beginning of the block containing the first record
+        auto block = current_id / TIME_BLOCK_SIZE;
+        auto pos = time_pos_column[block];
+        auto time = time_base_column[block];
+        for (auto i = block * TIME_BLOCK_SIZE; i < current_id; i++)
+            time += ReadDelta(time_data, pos);
+        for (auto index = current_id; index < dest_id; index += batch.count) {
+            batch.count = std::min<unsigned long>(BATCH_SIZE, dest_id - index);
+            // columns can be handed out directly without copying
+            batch.x = x_column + index;
+            batch.y = y_column + index;
+            batch.color_index = color_column + index;
+            batch.action_id = action_column + index;
+            batch.user_id = user_column + index;
+            for (std::size_t i = 0; i < batch.count; i++) {
+                if ((index + i) % TIME_BLOCK_SIZE == 0)
+                    time = time_base_column[(index + i) / TIME_BLOCK_SIZE];
+                time += ReadDelta(time_data, pos);
+                time_buf[i] = time;
+            }
+            callback(batch);
+        }
+    } else {
+        batch.direction = BACKWARD;
+        // gather the values of previous records in reverse order
+        std::vector<std::uint16_t> x_buf(BATCH_SIZE), y_buf(BATCH_SIZE);
+        std::vector<std::uint8_t> color_buf(BATCH_SIZE), action_buf(BATCH_SIZE), has_prev_buf(BATCH_SIZE);
+        std::vector<std::uint32_t> user_buf(BATCH_SIZE);
+        batch.x = x_buf.data(); batch.y = y_buf.data();
+        batch.color_index = color_buf.data(); batch.action_id = action_buf.data();
+        batch.user_id = user_buf.data(); batch.has_prev = has_prev_buf.data();
+        for (auto id = current_id; id > dest_id; id -= batch.count) {
+            batch.count = std::min<unsigned long>(BATCH_SIZE, id - dest_id);
+            for (std::size_t i = 0; i < batch.count; i++) {
+                const auto index = id - 1 - i;
+                const auto prev_id = prev_column[index];
+                x_buf[i] = x_column[index];
+                y_buf[i] = y_column[index];
+                has_prev_buf[i] = prev_id != 0;
+                if (prev_id != 0) {
+                    color_buf[i] = color_column[prev_id - 1];
+                    action_buf[i] = action_column[prev_id - 1];
+                    user_buf[i] = user_column[prev_id - 1];
+                    time_buf[i] = Time(prev_id);
+                }
+            }
+            callback(batch);
+        }
+    }
+    return true;
+}
+
+bool PxlsLogColumns::QueryFilteredBatches(const unsigned long current_id, const unsigned long dest_id, const PxlsRecordBitmap &selected,
+                                          const RecordBatchQueryCallback &callback) const {
+    if (!header || current_id > header->record_count || dest_id > header->record_count) return false;
+    if (callback == nullptr || current_id == dest_id) return true;
+    const bool forward = dest_id > current_id;
+    BatchGatherer gatherer(forward ? FORWARD : BACKWARD, callback);
+    // gather the position of a record and the values of value_id, which is 0 if the pixel becomes virgin
+    const auto Gather = [&](const std::uint32_t id, const std::uint32_t value_id) {
+        if (value_id == 0)
+            gatherer.Push(x_column[id - 1], y_column[id - 1]);
+        else
+            gatherer.Push(x_column[id - 1], y_column[id - 1], color_column[value_id - 1], action_column[value_id - 1],
+                user_column[value_id - 1], Time(value_id));
+    };
+    if (forward) {
+        selected.ForEachRun(current_id, dest_id, false, [&](const std::uint32_t first, const std::uint32_t last) {
+            // long runs are handed out directly like unfiltered records
+            if (last - first + 1 >= GATHER_RUN_LENGTH) {
+                gatherer.Flush();
+                QueryBatches(first - 1, last, callback);
+                return;
+            }
+            for (auto id = first; id <= last; id++)
+                Gather(id, id);
+        });
+    } else {
+        selected.ForEachRun(dest_id, current_id, true, [&](const std::uint32_t first, const std::uint32_t last) {
+            for (auto id = last; id >= first; id--) {
+                // skip previous records that are filtered out
+                auto prev_id = prev_column[id - 1];
+                while (prev_id != 0 && !selected.Contains(prev_id))
+                    prev_id = prev_column[prev_id - 1];
+                Gather(id, prev_id);
+            }
+        });
+    }
+    gatherer.Flush();
+    return true;
+}
+
+bool PxlsLogColumns::QueryCorrectionBatches(const std::vector<PxlsFilterCorrection> &corrections, const RecordBatchQueryCallback &callback) const {
+    if (!header) return false;
+    if (callback == nullptr) return true;
+    BatchGatherer gatherer(BACKWARD, callback);
+    for (const auto &correction: corrections) {
+        if (correction.record_id == PxlsFilterCorrection::KEEP_RECORD) continue;
+        if (correction.record_id > header->record_count) return false;
+        if (const auto id = correction.record_id; id == 0)
+            gatherer.Push(correction.x, correction.y);
+        else
+            gatherer.Push(correction.x, correction.y, color_column[id - 1], action_column[id - 1], user_column[id - 1], Time(id));
+    }
+    gatherer.Flush();
+    return true;
+}
+
+bool PxlsLogColumns::FilterCorrections(const PxlsRecordBitmap &selected, const std::vector<unsigned long> &ids,
+                                       PxlsFilterCorrectionDeltas &deltas) const {
+    if (!header) return false;
+    auto sorted_ids = ids;
+    std::ranges::sort(sorted_ids);
+    if (!sorted_ids.empty() && sorted_ids.back() > header->record_count) return false;
+    const auto pixel_count = static_cast<std::size_t>(header->width) * header->height;
+    // the last record, the last selected record and the number of records filtered out of each pixel so far
+    std::vector<std::uint32_t> last_ids(pixel_count, 0), last_selected_ids(pixel_count, 0), excluded_counts(pixel_count, 0);
+    // the pixels placed on since the previous id, which are the ones whose correction may have changed
+    std::vector<std::uint8_t> touched(pixel_count, 0);
+    std::vector<std::size_t> touched_indices;
+    const auto PixelIndex = [&](const std::uint32_t id) {
+        const auto index = static_cast<std::size_t>(y_column[id - 1]) * header->width + x_column[id - 1];
+        if (!touched[index]) {
+            touched[index] = 1;
+            touched_indices.push_back(index);
+        }
+        return index;
+    };
+    const auto Exclude = [&](const std::uint32_t first, const std::uint32_t last) {
+        for (auto id = first; id <= last; id++) {
+            const auto index = PixelIndex(id);
+            last_ids[index] = id;
+            excluded_counts[index]++;
+        }
+    };
+    deltas.clear();
+    std::uint32_t scanned_id = 0;
+    for (const auto id: sorted_ids) {
+        if (!deltas.empty() && deltas.back().first == id) continue;
+        // the records between runs of selected records are filtered out
+        selected.ForEachRun(scanned_id, id, false, [&](const std::uint32_t first, const std::uint32_t last) {
+            Exclude(scanned_id + 1, first - 1);
+            for (auto selected_id = first; selected_id <= last; selected_id++) {
+                const auto index = PixelIndex(selected_id);
+                last_ids[index] = last_selected_ids[index] = selected_id;
+            }
+            scanned_id = last;
+        });
+        Exclude(scanned_id + 1, id);
+        scanned_id = id;
+        // the corrections are applied in pixel order, which keeps the writes to the planes sequential
+        std::ranges::sort(touched_indices);
+        auto &delta = deltas.emplace_back(id, std::vector<PxlsFilterCorrection> {}).second;
+        for (const auto index: touched_indices) {
+            touched[index] = 0;
+            // the records filtered out are only counted up, so the pixels without any have never had a correction
+            if (excluded_counts[index] == 0) continue;
+            delta.push_back({
+                static_cast<std::uint16_t>(index % header->width), static_cast<std::uint16_t>(index / header->width),
+                excluded_counts[index],
+                last_ids[index] == last_selected_ids[index] ? PxlsFilterCorrection::KEEP_RECORD : last_selected_ids[index]
+            });
+        }
+        touched_indices.clear();
+    }
+    return true;
+}
+
+bool PxlsLogColumns::MergeCorrections(const PxlsFilterCorrectionDeltas &deltas, const unsigned long id,
+                                      std::vector<PxlsFilterCorrection> &corrections) const {
+    const auto it = std::ranges::lower_bound(deltas, id, {}, &PxlsFilterCorrectionDeltas::value_type::first);
+    if (!header || it == deltas.end() || it->first != id) return false;
+    corrections.clear();
+    // the latest delta of a pixel has its correction at id, so walk the deltas backwards and skip the pixels merged
+    std::vector<bool> merged(static_cast<std::size_t>(header->width) * header->height, false);
+    for (auto delta_it = std::make_reverse_iterator(std::next(it)); delta_it != deltas.rend(); ++delta_it) {
+        for (const auto &correction: delta_it->second) {
+            const auto index = static_cast<std::size_t>(correction.y) * header->width + correction.x;
+            if (merged[index]) continue;
+            merged[index] = true;
+            corrections.push_back(correction);
+        }
+    }
+    return true;
+}
+
+std::string PxlsLogColumns::FormatDate(const long long time) {
+    return std::format("{:%F %T}", std::chrono::sys_time<std::chrono::milliseconds> { std::chrono::milliseconds(time) });
+}
+
+bool PxlsLogColumns::ReadTimeColumn(sqlite3_stmt *sql_stmt, const int column, long long &time) {
+    switch (sqlite3_column_type(sql_stmt, column)) {
+        case SQLITE_INTEGER:
+            time = sqlite3_column_int64(sql_stmt, column);
+            return true;
+        case SQLITE_TEXT:
+            return ParseDate(reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, column)), time);
+        default:
+            return false;
+    }
+}
+
+bool PxlsLogColumns::ParseDate(const std::string_view date_str, long long &time) {
+    // fixed format: YYYY-MM-DD HH:MM:SS[.mmm]
+    if (date_str.size() < 19) return false;
+    const auto ParseDigits = [&](const std::size_t pos, const std::size_t len, int &value) {
+        value = 0;
+        for (auto i = pos; i < pos + len; i++) {
+            if (date_str[i] < '0' || date_str[i] > '9') return false;
+            value = value * 10 + (date_str[i] - '0');
+        }
+        return true;
+    };
+    int year, month, day, hour, minute, second, millisecond = 0;
+    if (!ParseDigits(0, 4, year) || date_str[4] != '-' || !ParseDigits(5, 2, month) || date_str[7] != '-' ||
+        !ParseDigits(8, 2, day) || date_str[10] != ' ' || !ParseDigits(11, 2, hour) || date_str[13] != ':' ||
+        !ParseDigits(14, 2, minute) || date_str[16] != ':' || !ParseDigits(17, 2, second))
+        return false;
+    // fractional part, both '.' and ',' are accepted as the separator
+    if (date_str.size() > 19) {
+        if (date_str[19] != '.' && date_str[19] != ',') return false;
+        int scale = 100;
+        for (auto i = 20u; i < date_str.size() && i < 23u; i++, scale /= 10) {
+            if (date_str[i] < '0' || date_str[i] > '9') return false;
+            millisecond += (date_str[i] - '0') * scale;
+        }
+    }
+    const std::chrono::year_month_day ymd { std::chrono::year(year), std::chrono::month(month), std::chrono::day(day) };
+    if (!ymd.ok()) return false;
+    time = std::chrono::sys_days(ymd).time_since_epoch().count() * 86400000ll +
+        hour * 3600000ll + minute * 60000ll + second * 1000ll + millisecond;
+    return true;
+}
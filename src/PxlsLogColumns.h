@@ -0,0 +1,165 @@
+//
+// Provide classes and methods to build and read the columnar LogDB sidecar (.pxcol) using memory mapping
+//
+
+#ifndef PXLSLOGCOLUMNS_H
+#define PXLSLOGCOLUMNS_H
+#include <vector>
+#include <string>
+#include <string_view>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <unordered_map>
+#include <chrono>
+#include <format>
+#include <cstdint>
+#include <cstring>
+#include <sqlite3.h>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include "PxlsHashTable.h"
+#include "PxlsRecordBitmap.h"
+
+enum QueryDirection { FORWARD, BACKWARD };
+
+// a batch of records stored in packed arrays, ready to be applied to the canvas
+struct PxlsRecordBatch {
+    QueryDirection direction { FORWARD };
+    std::size_t count { 0 };
+    // pixel position of records
+    const std::uint16_t *x { nullptr }, *y { nullptr };
+    // when querying backwards, the following arrays hold the values of the previous record instead
+    const std::uint8_t *color_index { nullptr };
+    const std::uint8_t *action_id { nullptr };
+    const std::uint32_t *user_id { nullptr };
+    // epoch time in milliseconds
+    const long long *time { nullptr };
+    // only used when querying backwards, 0 means there is no previous record and the pixel becomes virgin
+    const std::uint8_t *has_prev { nullptr };
+    // view of slice_count records starting from offset
+    [[nodiscard]] PxlsRecordBatch Slice(const std::size_t offset, const std::size_t slice_count) const {
+        auto slice = *this;
+        slice.count = slice_count;
+        slice.x += offset; slice.y += offset;
+        slice.color_index += offset; slice.action_id += offset;
+        slice.user_id += offset; slice.time += offset;
+        if (slice.has_prev)
+            slice.has_prev += offset;
+        return slice;
+    }
+};
+using RecordBatchQueryCallback = std::function<void (const PxlsRecordBatch &batch)>;
+
+// correction of a pixel of the canvas state at a record id, which turns the state of all records into the state of
+// the records selected by a filter
+struct PxlsFilterCorrection {
+    std::uint16_t x { 0 }, y { 0 };
+    // number of records placed on the pixel that are filtered out
+    std::uint32_t excluded_count { 0 };
+    // the last selected record placed on the pixel if the last record is filtered out, 0 if there is none,
+    // or KEEP_RECORD if the last record is selected
+    std::uint32_t record_id { KEEP_RECORD };
+    static constexpr std::uint32_t KEEP_RECORD { UINT32_MAX };
+};
+// corrections of the canvas states at ascending record ids, each of which only keeps the pixels placed on since the
+// previous id, so that memory grows with the records instead of the pixels times the ids
+using PxlsFilterCorrectionDeltas = std::vector<std::pair<unsigned long, std::vector<PxlsFilterCorrection>>>;
+
+// on-disk header of the columnar sidecar, all offsets are in bytes from the beginning of the file
+struct PxlsLogColumnsHeader {
+    char magic[8] {};
+    std::uint32_t version { 0 };
+    std::uint32_t width { 0 }, height { 0 };
+    std::uint32_t user_count { 0 }, action_count { 0 };
+    std::uint32_t reserved { 0 };
+    std::uint64_t record_count { 0 };
+    std::uint64_t x_offset { 0 }, y_offset { 0 }, color_offset { 0 }, action_offset { 0 }, user_offset { 0 }, prev_offset { 0 };
+    std::uint64_t time_base_offset { 0 }, time_pos_offset { 0 }, time_data_offset { 0 };
+    std::uint64_t user_str_offset { 0 }, action_str_offset { 0 };
+    std::uint64_t file_size { 0 };
+    // action bitmaps, only present since version 2
+    std::uint64_t bitmap_offset { 0 };
+};
+
+class PxlsLogColumns {
+public:
+    // build the sidecar from all records of an open logdb, return false if records can't be packed
+    static bool Build(sqlite3 *log_db, const std::string &filename);
+    // map an existing sidecar into memory
+    bool Open(const std::string &filename);
+    // unmap sidecar
+    void Close();
+    // is sidecar mapped
+    [[nodiscard]] bool IsOpen() const { return header != nullptr; }
+    [[nodiscard]] unsigned long RecordCount() const { return header ? header->record_count : 0; }
+    [[nodiscard]] unsigned Width() const { return header ? header->width : 0; }
+    [[nodiscard]] unsigned Height() const { return header ? header->height : 0; }
+    // get the epoch time in milliseconds of a record, id starts from 1
+    [[nodiscard]] long long Time(unsigned long id) const;
+    // get interned strings
+    [[nodiscard]] std::string_view UserHash(std::uint32_t user_id) const;
+    // get the id of a user hash in the process-wide hash table, the user id must be valid
+    [[nodiscard]] std::uint32_t UserHashId(const std::uint32_t user_id) const { return user_hash_ids[user_id]; }
+    [[nodiscard]] std::string_view ActionName(std::uint8_t action_id) const;
+    // query records in batches, from current_id to dest_id. when querying backwards, it queries the record with prev_id instead
+    bool QueryBatches(unsigned long current_id, unsigned long dest_id, const RecordBatchQueryCallback &callback) const;
+    // ids of the records of an action, the action id must be valid
+    [[nodiscard]] const PxlsRecordBitmap& ActionBitmap(const std::uint8_t action_id) const { return action_bitmaps[action_id]; }
+    [[nodiscard]] std::uint32_t ActionCount() const { return header ? header->action_count : 0; }
+    // query the records selected by the bitmap in batches, from current_id to dest_id. the other records are skipped
+    // without being decoded. when querying backwards, it queries the last selected record before each record instead,
+    // which is found by following prev_id
+    bool QueryFilteredBatches(unsigned long current_id, unsigned long dest_id, const PxlsRecordBitmap &selected,
+                              const RecordBatchQueryCallback &callback) const;
+    // query the records replacing the last records of corrected pixels in backward batches, so that applying them
+    // restores the pixels like undoing. the pixels without replacement are skipped
+    bool QueryCorrectionBatches(const std::vector<PxlsFilterCorrection> &corrections, const RecordBatchQueryCallback &callback) const;
+    // calc the corrections of the canvas states at the given ids in a single pass over the records, return false if
+    // any id is out of range
+    bool FilterCorrections(const PxlsRecordBitmap &selected, const std::vector<unsigned long> &ids,
+                           PxlsFilterCorrectionDeltas &deltas) const;
+    // merge the deltas up to id into the corrections of the canvas state at id, return false if id has no delta
+    bool MergeCorrections(const PxlsFilterCorrectionDeltas &deltas, unsigned long id,
+                          std::vector<PxlsFilterCorrection> &corrections) const;
+    // parse date string in "%F %T" format with optional milliseconds to epoch time in milliseconds
+    static bool ParseDate(std::string_view date_str, long long &time);
+    // format epoch time in milliseconds in "%F %T" format with milliseconds
+    static std::string FormatDate(long long time);
+    // read a date column as epoch time in milliseconds, logdb of older versions stores dates as text
+    static bool ReadTimeColumn(sqlite3_stmt *sql_stmt, int column, long long &time);
+    // magic and version of the sidecar format
+    static constexpr char MAGIC[8] { 'P', 'X', 'C', 'O', 'L', '\0', '\0', '\0' };
+    static constexpr std::uint32_t VERSION { 2 };
+    // sidecars of older versions without action bitmaps are still usable, the bitmaps are built when mapping them
+    static constexpr std::uint32_t MIN_VERSION { 1 };
+    // number of records sharing a time base, smaller blocks make random access faster
+    static constexpr unsigned TIME_BLOCK_SIZE { 32 };
+    // number of records in a batch
+    static constexpr unsigned BATCH_SIZE { 4096 };
+    // runs of selected records shorter than this are gathered into batches when filtering, instead of being handed out directly
+    static constexpr unsigned GATHER_RUN_LENGTH { 64 };
+private:
+    // get interned string from a string section
+    [[nodiscard]] std::string_view SectionString(std::uint64_t section_offset, std::uint32_t count, std::uint32_t index) const;
+    template <typename T>
+    [[nodiscard]] const T* Section(const std::uint64_t offset) const {
+        return reinterpret_cast<const T*>(static_cast<const char*>(mapped_region.get_address()) + offset);
+    }
+    boost::interprocess::file_mapping mapped_file;
+    boost::interprocess::mapped_region mapped_region;
+    const PxlsLogColumnsHeader *header { nullptr };
+    // column pointers, indexed by id - 1
+    const std::uint16_t *x_column { nullptr }, *y_column { nullptr };
+    const std::uint8_t *color_column { nullptr }, *action_column { nullptr };
+    const std::uint32_t *user_column { nullptr }, *prev_column { nullptr };
+    const long long *time_base_column { nullptr };
+    const std::uint64_t *time_pos_column { nullptr };
+    const std::uint8_t *time_data { nullptr };
+    // ids of user hashes in the process-wide hash table, indexed by user id
+    std::vector<std::uint32_t> user_hash_ids;
+    // ids of the records of each action, indexed by action id
+    std::vector<PxlsRecordBitmap> action_bitmaps;
+};
+
+#endif //PXLSLOGCOLUMNS_H
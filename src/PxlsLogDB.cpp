@@ -3,213 +3,1500 @@
 //
 
 #include "PxlsLogDB.h"
+#include "PxlsLogSource.h"
+#include "nlohmann/json.hpp"
+using json = nlohmann::ordered_json;
 
-bool PxlsLogDB::OpenLogRaw(const std::string &filename) {
+bool PxlsLogDB::OpenLogRaw(const std::string &filename, const IngestCallback &ingest_callback,
+                           const SnapshotDumpCallback &snapshot_callback) {
     if (!std::filesystem::exists(filename) || std::filesystem::is_directory(filename)) return false;
-    std::ifstream file(filename);
-    auto db_path = std::filesystem::path(filename).replace_extension("logdb").string();
-    // delete old logdb and reconstruct it
-    if (std::filesystem::exists(db_path) && !std::filesystem::is_directory(db_path))
-        std::filesystem::remove(db_path);
+    // shards are built from byte ranges of the log, which compressed logs can't seek to
+    if (shard_bytes != 0 && std::filesystem::file_size(filename) > shard_bytes &&
+        PxlsLogSource::DetectCompression(filename) == UNCOMPRESSED)
+        return OpenLogRawSharded(filename, ingest_callback, snapshot_callback);
+    // gzip and zstd logs are decompressed while being parsed
+    PxlsLogSource source;
+    if (!source.Open(filename)) return false;
+    auto &file = source.Stream();
+    const bool compressed = source.Compression() != UNCOMPRESSED;
+    const auto log_path = PxlsLogSource::StripCompressionExtension(filename);
+    auto db_path = std::filesystem::path(log_path).replace_extension("logdb").string();
+    // store previous record id
+    std::map<std::pair<unsigned, unsigned>, unsigned long> prev_id_map;
+    unsigned long record_id = 1;
+    // bytes of pxls log ingested and their hash
+    unsigned long long ingested_offset = 0;
+    std::uint64_t prefix_hash = PREFIX_HASH_SEED;
     sqlite3 *new_log_db = nullptr;
-    if (sqlite3_open_v2(db_path.c_str(), &new_log_db,
-        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) return false;
-    // enable foreign keys
-    if (sqlite3_exec(new_log_db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+    // continue from the last checkpoint if the logdb is converted from the same pxls log, otherwise reconstruct it
+    if (!ResumeLogRaw(db_path, file, new_log_db, prev_id_map, record_id, ingested_offset, prefix_hash)) {
+        if (!source.Rewind()) return false;
+        if (std::filesystem::exists(db_path) && !std::filesystem::is_directory(db_path))
+            std::filesystem::remove(db_path);
+        // the wal left behind by an interrupted conversion must not be applied to the new logdb
+        std::filesystem::remove(db_path + "-wal");
+        std::filesystem::remove(db_path + "-shm");
+        if (sqlite3_open_v2(db_path.c_str(), &new_log_db,
+            SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+            sqlite3_close(new_log_db);
+            return false;
+        }
+        // init logdb by creating the log table, the snapshot table and the tables for ingestion
+        const std::string init_sql  = "PRAGMA foreign_keys = ON;"
+                                "PRAGMA journal_mode = WAL;"
+                                "CREATE TABLE log("
+                                "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                                "prev_id INTEGER,"
+                                "date INTEGER NOT NULL,"
+                                "hash TEXT NOT NULL,"
+                                "x INTEGER NOT NULL,"
+                                "y INTEGER NOT NULL,"
+                                "color_index INTEGER NOT NULL,"
+                                "action TEXT NOT NULL,"
+                                "tile_id INTEGER NOT NULL,"
+                                "FOREIGN KEY (prev_id) REFERENCES log(id)"
+                                ");"
+                                "CREATE TABLE canvas_snapshot("
+                                "id INTEGER PRIMARY KEY NOT NULL,"
+                                "snapshot BLOB NOT NULL"
+                                ");"
+                                "CREATE TABLE meta("
+                                "key TEXT PRIMARY KEY NOT NULL,"
+                                "value TEXT NOT NULL"
+                                ");"
+                                "CREATE TABLE pixel_head("
+                                "x INTEGER NOT NULL,"
+                                "y INTEGER NOT NULL,"
+                                "last_id INTEGER NOT NULL,"
+                                "PRIMARY KEY (x, y)"
+                                ") WITHOUT ROWID;"
+                                "CREATE TABLE quarantine("
+                                "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                                "source_offset INTEGER NOT NULL,"
+                                "line TEXT NOT NULL"
+                                ");" +
+                                std::format("INSERT INTO meta(key,value) VALUES ('schema_version','{}');", SCHEMA_VERSION);
+        if (sqlite3_exec(new_log_db, init_sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
+            sqlite3_close(new_log_db);
+            std::filesystem::remove(db_path);
+            return false;
+        }
+    }
+    // from now on, the logdb is kept on failure so that the conversion can be resumed from the last checkpoint
+    const auto Fail = [&] {
+        sqlite3_exec(new_log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
         sqlite3_close(new_log_db);
-        std::filesystem::remove(db_path);
         return false;
+    };
+    // pixels whose previous record id changed since the last checkpoint
+    std::map<std::pair<unsigned, unsigned>, unsigned long> dirty_heads;
+    // commit the pending records along with the checkpoint, then start a new transaction
+    const auto Checkpoint = [&](const bool begin_next) {
+        sqlite3_stmt *head_stmt;
+        sqlite3_prepare_v2(new_log_db, "INSERT OR REPLACE INTO pixel_head(x,y,last_id) VALUES (?,?,?);", -1, &head_stmt, nullptr);
+        bool head_ok = true;
+        for (const auto &[pos, last_id]: dirty_heads) {
+            sqlite3_bind_int(head_stmt, 1, static_cast<int>(pos.first));
+            sqlite3_bind_int(head_stmt, 2, static_cast<int>(pos.second));
+            sqlite3_bind_int64(head_stmt, 3, static_cast<sqlite3_int64>(last_id));
+            head_ok = sqlite3_step(head_stmt) == SQLITE_DONE;
+            sqlite3_reset(head_stmt);
+            if (!head_ok) break;
+        }
+        sqlite3_finalize(head_stmt);
+        dirty_heads.clear();
+        return head_ok &&
+            WriteMeta(new_log_db, "source_offset", std::to_string(ingested_offset)) &&
+            WriteMeta(new_log_db, "source_prefix_hash", std::to_string(prefix_hash)) &&
+            sqlite3_exec(new_log_db, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK &&
+            (!begin_next || sqlite3_exec(new_log_db, "BEGIN;", nullptr, nullptr, nullptr) == SQLITE_OK);
+    };
+    if (sqlite3_exec(new_log_db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) return Fail();
+    // offsets of the pxls log to create snapshots at, the ones before the checkpoint are already created
+    const bool create_snapshots = ingest_callback && snapshot_callback;
+    const auto file_size = std::filesystem::file_size(filename);
+    // the decompressed size of compressed logs is unknown, so their offsets are the compressed bytes consumed so far
+    const auto SourceOffset = [&] { return compressed ? source.CompressedOffset() : ingested_offset; };
+    std::vector<unsigned long long> snapshot_offsets;
+    for (const auto proportion: snapshot_proportions) {
+        if (const auto offset = static_cast<unsigned long long>(std::ceil(static_cast<double>(proportion) * file_size));
+            create_snapshots && offset > SourceOffset())
+            snapshot_offsets.push_back(offset);
+    }
+    std::size_t next_snapshot = 0;
+    // create a snapshot of the records converted so far, it is committed along with them
+    const auto CreateSnapshotInline = [&] {
+        std::vector<char> snapshot_blob;
+        if (record_id == 1 || !snapshot_callback(snapshot_blob)) return true;
+        sqlite3_stmt *snapshot_stmt;
+        sqlite3_prepare_v2(new_log_db, "INSERT OR REPLACE INTO canvas_snapshot(id,snapshot) VALUES (?,?);", -1, &snapshot_stmt, nullptr);
+        sqlite3_bind_int64(snapshot_stmt, 1, static_cast<sqlite3_int64>(record_id - 1));
+        sqlite3_bind_blob64(snapshot_stmt, 2, snapshot_blob.data(), snapshot_blob.size(), SQLITE_STATIC);
+        const bool snapshot_ok = sqlite3_step(snapshot_stmt) == SQLITE_DONE;
+        sqlite3_finalize(snapshot_stmt);
+        return snapshot_ok && WriteSnapshotSummary(new_log_db);
+    };
+    // the snapshots after the checkpoint also contain the records converted before it, so pass them from the logdb first
+    if (ingest_callback && (!create_snapshots || !snapshot_offsets.empty()) && record_id > 1) {
+        sqlite3_stmt *replay_stmt;
+        sqlite3_prepare_v2(new_log_db, "SELECT date,hash,x,y,color_index,action FROM log ORDER BY id;", -1, &replay_stmt, nullptr);
+        const auto ColumnText = [&](const int column) {
+            return std::string_view { reinterpret_cast<const char*>(sqlite3_column_text(replay_stmt, column)),
+                static_cast<std::size_t>(sqlite3_column_bytes(replay_stmt, column)) };
+        };
+        while (sqlite3_step(replay_stmt) == SQLITE_ROW) {
+            long long time = 0;
+            PxlsLogColumns::ReadTimeColumn(replay_stmt, 0, time);
+            ingest_callback(time, ColumnText(1), static_cast<unsigned>(sqlite3_column_int64(replay_stmt, 2)),
+                static_cast<unsigned>(sqlite3_column_int64(replay_stmt, 3)),
+                static_cast<unsigned>(sqlite3_column_int64(replay_stmt, 4)), ColumnText(5));
+        }
+        sqlite3_finalize(replay_stmt);
+    }
+    sqlite3_stmt *quarantine_stmt;
+    sqlite3_prepare_v2(new_log_db, "INSERT INTO quarantine(source_offset,line) VALUES (?,?);", -1, &quarantine_stmt, nullptr);
+    std::string record_line;
+    std::vector<std::string> record;
+    const std::string insert_sql_prefix = "INSERT INTO log(date,hash,x,y,color_index,action,tile_id,prev_id) VALUES ";
+    std::stringstream sql_ss;
+    sql_ss << insert_sql_prefix;
+    unsigned short record_num = 0;
+    unsigned long checkpoint_record_num = 0;
+    unsigned record_x, record_y;
+    long long record_time;
+    // insert the records constructed in sql_ss
+    const auto FlushRecords = [&] {
+        if (record_num == 0) return true;
+        PxlsProfileScope insert_scope(PxlsProfiler::OPEN_LOG_INSERT, record_num);
+        std::string insert_sql { sql_ss.str() };
+        insert_sql.back() = ';';
+        record_num = 0;
+        sql_ss.str("");
+        sql_ss << insert_sql_prefix;
+        return sqlite3_exec(new_log_db, insert_sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    };
+    {
+        // parse pxls log and insert records
+        PxlsProfileScope ingest_scope(PxlsProfiler::OPEN_LOG_INGEST);
+        while (std::getline(file, record_line)) {
+            // the last line may still be being written when following the log, leave it to the tail so that the
+            // checkpoints end at a line. compressed logs are complete and never followed, so their last line is kept
+            if (file.eof() && follow_source && !compressed) break;
+            const auto line_offset = ingested_offset;
+            ingested_offset += record_line.size();
+            prefix_hash = HashBytes(record_line.data(), record_line.size(), prefix_hash);
+            if (!file.eof()) {
+                ingested_offset++;
+                prefix_hash = HashBytes("\n", 1, prefix_hash);
+            }
+            // put malformed lines aside instead of aborting the conversion
+            if (!ParseRecord(record_line, record, record_x, record_y, record_time)) {
+                sqlite3_bind_int64(quarantine_stmt, 1, static_cast<sqlite3_int64>(line_offset));
+                sqlite3_bind_text(quarantine_stmt, 2, record_line.c_str(), -1, SQLITE_TRANSIENT);
+                const bool quarantine_ok = sqlite3_step(quarantine_stmt) == SQLITE_DONE;
+                sqlite3_reset(quarantine_stmt);
+                if (!quarantine_ok) {
+                    sqlite3_finalize(quarantine_stmt);
+                    return Fail();
+                }
+                continue;
+            }
+            // construct insert values
+            sql_ss << '(' << record_time
+                << ",'" << record[1]
+                << "'," << record[2]
+                << ',' << record[3]
+                << ',' << record[4]
+                << ",'" << record[5]
+                << "'," << TileId(record_x, record_y)
+                << ',';
+            if (prev_id_map.contains(std::make_pair(record_x, record_y)))
+                sql_ss << prev_id_map[std::make_pair(record_x, record_y)];
+            else
+                sql_ss << "NULL";
+            sql_ss << "),";
+            // update prev_id_map
+            dirty_heads[std::make_pair(record_x, record_y)] = prev_id_map[std::make_pair(record_x, record_y)] = record_id++;
+            if (ingest_callback)
+                ingest_callback(record_time, record[1], record_x, record_y, std::stoul(record[4]), record[5]);
+            // the last snapshot is left to the end, since the pxls log may grow during the conversion
+            for (; next_snapshot < snapshot_offsets.size() && snapshot_offsets[next_snapshot] < file_size &&
+                snapshot_offsets[next_snapshot] <= SourceOffset(); next_snapshot++) {
+                if (!CreateSnapshotInline()) {
+                    sqlite3_finalize(quarantine_stmt);
+                    return Fail();
+                }
+            }
+            // insert INSERT_RECORDS_MAX_COUNT of records a time
+            if (++record_num == INSERT_RECORDS_MAX_COUNT && !FlushRecords()) {
+                sqlite3_finalize(quarantine_stmt);
+                return Fail();
+            }
+            // commit a checkpoint every CHECKPOINT_RECORDS_COUNT of records
+            if (++checkpoint_record_num == CHECKPOINT_RECORDS_COUNT) {
+                checkpoint_record_num = 0;
+                if (!FlushRecords() || !Checkpoint(true)) {
+                    sqlite3_finalize(quarantine_stmt);
+                    return Fail();
+                }
+            }
+        }
+        sqlite3_finalize(quarantine_stmt);
+        // a corrupted compressed log ends early, which must not be taken as the whole log
+        if (source.Failed() || !FlushRecords()) return Fail();
+        for (; next_snapshot < snapshot_offsets.size(); next_snapshot++) {
+            if (!CreateSnapshotInline()) return Fail();
+        }
+        if (!Checkpoint(false)) return Fail();
     }
-    // init logdb by creating the log table and the snapshot table
-    const std::string init_sql  = "CREATE TABLE log("
-                            "id INTEGER PRIMARY KEY AUTOINCREMENT,"
-                            "prev_id INTEGER,"
-                            "date TEXT NOT NULL,"
-                            "hash TEXT NOT NULL,"
-                            "x INTEGER NOT NULL,"
-                            "y INTEGER NOT NULL,"
-                            "color_index INTEGER NOT NULL,"
-                            "action TEXT NOT NULL,"
-                            "FOREIGN KEY (prev_id) REFERENCES log(id)"
-                            ");"
-                            "CREATE TABLE canvas_snapshot("
-                            "id INTEGER PRIMARY KEY NOT NULL,"
-                            "snapshot BLOB NOT NULL"
-                            ");";
-    if (sqlite3_exec(new_log_db, init_sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
+    // a file without any valid record is not a pxls log
+    if (record_id == 1) {
         sqlite3_close(new_log_db);
         std::filesystem::remove(db_path);
         return false;
     }
-    // store previous record id
-    std::map<std::pair<unsigned, unsigned>, unsigned long> prev_id_map;
+    // build the tile index after inserting all records, which is much faster than maintaining it while inserting
+    if (PxlsProfileScope index_scope(PxlsProfiler::OPEN_LOG_INDEX);
+        sqlite3_exec(new_log_db, "CREATE INDEX IF NOT EXISTS log_tile_index ON log(tile_id, id);", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_close(new_log_db);
+        return false;
+    }
+    CloseLogDB();
+    log_db = new_log_db;
+    writable = true;
+    if (!QueryLogDBMetadata()) {
+        CloseLogDB();
+        return false;
+    }
+    db_filename = db_path;
+    // compressed logs are archives, which can't be followed
+    source_filename = compressed ? std::string {} : filename;
+    // write columnar sidecar alongside the logdb, playback falls back to sqlite if it can't be built. the sidecar can't
+    // be extended with the records appended later, so a stale one is removed instead when converting for following
+    const auto columns_path = std::filesystem::path(log_path).replace_extension("pxcol").string();
+    if (std::error_code ec; follow_source)
+        std::filesystem::remove(columns_path, ec);
+    else if (PxlsProfileScope columns_scope(PxlsProfiler::OPEN_LOG_COLUMNS);
+        write_columns && PxlsLogColumns::Build(log_db, columns_path))
+        OpenColumns(columns_path);
+    // build statistics for range queries, which are unavailable if it fails
+    {
+        PxlsProfileScope stats_scope(PxlsProfiler::OPEN_LOG_STATS);
+        PxlsLogStats::Build(log_db);
+    }
+    stats_id = PxlsLogStats::CoveredId(log_db);
+    PublishInfo();
+    return true;
+}
+
+bool PxlsLogDB::ResumeLogRaw(const std::string &db_path, std::istream &file, sqlite3 *&resumed_log_db,
+                             std::map<std::pair<unsigned, unsigned>, unsigned long> &prev_id_map,
+                             unsigned long &record_id, unsigned long long &ingested_offset, std::uint64_t &prefix_hash) {
+    if (!std::filesystem::exists(db_path) || std::filesystem::is_directory(db_path)) return false;
+    sqlite3 *new_log_db = nullptr;
+    if (sqlite3_open_v2(db_path.c_str(), &new_log_db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        sqlite3_close(new_log_db);
+        return false;
+    }
+    const auto Fail = [&] {
+        sqlite3_close(new_log_db);
+        return false;
+    };
+    // logdb created by older versions doesn't have checkpoints, and the ones of other schema versions are reconstructed
+    unsigned long long checkpoint_offset;
+    std::uint64_t checkpoint_hash;
+    try {
+        const auto offset_str = ReadMeta(new_log_db, "source_offset");
+        const auto hash_str = ReadMeta(new_log_db, "source_prefix_hash");
+        const auto version_str = ReadMeta(new_log_db, "schema_version");
+        if (!offset_str || !hash_str || !version_str || std::stoul(*version_str) != SCHEMA_VERSION) return Fail();
+        checkpoint_offset = std::stoull(*offset_str);
+        checkpoint_hash = std::stoull(*hash_str);
+    } catch (std::logic_error&) {
+        return Fail();
+    }
+    // verify that the pxls log starts with the bytes ingested before
+    std::uint64_t hash = PREFIX_HASH_SEED;
+    std::vector<char> buf(1 << 20);
+    for (auto remaining = checkpoint_offset; remaining > 0; ) {
+        const auto read_size = static_cast<std::streamsize>(std::min<unsigned long long>(remaining, buf.size()));
+        if (!file.read(buf.data(), read_size)) return Fail();
+        hash = HashBytes(buf.data(), read_size, hash);
+        remaining -= read_size;
+    }
+    if (hash != checkpoint_hash) return Fail();
+    // restore the state at the checkpoint
+    std::map<std::pair<unsigned, unsigned>, unsigned long> new_prev_id_map;
+    if (sqlite3_exec(new_log_db, "SELECT x,y,last_id FROM pixel_head;", [](void* map_ptr, int, char **argv, char**) -> int {
+        (*static_cast<std::map<std::pair<unsigned, unsigned>, unsigned long>*>(map_ptr))[
+            std::make_pair(std::stoul(argv[0]), std::stoul(argv[1]))] = std::stoul(argv[2]);
+        return 0;
+    }, &new_prev_id_map, nullptr) != SQLITE_OK)
+        return Fail();
+    unsigned long max_id = 0;
+    if (sqlite3_exec(new_log_db, "SELECT COALESCE(MAX(id), 0) FROM log;", [](void* id_ptr, int, char **argv, char**) -> int {
+        *static_cast<unsigned long*>(id_ptr) = std::stoul(argv[0]);
+        return 0;
+    }, &max_id, nullptr) != SQLITE_OK)
+        return Fail();
+    // metadata is rescanned after conversion. snapshots carry their own dimension, so the ones created before the
+    // checkpoint are kept even if the canvas grows
+    if (sqlite3_exec(new_log_db, "PRAGMA foreign_keys = ON;"
+                                 "DELETE FROM meta WHERE key IN ('width','height','record_count','start_time','end_time');",
+                                 nullptr, nullptr, nullptr) != SQLITE_OK)
+        return Fail();
+    resumed_log_db = new_log_db;
+    prev_id_map = std::move(new_prev_id_map);
+    record_id = max_id + 1;
+    ingested_offset = checkpoint_offset;
+    prefix_hash = checkpoint_hash;
+    return true;
+}
+
+bool PxlsLogDB::OpenLogRawSharded(const std::string &filename, const IngestCallback &ingest_callback,
+                                  const SnapshotDumpCallback &snapshot_callback) {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    const auto manifest_path = std::filesystem::path(filename).replace_extension("logdbm").string();
+    const auto ShardPath = [&](const std::size_t index) {
+        return std::filesystem::path(filename).replace_extension(std::format("{:04}.logshard", index)).string();
+    };
+    // the manifest is written after all shards are built, so a stale one must not survive a failed conversion
+    std::filesystem::remove(manifest_path);
+    std::vector<Shard> new_shards;
+    std::vector<std::future<bool>> builds;
+    std::size_t finished_count = 0;
+    bool build_ok = true;
+    // last record id of each pixel in the shards linked so far
+    std::map<std::pair<unsigned, unsigned>, unsigned long> head_map;
+    // wait for the oldest shard being built, then link it to the shards before it
+    const auto FinishShard = [&] {
+        const bool built = builds[finished_count].get();
+        build_ok = build_ok && built && LinkShard(new_shards[finished_count].filename, head_map);
+        finished_count++;
+    };
+    const auto max_builds = std::max(1u, std::thread::hardware_concurrency());
+    std::string record_line;
+    std::vector<std::string> record;
+    unsigned record_x, record_y;
+    long long record_time;
+    unsigned long record_id = 1, shard_first_id = 1;
+    unsigned long long offset = 0, shard_begin = 0;
+    unsigned new_width = 0, new_height = 0;
+    std::optional<long long> start_time { std::nullopt };
+    long long end_time = 0;
+    // offsets of the pxls log to create snapshots at, like the unsharded conversion
+    const bool create_snapshots = ingest_callback && snapshot_callback;
+    const auto file_size = std::filesystem::file_size(filename);
+    std::vector<unsigned long long> snapshot_offsets;
+    for (const auto proportion: snapshot_proportions)
+        if (create_snapshots)
+            snapshot_offsets.push_back(static_cast<unsigned long long>(std::ceil(static_cast<double>(proportion) * file_size)));
+    std::size_t next_snapshot = 0;
+    // snapshots of the records scanned since the last cut, which go to the next shard
+    ShardSnapshots shard_snapshots;
+    const auto DumpSnapshot = [&] {
+        if (!create_snapshots || record_id == shard_first_id ||
+            (!shard_snapshots.empty() && shard_snapshots.back().first == record_id - 1))
+            return;
+        std::vector<char> snapshot_blob;
+        if (snapshot_callback(snapshot_blob))
+            shard_snapshots.emplace_back(record_id - 1, std::move(snapshot_blob));
+    };
+    // hand the lines scanned since the last cut to a new shard, along with its snapshots. every shard has one at its
+    // end besides the ones at the snapshot proportions, so that seeking never replays more than a shard
+    const auto CutShard = [&] {
+        DumpSnapshot();
+        new_shards.push_back({ ShardPath(new_shards.size()), shard_first_id, record_id - 1, {} });
+        for (const auto &[snapshot_id, snapshot_blob]: shard_snapshots)
+            new_shards.back().snapshot_ids.push_back(snapshot_id);
+        while (builds.size() - finished_count >= max_builds)
+            FinishShard();
+        builds.push_back(std::async(std::launch::async, &PxlsLogDB::BuildShard, this, filename, new_shards.back().filename,
+            shard_begin, offset, shard_first_id, record_id - 1, std::move(shard_snapshots)));
+        shard_snapshots.clear();
+        shard_begin = offset;
+        shard_first_id = record_id;
+    };
+    {
+        // scan pxls log for the boundaries of shards, the records are only parsed here and inserted by the shard builds
+        PxlsProfileScope ingest_scope(PxlsProfiler::OPEN_LOG_INGEST);
+        while (build_ok && std::getline(file, record_line)) {
+            // a sharded logdb is never followed, so an unterminated last line is converted as well
+            offset += record_line.size();
+            if (!file.eof()) offset++;
+            // malformed lines are quarantined by the shard build
+            if (!ParseRecord(record_line, record, record_x, record_y, record_time)) continue;
+            record_id++;
+            new_width = std::max(new_width, record_x + 1);
+            new_height = std::max(new_height, record_y + 1);
+            if (!start_time) start_time = record_time;
+            end_time = record_time;
+            if (ingest_callback)
+                ingest_callback(record_time, record[1], record_x, record_y, std::stoul(record[4]), record[5]);
+            for (; next_snapshot < snapshot_offsets.size() && offset >= snapshot_offsets[next_snapshot]; next_snapshot++)
+                DumpSnapshot();
+            // shards are cut at line boundaries
+            if (offset - shard_begin >= shard_bytes)
+                CutShard();
+        }
+        if (build_ok && record_id > shard_first_id)
+            CutShard();
+        while (finished_count < builds.size())
+            FinishShard();
+    }
+    // a file without any valid record is not a pxls log
+    if (!build_ok || new_shards.empty()) {
+        for (const auto &shard: new_shards) {
+            std::filesystem::remove(shard.filename);
+            std::filesystem::remove(shard.filename + "-wal");
+            std::filesystem::remove(shard.filename + "-shm");
+        }
+        return false;
+    }
+    CloseLogDB();
+    shards = std::move(new_shards);
+    db_filename = manifest_path;
+    db_width = new_width; db_height = new_height;
+    db_record_count = record_id - 1;
+    db_start_time = PxlsLogColumns::FormatDate(*start_time);
+    db_end_time = PxlsLogColumns::FormatDate(end_time);
+    has_tile_index = true;
+    if (!WriteManifest() || !(log_db = ShardDB(0))) {
+        CloseLogDB();
+        return false;
+    }
+    PublishInfo();
+    return true;
+}
+
+bool PxlsLogDB::BuildShard(const std::string &log_path, const std::string &shard_path, const unsigned long long begin_offset,
+                           const unsigned long long end_offset, const unsigned long first_id, const unsigned long last_id,
+                           const ShardSnapshots &snapshots) const {
+    std::ifstream file(log_path, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(begin_offset));
+    if (!file) return false;
+    std::filesystem::remove(shard_path);
+    std::filesystem::remove(shard_path + "-wal");
+    std::filesystem::remove(shard_path + "-shm");
+    sqlite3 *shard_db = nullptr;
+    if (sqlite3_open_v2(shard_path.c_str(), &shard_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, nullptr) != SQLITE_OK) {
+        sqlite3_close(shard_db);
+        return false;
+    }
+    const auto Fail = [&] {
+        sqlite3_exec(shard_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        sqlite3_close(shard_db);
+        std::filesystem::remove(shard_path);
+        return false;
+    };
+    // prev_id may point to an earlier shard, so it isn't a foreign key. shard_head stores the first and the last record
+    // of each pixel in the shard, which are used for linking the shards after all of them are built
+    const std::string init_sql = "PRAGMA journal_mode = WAL;"
+                                 "CREATE TABLE log("
+                                 "id INTEGER PRIMARY KEY,"
+                                 "prev_id INTEGER,"
+                                 "date INTEGER NOT NULL,"
+                                 "hash TEXT NOT NULL,"
+                                 "x INTEGER NOT NULL,"
+                                 "y INTEGER NOT NULL,"
+                                 "color_index INTEGER NOT NULL,"
+                                 "action TEXT NOT NULL,"
+                                 "tile_id INTEGER NOT NULL"
+                                 ");"
+                                 "CREATE TABLE canvas_snapshot("
+                                 "id INTEGER PRIMARY KEY NOT NULL,"
+                                 "snapshot BLOB NOT NULL"
+                                 ");"
+                                 "CREATE TABLE meta("
+                                 "key TEXT PRIMARY KEY NOT NULL,"
+                                 "value TEXT NOT NULL"
+                                 ");"
+                                 "CREATE TABLE shard_head("
+                                 "x INTEGER NOT NULL,"
+                                 "y INTEGER NOT NULL,"
+                                 "first_id INTEGER NOT NULL,"
+                                 "last_id INTEGER NOT NULL,"
+                                 "PRIMARY KEY (x, y)"
+                                 ") WITHOUT ROWID;"
+                                 "CREATE TABLE quarantine("
+                                 "id INTEGER PRIMARY KEY AUTOINCREMENT,"
+                                 "source_offset INTEGER NOT NULL,"
+                                 "line TEXT NOT NULL"
+                                 ");" +
+                                 std::format("INSERT INTO meta(key,value) VALUES ('schema_version','{}'),"
+                                             "('shard_first_id','{}'),('shard_last_id','{}');", SCHEMA_VERSION, first_id, last_id) +
+                                 "BEGIN;";
+    if (sqlite3_exec(shard_db, init_sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) return Fail();
+    sqlite3_stmt *quarantine_stmt;
+    sqlite3_prepare_v2(shard_db, "INSERT INTO quarantine(source_offset,line) VALUES (?,?);", -1, &quarantine_stmt, nullptr);
+    // first and last record id of each pixel in the shard
+    std::map<std::pair<unsigned, unsigned>, std::pair<unsigned long, unsigned long>> heads;
     std::string record_line;
     std::vector<std::string> record;
-    const std::string insert_sql_prefix = "INSERT INTO log(date,hash,x,y,color_index,action,prev_id) VALUES ";
+    const std::string insert_sql_prefix = "INSERT INTO log(id,date,hash,x,y,color_index,action,tile_id,prev_id) VALUES ";
     std::stringstream sql_ss;
     sql_ss << insert_sql_prefix;
-    unsigned long record_id = 1;
     unsigned short record_num = 0;
+    unsigned long record_id = first_id;
     unsigned record_x, record_y;
-    while (std::getline(file, record_line)) {
-        split(record, record_line, boost::is_any_of("\t"));
-        /*
-         * record format
-         * [date, random_hash, x, y, color_index, action]
-         */
-        if (record.size() != 6) {
-            sqlite3_close(new_log_db);
-            std::filesystem::remove(db_path);
-            return false;
+    long long record_time;
+    const auto FlushRecords = [&] {
+        if (record_num == 0) return true;
+        PxlsProfileScope insert_scope(PxlsProfiler::OPEN_LOG_INSERT, record_num);
+        std::string insert_sql { sql_ss.str() };
+        insert_sql.back() = ';';
+        record_num = 0;
+        sql_ss.str("");
+        sql_ss << insert_sql_prefix;
+        return sqlite3_exec(shard_db, insert_sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    };
+    for (auto offset = begin_offset; offset < end_offset && std::getline(file, record_line);) {
+        const auto line_offset = offset;
+        offset += record_line.size();
+        if (!file.eof()) offset++;
+        if (!ParseRecord(record_line, record, record_x, record_y, record_time)) {
+            sqlite3_bind_int64(quarantine_stmt, 1, static_cast<sqlite3_int64>(line_offset));
+            sqlite3_bind_text(quarantine_stmt, 2, record_line.c_str(), -1, SQLITE_TRANSIENT);
+            const bool quarantine_ok = sqlite3_step(quarantine_stmt) == SQLITE_DONE;
+            sqlite3_reset(quarantine_stmt);
+            if (!quarantine_ok) {
+                sqlite3_finalize(quarantine_stmt);
+                return Fail();
+            }
+            continue;
         }
-        record[0][record[0].rfind(',')] = '.'; // convert date to compatible format
-        // construct insert values
-        sql_ss << "('" << record[0]
-            << "','" << record[1]
+        sql_ss << '(' << record_id
+            << ',' << record_time
+            << ",'" << record[1]
             << "'," << record[2]
             << ',' << record[3]
             << ',' << record[4]
             << ",'" << record[5]
-            << "',";
-        // fetch
-        try {
-            record_x = std::stoul(record[2]);
-            record_y = std::stoul(record[3]);
-        }
-        catch (std::invalid_argument&) {
-            sqlite3_close(new_log_db);
-            std::filesystem::remove(db_path);
-            return false;
-        }
-        if (prev_id_map.contains(std::make_pair(record_x, record_y)))
-            sql_ss << prev_id_map[std::make_pair(record_x, record_y)];
-        else
+            << "'," << TileId(record_x, record_y)
+            << ',';
+        // the first record of a pixel in the shard is linked later
+        if (const auto head = heads.find(std::make_pair(record_x, record_y)); head != heads.end()) {
+            sql_ss << head->second.second;
+            head->second.second = record_id;
+        } else {
             sql_ss << "NULL";
+            heads[std::make_pair(record_x, record_y)] = std::make_pair(record_id, record_id);
+        }
         sql_ss << "),";
-        // update prev_id_map
-        prev_id_map[std::make_pair(record_x, record_y)] = record_id++;
-        // insert INSERT_RECORDS_MAX_COUNT of records a time
-        if (++record_num == INSERT_RECORDS_MAX_COUNT) {
-            std::string insert_sql { sql_ss.str() };
-            insert_sql.back() = ';';
-            if (sqlite3_exec(new_log_db, insert_sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
-                sqlite3_close(new_log_db);
-                std::filesystem::remove(db_path);
-                return false;
-            }
-            record_num = 0;
-            sql_ss.str("");
-            sql_ss << insert_sql_prefix;
+        record_id++;
+        if (++record_num == INSERT_RECORDS_MAX_COUNT && !FlushRecords()) {
+            sqlite3_finalize(quarantine_stmt);
+            return Fail();
         }
     }
-    if (!sql_ss.str().empty()) {
-        std::string insert_sql { sql_ss.str() };
-        insert_sql.back() = ';';
-        if (sqlite3_exec(new_log_db, insert_sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) {
-            sqlite3_close(new_log_db);
-            std::filesystem::remove(db_path);
-            return false;
+    sqlite3_finalize(quarantine_stmt);
+    // the records must match the ones counted when scanning pxls log
+    if (!FlushRecords() || record_id != last_id + 1) return Fail();
+    sqlite3_stmt *head_stmt;
+    sqlite3_prepare_v2(shard_db, "INSERT INTO shard_head(x,y,first_id,last_id) VALUES (?,?,?,?);", -1, &head_stmt, nullptr);
+    for (const auto &[pos, ids]: heads) {
+        sqlite3_bind_int(head_stmt, 1, static_cast<int>(pos.first));
+        sqlite3_bind_int(head_stmt, 2, static_cast<int>(pos.second));
+        sqlite3_bind_int64(head_stmt, 3, static_cast<sqlite3_int64>(ids.first));
+        sqlite3_bind_int64(head_stmt, 4, static_cast<sqlite3_int64>(ids.second));
+        const bool head_ok = sqlite3_step(head_stmt) == SQLITE_DONE;
+        sqlite3_reset(head_stmt);
+        if (!head_ok) {
+            sqlite3_finalize(head_stmt);
+            return Fail();
         }
     }
-    CloseLogDB();
-    log_db = new_log_db;
-    if (!QueryLogDBMetadata()) {
-        CloseLogDB();
+    sqlite3_finalize(head_stmt);
+    sqlite3_stmt *snapshot_stmt;
+    sqlite3_prepare_v2(shard_db, "INSERT INTO canvas_snapshot(id,snapshot) VALUES (?,?);", -1, &snapshot_stmt, nullptr);
+    for (const auto &[snapshot_id, snapshot_blob]: snapshots) {
+        sqlite3_bind_int64(snapshot_stmt, 1, static_cast<sqlite3_int64>(snapshot_id));
+        sqlite3_bind_blob64(snapshot_stmt, 2, snapshot_blob.data(), snapshot_blob.size(), SQLITE_STATIC);
+        const bool snapshot_ok = sqlite3_step(snapshot_stmt) == SQLITE_DONE;
+        sqlite3_reset(snapshot_stmt);
+        if (!snapshot_ok) {
+            sqlite3_finalize(snapshot_stmt);
+            return Fail();
+        }
+    }
+    sqlite3_finalize(snapshot_stmt);
+    if (!WriteSnapshotSummary(shard_db) || sqlite3_exec(shard_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK)
+        return Fail();
+    if (PxlsProfileScope index_scope(PxlsProfiler::OPEN_LOG_INDEX);
+        sqlite3_exec(shard_db, "CREATE INDEX log_tile_index ON log(tile_id, id);", nullptr, nullptr, nullptr) != SQLITE_OK)
+        return Fail();
+    sqlite3_close(shard_db);
+    return true;
+}
+
+bool PxlsLogDB::LinkShard(const std::string &shard_path, std::map<std::pair<unsigned, unsigned>, unsigned long> &head_map) {
+    sqlite3 *shard_db = nullptr;
+    if (sqlite3_open_v2(shard_path.c_str(), &shard_db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK ||
+        sqlite3_exec(shard_db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_close(shard_db);
+        return false;
+    }
+    sqlite3_stmt *head_stmt, *link_stmt;
+    sqlite3_prepare_v2(shard_db, "SELECT x,y,first_id,last_id FROM shard_head;", -1, &head_stmt, nullptr);
+    sqlite3_prepare_v2(shard_db, "UPDATE log SET prev_id = ? WHERE id = ?;", -1, &link_stmt, nullptr);
+    bool link_ok = true;
+    int step_result;
+    while (link_ok && (step_result = sqlite3_step(head_stmt)) == SQLITE_ROW) {
+        const auto pos = std::make_pair(static_cast<unsigned>(sqlite3_column_int64(head_stmt, 0)),
+                                        static_cast<unsigned>(sqlite3_column_int64(head_stmt, 1)));
+        if (const auto head = head_map.find(pos); head != head_map.end()) {
+            sqlite3_bind_int64(link_stmt, 1, static_cast<sqlite3_int64>(head->second));
+            sqlite3_bind_int64(link_stmt, 2, sqlite3_column_int64(head_stmt, 2));
+            link_ok = sqlite3_step(link_stmt) == SQLITE_DONE;
+            sqlite3_reset(link_stmt);
+        }
+        head_map[pos] = sqlite3_column_int64(head_stmt, 3);
+    }
+    sqlite3_finalize(head_stmt);
+    sqlite3_finalize(link_stmt);
+    if (!link_ok || step_result != SQLITE_DONE || sqlite3_exec(shard_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(shard_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        sqlite3_close(shard_db);
         return false;
     }
+    sqlite3_close(shard_db);
     return true;
 }
 
-bool PxlsLogDB::OpenLogDB(const std::string &filename) {
+std::uint64_t PxlsLogDB::HashBytes(const char *data, const std::size_t size, std::uint64_t hash) {
+    // 64-bit FNV-1a, which can be continued from a previous hash
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+void PxlsLogDB::SnapshotProportions(std::vector<float> proportions) {
+    std::erase_if(proportions, [](const float proportion) { return !(proportion > 0.0f && proportion <= 1.0f); });
+    std::ranges::sort(proportions);
+    snapshot_proportions = std::move(proportions);
+}
+
+bool PxlsLogDB::OpenLogDB(const std::string &filename, const bool open_read_only) {
     if (!std::filesystem::exists(filename) || std::filesystem::is_directory(filename)) return false;
+    if (std::filesystem::path(filename).extension() == ".logdbm") return OpenManifest(filename, open_read_only);
+    // open readonly, so that opening a logdb doesn't change the file. it is reopened for writing when it has to be written
     sqlite3 *new_log_db = nullptr;
-    if (sqlite3_open_v2(filename.c_str(), &new_log_db,
-        SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) return false;
-    // enable foreign keys
-    if (sqlite3_exec(new_log_db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+    if (sqlite3_open_v2(filename.c_str(), &new_log_db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK ||
+        sqlite3_exec(new_log_db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr) != SQLITE_OK) {
         sqlite3_close(new_log_db);
         return false;
     }
+    sqlite3_busy_timeout(new_log_db, BUSY_TIMEOUT_MS);
     CloseLogDB();
     log_db = new_log_db;
+    db_filename = filename;
+    read_only = open_read_only;
     if (!QueryLogDBMetadata()) {
         CloseLogDB();
         return false;
     }
+    // the source pxls log is expected to lie beside the logdb
+    if (const auto log_path = std::filesystem::path(filename).replace_extension("log");
+        std::filesystem::exists(log_path) && !std::filesystem::is_directory(log_path))
+        source_filename = log_path.string();
+    OpenColumns(std::filesystem::path(filename).replace_extension("pxcol").string());
+    stats_id = PxlsLogStats::CoveredId(log_db);
+    PublishInfo();
+    return true;
+}
+
+bool PxlsLogDB::RefreshMetadata() {
+    // a sharded logdb can't follow its source pxls log, so its metadata never changes
+    if (IsSharded()) return true;
+    if (!QueryLogDBMetadata()) return false;
+    stats_id = PxlsLogStats::CoveredId(log_db);
+    PublishInfo();
+    return true;
+}
+
+bool PxlsLogDB::OpenManifest(const std::string &filename, const bool open_read_only) {
+    std::vector<Shard> new_shards;
+    unsigned new_width, new_height, new_schema_version;
+    unsigned long new_record_count;
+    std::string new_start_time, new_end_time;
+    try {
+        std::ifstream file(filename);
+        const auto manifest = json::parse(file);
+        new_schema_version = manifest.at("schema_version").get<unsigned>();
+        new_width = manifest.at("width").get<unsigned>();
+        new_height = manifest.at("height").get<unsigned>();
+        new_record_count = manifest.at("record_count").get<unsigned long>();
+        new_start_time = manifest.at("start_time").get<std::string>();
+        new_end_time = manifest.at("end_time").get<std::string>();
+        // shard files are relative to the manifest
+        for (const auto &shard: manifest.at("shards")) {
+            new_shards.push_back({
+                (std::filesystem::path(filename).parent_path() / shard.at("file").get<std::string>()).string(),
+                shard.at("first_id").get<unsigned long>(), shard.at("last_id").get<unsigned long>(),
+                shard.at("snapshot_ids").get<std::vector<unsigned long>>()
+            });
+        }
+    } catch (json::exception&) {
+        return false;
+    }
+    // shards must cover all records in order
+    unsigned long next_id = 1;
+    for (const auto &shard: new_shards) {
+        if (shard.first_id != next_id || shard.last_id < shard.first_id ||
+            !std::filesystem::exists(shard.filename) || std::filesystem::is_directory(shard.filename))
+            return false;
+        next_id = shard.last_id + 1;
+    }
+    if (new_shards.empty() || next_id != new_record_count + 1 || new_schema_version != SCHEMA_VERSION) return false;
+    CloseLogDB();
+    shards = std::move(new_shards);
+    read_only = open_read_only;
+    db_width = new_width; db_height = new_height;
+    db_record_count = new_record_count;
+    db_start_time = new_start_time;
+    db_end_time = new_end_time;
+    has_tile_index = true;
+    if (!(log_db = ShardDB(0))) {
+        CloseLogDB();
+        return false;
+    }
+    db_filename = filename;
+    PublishInfo();
+    return true;
+}
+
+bool PxlsLogDB::WriteManifest() const {
+    json manifest;
+    manifest["schema_version"] = db_schema_version;
+    manifest["width"] = db_width;
+    manifest["height"] = db_height;
+    manifest["record_count"] = db_record_count;
+    manifest["start_time"] = db_start_time;
+    manifest["end_time"] = db_end_time;
+    manifest["shards"] = json::array();
+    for (const auto &shard: shards) {
+        manifest["shards"].push_back({
+            { "file", std::filesystem::path(shard.filename).filename().string() },
+            { "first_id", shard.first_id }, { "last_id", shard.last_id }, { "snapshot_ids", shard.snapshot_ids }
+        });
+    }
+    // replace the manifest as a whole so that it is never left half written
+    const auto temp_path = db_filename + ".tmp";
+    {
+        std::ofstream file(temp_path);
+        file << manifest.dump(2);
+        if (!file) return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, db_filename, ec);
+    return !ec;
+}
+
+sqlite3* PxlsLogDB::ShardDB(const std::size_t index) const {
+    std::lock_guard lock(shard_mutex);
+    auto &shard = shards[index];
+    if (shard.db) return shard.db;
+    sqlite3 *shard_db = nullptr;
+    if (read_only || sqlite3_open_v2(shard.filename.c_str(), &shard_db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK) {
+        sqlite3_close(shard_db);
+        shard_db = nullptr;
+        if (sqlite3_open_v2(shard.filename.c_str(), &shard_db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            sqlite3_close(shard_db);
+            return nullptr;
+        }
+    }
+    sqlite3_busy_timeout(shard_db, BUSY_TIMEOUT_MS);
+    if (sqlite3_prepare_v2(shard_db, "SELECT date,hash,color_index,action FROM log WHERE id = ?;", -1,
+        &shard.record_stmt, nullptr) != SQLITE_OK) {
+        sqlite3_close(shard_db);
+        return nullptr;
+    }
+    shard.db = shard_db;
+    return shard_db;
+}
+
+std::size_t PxlsLogDB::ShardOf(const unsigned long id) const {
+    const auto it = std::ranges::lower_bound(shards, id, {}, &Shard::last_id);
+    return std::min<std::size_t>(it - shards.begin(), shards.size() - 1);
+}
+
+std::size_t PxlsLogDB::OpenShardCount() const {
+    std::lock_guard lock(shard_mutex);
+    return std::ranges::count_if(shards, [](const Shard &shard) { return shard.db != nullptr; });
+}
+
+bool PxlsLogDB::OpenColumns(const std::string &filename) {
+    if (!log_columns.Open(filename)) return false;
+    // records are only appended, so a sidecar covering a prefix of the logdb is still usable
+    if (log_columns.RecordCount() > db_record_count || log_columns.Width() > db_width || log_columns.Height() > db_height) {
+        log_columns.Close();
+        return false;
+    }
     return true;
 }
 
 void PxlsLogDB::CloseLogDB() {
-    if (log_db)
+    // log_db is the first shard of a sharded logdb
+    if (log_db && shards.empty())
         sqlite3_close(log_db);
+    for (const auto &shard: shards) {
+        sqlite3_finalize(shard.record_stmt);
+        if (shard.db)
+            sqlite3_close(shard.db);
+    }
+    shards.clear();
     log_db = nullptr;
+    db_filename.clear();
+    log_columns.Close();
     current_id = 0;
     db_width = db_height = 0;
     db_record_count = 0ul;
+    db_start_time.clear();
+    db_end_time.clear();
+    db_schema_version = SCHEMA_VERSION;
+    has_tile_index = false;
+    stats_id = 0;
+    source_filename.clear();
+    source_offset = 0;
+    source_prefix_hash = PREFIX_HASH_SEED;
+    has_pixel_head = false;
+    read_only = false;
+    writable = false;
+    PublishInfo();
+}
+
+bool PxlsLogDB::ReopenForWriting() {
+    if (writable) return true;
+    if (!log_db || read_only || !shards.empty()) return false;
+    sqlite3 *new_log_db = nullptr;
+    if (sqlite3_open_v2(db_filename.c_str(), &new_log_db, SQLITE_OPEN_READWRITE, nullptr) != SQLITE_OK ||
+        sqlite3_db_readonly(new_log_db, "main") != 0 ||
+        sqlite3_exec(new_log_db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_close(new_log_db);
+        // the file is write protected, so don't try again
+        read_only = true;
+        return false;
+    }
+    sqlite3_busy_timeout(new_log_db, BUSY_TIMEOUT_MS);
+    // switch to wal mode so that readers on other connections don't wait for writing, it is kept in the file
+    sqlite3_exec(new_log_db, "PRAGMA journal_mode = WAL;", nullptr, nullptr, nullptr);
+    sqlite3_close(log_db);
+    log_db = new_log_db;
+    writable = true;
+    return true;
+}
+
+PxlsLogDBInfo PxlsLogDB::Info() const {
+    std::lock_guard lock(info_mutex);
+    return info;
+}
+
+void PxlsLogDB::PublishInfo() {
+    std::lock_guard lock(info_mutex);
+    info = {
+        IsOpen(), db_width, db_height, db_record_count, log_columns.IsOpen() ? log_columns.RecordCount() : 0,
+        log_columns.IsOpen(), HasStats(), CanTail()
+    };
 }
 
 bool PxlsLogDB::QueryLogDBMetadata() {
     if (!log_db) return false;
-    const std::string sql = "SELECT MAX(x),MAX(y),COUNT(*) FROM log";
-    if (sqlite3_exec(log_db, sql.c_str(), [](void* db_ptr, int, char **argv, char**) -> int {
-        auto *db = static_cast<PxlsLogDB*>(db_ptr);
-        db->db_width = std::stoul(argv[0]) + 1;
-        db->db_height = std::stoul(argv[1]) + 1;
-        db->db_record_count = std::stoul(argv[2]);
+    // logdb created by older versions doesn't have the meta table
+    std::map<std::string, std::string> meta;
+    ReadMetaTable(log_db, meta);
+    bool has_metadata = false;
+    if (meta.contains("width") && meta.contains("height") && meta.contains("record_count") &&
+        meta.contains("start_time") && meta.contains("end_time")) {
+        try {
+            db_width = std::stoul(meta["width"]);
+            db_height = std::stoul(meta["height"]);
+            db_record_count = std::stoul(meta["record_count"]);
+            db_start_time = meta["start_time"];
+            db_end_time = meta["end_time"];
+            has_metadata = true;
+        } catch (std::logic_error&) {}
+    }
+    try {
+        db_schema_version = meta.contains("schema_version") ? std::stoul(meta["schema_version"]) : 1;
+    } catch (std::logic_error&) {
+        db_schema_version = 1;
+    }
+    if (!has_metadata) {
+        if (!ScanLogDBMetadata()) return false;
+        // write metadata back so that the scan is only done once, it doesn't matter if the logdb is not writable
+        if (ReopenForWriting())
+            WriteLogDBMetadata();
+    }
+    // logdb created by older versions doesn't have the tile index
+    has_tile_index = false;
+    if (sqlite3_exec(log_db, "SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = 'log_tile_index';",
+        [](void* has_index, int, char **, char**) -> int {
+        *static_cast<bool*>(has_index) = true;
         return 0;
-    }, this, nullptr) != SQLITE_OK)
+    }, &has_tile_index, nullptr) != SQLITE_OK)
+        return false;
+    // logdb created by older versions can't follow the log
+    has_pixel_head = false;
+    if (sqlite3_exec(log_db, "SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name IN ('meta', 'pixel_head', 'quarantine') HAVING COUNT(*) = 3;",
+        [](void* has_head, int, char **, char**) -> int {
+        *static_cast<bool*>(has_head) = true;
+        return 0;
+    }, &has_pixel_head, nullptr) != SQLITE_OK)
+        return false;
+    source_offset = 0;
+    source_prefix_hash = PREFIX_HASH_SEED;
+    if (has_pixel_head) {
+        try {
+            source_offset = std::stoull(meta["source_offset"]);
+            source_prefix_hash = std::stoull(meta["source_prefix_hash"]);
+        } catch (std::logic_error&) {
+            has_pixel_head = false;
+        }
+    }
+    return true;
+}
+
+bool PxlsLogDB::ScanLogDBMetadata() {
+    sqlite3_stmt *sql_stmt;
+    if (sqlite3_prepare_v2(log_db, "SELECT MAX(x),MAX(y),COUNT(*),"
+                                   "(SELECT date FROM log ORDER BY id LIMIT 1),"
+                                   "(SELECT date FROM log ORDER BY id DESC LIMIT 1) FROM log;", -1, &sql_stmt, nullptr) != SQLITE_OK)
+        return false;
+    // empty log table
+    long long start_time, end_time;
+    if (sqlite3_step(sql_stmt) != SQLITE_ROW || sqlite3_column_type(sql_stmt, 0) == SQLITE_NULL ||
+        !PxlsLogColumns::ReadTimeColumn(sql_stmt, 3, start_time) || !PxlsLogColumns::ReadTimeColumn(sql_stmt, 4, end_time)) {
+        sqlite3_finalize(sql_stmt);
+        return false;
+    }
+    db_width = sqlite3_column_int(sql_stmt, 0) + 1;
+    db_height = sqlite3_column_int(sql_stmt, 1) + 1;
+    db_record_count = sqlite3_column_int64(sql_stmt, 2);
+    db_start_time = PxlsLogColumns::FormatDate(start_time);
+    db_end_time = PxlsLogColumns::FormatDate(end_time);
+    sqlite3_finalize(sql_stmt);
+    return true;
+}
+
+bool PxlsLogDB::WriteLogDBMetadata() const {
+    if (sqlite3_exec(log_db, "BEGIN;"
+                             "CREATE TABLE IF NOT EXISTS meta("
+                             "key TEXT PRIMARY KEY NOT NULL,"
+                             "value TEXT NOT NULL"
+                             ");", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
         return false;
+    }
+    if (!WriteMeta(log_db, "schema_version", std::to_string(db_schema_version)) ||
+        !WriteMeta(log_db, "width", std::to_string(db_width)) ||
+        !WriteMeta(log_db, "height", std::to_string(db_height)) ||
+        !WriteMeta(log_db, "record_count", std::to_string(db_record_count)) ||
+        !WriteMeta(log_db, "start_time", db_start_time) ||
+        !WriteMeta(log_db, "end_time", db_end_time) ||
+        (!ReadMeta(log_db, "snapshot_ids") && !WriteSnapshotSummary(log_db)) ||
+        sqlite3_exec(log_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
     return true;
 }
 
-bool PxlsLogDB::QueryRecords(unsigned long dest_id, RecordQueryCallback callback) {
+bool PxlsLogDB::WriteSnapshotSummary(sqlite3 *db) {
+    std::string snapshot_ids;
+    if (sqlite3_exec(db, "SELECT group_concat(id) FROM (SELECT id FROM canvas_snapshot ORDER BY id);",
+        [](void* ids_ptr, int, char **argv, char**) -> int {
+        if (argv[0])
+            *static_cast<std::string*>(ids_ptr) = argv[0];
+        return 0;
+    }, &snapshot_ids, nullptr) != SQLITE_OK)
+        return false;
+    return WriteMeta(db, "snapshot_ids", snapshot_ids);
+}
+
+std::optional<std::uint64_t> PxlsLogDB::PaletteHash() const {
+    try {
+        if (const auto palette_hash = ReadMeta(log_db, "palette_hash"))
+            return std::stoull(*palette_hash);
+    } catch (std::logic_error&) {}
+    return std::nullopt;
+}
+
+bool PxlsLogDB::PaletteHash(const std::uint64_t palette_hash) const {
+    return !read_only && WriteMeta(log_db, "palette_hash", std::to_string(palette_hash));
+}
 
+bool PxlsLogDB::ParseRecord(const std::string &record_line, std::vector<std::string> &record, unsigned &x, unsigned &y,
+                            long long &time) {
+    split(record, record_line, boost::is_any_of("\t"));
+    /*
+     * record format
+     * [date, random_hash, x, y, color_index, action]
+     */
+    if (record.size() != 6) return false;
+    // convert date to compatible format
+    if (const auto comma_pos = record[0].rfind(','); comma_pos != std::string::npos)
+        record[0][comma_pos] = '.';
+    // strip carriage return of logs with crlf line endings
+    if (!record[5].empty() && record[5].back() == '\r')
+        record[5].pop_back();
+    // fetch
+    try {
+        x = std::stoul(record[2]);
+        y = std::stoul(record[3]);
+        std::stoul(record[4]);
+    }
+    catch (std::logic_error&) {
+        return false;
+    }
+    return PxlsLogColumns::ParseDate(record[0], time);
+}
+
+bool PxlsLogDB::ReadMetaTable(sqlite3 *db, std::map<std::string, std::string> &meta) {
+    return db && sqlite3_exec(db, "SELECT key,value FROM meta;", [](void* meta_ptr, int, char **argv, char**) -> int {
+        (*static_cast<std::map<std::string, std::string>*>(meta_ptr))[argv[0]] = argv[1];
+        return 0;
+    }, &meta, nullptr) == SQLITE_OK;
+}
+
+std::optional<std::string> PxlsLogDB::ReadMeta(sqlite3 *db, const std::string &key) {
+    if (!db) return std::nullopt;
+    sqlite3_stmt *sql_stmt;
+    if (sqlite3_prepare_v2(db, "SELECT value FROM meta WHERE key = ?;", -1, &sql_stmt, nullptr) != SQLITE_OK)
+        return std::nullopt;
+    sqlite3_bind_text(sql_stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    std::optional<std::string> value { std::nullopt };
+    if (sqlite3_step(sql_stmt) == SQLITE_ROW)
+        value = reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, 0));
+    sqlite3_finalize(sql_stmt);
+    return value;
+}
+
+bool PxlsLogDB::WriteMeta(sqlite3 *db, const std::string &key, const std::string &value) {
+    if (!db) return false;
+    sqlite3_stmt *sql_stmt;
+    if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO meta(key,value) VALUES (?,?);", -1, &sql_stmt, nullptr) != SQLITE_OK)
+        return false;
+    sqlite3_bind_text(sql_stmt, 1, key.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(sql_stmt, 2, value.c_str(), -1, SQLITE_TRANSIENT);
+    const bool result = sqlite3_step(sql_stmt) == SQLITE_DONE;
+    sqlite3_finalize(sql_stmt);
+    return result;
+}
+
+bool PxlsLogDB::CanTail() const {
+    return log_db && !read_only && has_pixel_head && !source_filename.empty() && !log_columns.IsOpen();
+}
+
+bool PxlsLogDB::TailLogRaw(unsigned long &appended_count) {
+    appended_count = 0;
+    if (!CanTail() || !std::filesystem::exists(source_filename)) return false;
+    // the log has been truncated or replaced, which can't be followed
+    if (std::filesystem::file_size(source_filename) < source_offset) return false;
+    if (std::filesystem::file_size(source_filename) == source_offset) return true;
+    // the logdb is written from now on, and it can't follow the log if it isn't writable
+    if (!ReopenForWriting()) {
+        PublishInfo();
+        return false;
+    }
+    std::ifstream file(source_filename, std::ios::binary);
+    // a logdb not converted for following the log may end with a line converted before it was complete. the rest of
+    // that line can't be parsed on its own, so it is put aside
+    bool line_fragment = false;
+    if (source_offset != 0) {
+        file.seekg(static_cast<std::streamoff>(source_offset - 1));
+        line_fragment = file.get() != '\n';
+    }
+    file.seekg(static_cast<std::streamoff>(source_offset));
+    if (!file) return false;
+    sqlite3_stmt *insert_stmt, *head_query_stmt, *head_update_stmt, *quarantine_stmt;
+    sqlite3_prepare_v2(log_db, "INSERT INTO log(date,hash,x,y,color_index,action,tile_id,prev_id) VALUES (?,?,?,?,?,?,?,?);",
+        -1, &insert_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "SELECT last_id FROM pixel_head WHERE x = ? AND y = ?;", -1, &head_query_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "INSERT OR REPLACE INTO pixel_head(x,y,last_id) VALUES (?,?,?);", -1, &head_update_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "INSERT INTO quarantine(source_offset,line) VALUES (?,?);", -1, &quarantine_stmt, nullptr);
+    const auto FinalizeStatements = [&] {
+        sqlite3_finalize(insert_stmt);
+        sqlite3_finalize(head_query_stmt);
+        sqlite3_finalize(head_update_stmt);
+        sqlite3_finalize(quarantine_stmt);
+    };
+    if (sqlite3_exec(log_db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        FinalizeStatements();
+        return false;
+    }
+    const auto Rollback = [&] {
+        FinalizeStatements();
+        sqlite3_exec(log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    };
+    std::string record_line;
+    std::vector<std::string> record;
+    unsigned record_x, record_y;
+    long long record_time;
+    auto new_offset = source_offset;
+    auto new_prefix_hash = source_prefix_hash;
+    auto new_end_time = db_end_time;
+    unsigned long new_count = 0;
+    unsigned new_width = db_width, new_height = db_height;
+    while (std::getline(file, record_line)) {
+        // the last line may still be being written, leave it to the next time
+        if (file.eof()) break;
+        const auto line_offset = new_offset;
+        new_offset += record_line.size() + 1;
+        new_prefix_hash = HashBytes("\n", 1, HashBytes(record_line.data(), record_line.size(), new_prefix_hash));
+        const bool is_fragment = std::exchange(line_fragment, false);
+        if (is_fragment && record_line.empty()) continue;
+        // put malformed lines aside
+        if (is_fragment || !ParseRecord(record_line, record, record_x, record_y, record_time)) {
+            sqlite3_bind_int64(quarantine_stmt, 1, static_cast<sqlite3_int64>(line_offset));
+            sqlite3_bind_text(quarantine_stmt, 2, record_line.c_str(), -1, SQLITE_TRANSIENT);
+            const bool quarantine_ok = sqlite3_step(quarantine_stmt) == SQLITE_DONE;
+            sqlite3_reset(quarantine_stmt);
+            if (!quarantine_ok) return Rollback();
+            continue;
+        }
+        // fetch the last record id of the pixel
+        std::optional<sqlite3_int64> prev_id { std::nullopt };
+        sqlite3_bind_int(head_query_stmt, 1, static_cast<int>(record_x));
+        sqlite3_bind_int(head_query_stmt, 2, static_cast<int>(record_y));
+        if (sqlite3_step(head_query_stmt) == SQLITE_ROW)
+            prev_id = sqlite3_column_int64(head_query_stmt, 0);
+        sqlite3_reset(head_query_stmt);
+        // insert record
+        // logdb of older versions stores dates as text
+        if (db_schema_version >= 3)
+            sqlite3_bind_int64(insert_stmt, 1, record_time);
+        else
+            sqlite3_bind_text(insert_stmt, 1, record[0].c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(insert_stmt, 2, record[1].c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(insert_stmt, 3, static_cast<int>(record_x));
+        sqlite3_bind_int(insert_stmt, 4, static_cast<int>(record_y));
+        sqlite3_bind_int(insert_stmt, 5, static_cast<int>(std::stoul(record[4])));
+        sqlite3_bind_text(insert_stmt, 6, record[5].c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(insert_stmt, 7, static_cast<int>(TileId(record_x, record_y)));
+        if (prev_id)
+            sqlite3_bind_int64(insert_stmt, 8, *prev_id);
+        else
+            sqlite3_bind_null(insert_stmt, 8);
+        const bool insert_ok = sqlite3_step(insert_stmt) == SQLITE_DONE;
+        sqlite3_reset(insert_stmt);
+        if (!insert_ok) return Rollback();
+        // update the last record id of the pixel
+        sqlite3_bind_int(head_update_stmt, 1, static_cast<int>(record_x));
+        sqlite3_bind_int(head_update_stmt, 2, static_cast<int>(record_y));
+        sqlite3_bind_int64(head_update_stmt, 3, sqlite3_last_insert_rowid(log_db));
+        const bool update_ok = sqlite3_step(head_update_stmt) == SQLITE_DONE;
+        sqlite3_reset(head_update_stmt);
+        if (!update_ok) return Rollback();
+        new_end_time = PxlsLogColumns::FormatDate(record_time);
+        new_width = std::max(new_width, record_x + 1);
+        new_height = std::max(new_height, record_y + 1);
+        new_count++;
+    }
+    // snapshots keep their dimension when the canvas grows, they are decoded into the top left of the larger canvas
+    if (!WriteMeta(log_db, "source_offset", std::to_string(new_offset)) ||
+        !WriteMeta(log_db, "source_prefix_hash", std::to_string(new_prefix_hash)) ||
+        !WriteMeta(log_db, "width", std::to_string(new_width)) ||
+        !WriteMeta(log_db, "height", std::to_string(new_height)) ||
+        !WriteMeta(log_db, "record_count", std::to_string(db_record_count + new_count)) ||
+        !WriteMeta(log_db, "end_time", new_end_time))
+        return Rollback();
+    FinalizeStatements();
+    if (sqlite3_exec(log_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    source_offset = new_offset;
+    source_prefix_hash = new_prefix_hash;
+    db_end_time = new_end_time;
+    db_width = new_width; db_height = new_height;
+    db_record_count += new_count;
+    appended_count = new_count;
+    // extend statistics with the appended records
+    if (stats_id != 0 && PxlsLogStats::Build(log_db))
+        stats_id = PxlsLogStats::CoveredId(log_db);
+    PublishInfo();
+    return true;
+}
+
+std::string PxlsLogDB::RegionCondition(const std::string &table, const PxlsRegion &region) const {
+    const unsigned x_end = region.x + region.width - 1, y_end = region.y + region.height - 1;
+    std::stringstream condition_ss;
+    if (has_tile_index) {
+        // enumerate all tiles overlapping the region so that only records inside them are visited
+        condition_ss << table << ".tile_id IN (";
+        for (unsigned tile_y = region.y / TILE_SIZE; tile_y <= y_end / TILE_SIZE; tile_y++) {
+            for (unsigned tile_x = region.x / TILE_SIZE; tile_x <= x_end / TILE_SIZE; tile_x++) {
+                condition_ss << TileId(tile_x * TILE_SIZE, tile_y * TILE_SIZE) << ',';
+            }
+        }
+        condition_ss.seekp(-1, std::ios_base::cur);
+        condition_ss << ") and ";
+    }
+    condition_ss << std::format("{0}.x >= {1} and {0}.x <= {2} and {0}.y >= {3} and {0}.y <= {4} and ",
+        table, region.x, x_end, region.y, y_end);
+    return condition_ss.str();
+}
+
+bool PxlsLogDB::QueryRecords(unsigned long dest_id, RecordQueryCallback callback, const std::optional<PxlsRegion> &region) {
+    PxlsProfileScope profile_scope(PxlsProfiler::QUERY_RECORDS);
     if (!log_db || dest_id > db_record_count) return false;
     if (callback == nullptr || dest_id == current_id) {
         current_id = dest_id;
         return true;
     }
-    if (dest_id > current_id) {
-        const std::string sql = std::format("SELECT date,hash,x,y,color_index,action "
-                                    "FROM log WHERE id > {} and id <= {};", current_id, dest_id);
-        if (sqlite3_exec(log_db, sql.c_str(), [](void* cb, int, char **argv, char**) -> int {
-            (*static_cast<RecordQueryCallback*>(cb))(
-                argv[0],
-                argv[1],
-                std::stoul(argv[2]),
-                std::stoul(argv[3]),
-                std::stoul(argv[4]),
-                argv[5],
-                FORWARD
-            );
-            return 0;
-        }, &callback, nullptr) != SQLITE_OK)
-            return false;
-    } else {
-        const std::string sql = std::format("SELECT prev_log.date,prev_log.hash,cur_log.x,cur_log.y,prev_log.color_index,prev_log.action "
-                                    "FROM log cur_log LEFT JOIN log prev_log ON cur_log.prev_id = prev_log.id "
-                                    "WHERE cur_log.id > {} and cur_log.id <= {} ORDER BY cur_log.id DESC;", dest_id, current_id);
-        if (sqlite3_exec(log_db, sql.c_str(), [](void* cb, int, char **argv, char**) -> int {
-            (*static_cast<RecordQueryCallback*>(cb))(
-                argv[0] ? std::make_optional(argv[0]) : std::nullopt,
-                argv[1] ? std::make_optional(argv[1]) : std::nullopt,
-                std::stoul(argv[2]),
-                std::stoul(argv[3]),
-                argv[4] ? std::make_optional(std::stoul(argv[4])) : std::nullopt,
-                argv[5] ? std::make_optional(argv[5]) : std::nullopt,
-                BACKWARD
+    if (region && (region->width == 0 || region->height == 0)) {
+        current_id = dest_id;
+        return true;
+    }
+    if (shards.empty()) {
+        if (!QueryRecordRange(log_db, current_id, dest_id, callback, region)) return false;
+        current_id = dest_id;
+        return true;
+    }
+    // visit the shards in the direction of the query, which opens them as the playback head enters their ranges
+    const bool forward = dest_id > current_id;
+    const auto from_shard = ShardOf(forward ? current_id + 1 : current_id.load()), dest_shard = ShardOf(forward ? dest_id : dest_id + 1);
+    for (auto index = from_shard;; forward ? index++ : index--) {
+        const auto &shard = shards[index];
+        const auto shard_dest_id = forward ? std::min(dest_id, shard.last_id) : std::max(dest_id, shard.first_id - 1);
+        sqlite3 *shard_db = ShardDB(index);
+        if (!shard_db || !QueryRecordRange(shard_db, current_id, shard_dest_id, callback, region)) return false;
+        current_id = shard_dest_id;
+        if (index == dest_shard) break;
+    }
+    return true;
+}
+
+bool PxlsLogDB::QueryRecordRange(sqlite3 *db, const unsigned long from_id, const unsigned long dest_id,
+                                 const RecordQueryCallback &callback, const std::optional<PxlsRegion> &region) const {
+    if (from_id == dest_id) return true;
+    // force sqlite to use the tile index when querying a region, otherwise it may prefer scanning the id range
+    const std::string index_hint = region && has_tile_index ? " INDEXED BY log_tile_index" : "";
+    const auto direction = dest_id > from_id ? FORWARD : BACKWARD;
+    const std::string sql = direction == FORWARD ?
+        std::format("SELECT date,hash,x,y,color_index,action "
+                    "FROM log{} WHERE {}id > {} and id <= {} ORDER BY id;",
+                    index_hint, region ? RegionCondition("log", *region) : "", from_id, dest_id) :
+        std::format("SELECT prev_log.date,prev_log.hash,cur_log.x,cur_log.y,prev_log.color_index,prev_log.action,cur_log.prev_id "
+                    "FROM log cur_log{} LEFT JOIN log prev_log ON cur_log.prev_id = prev_log.id "
+                    "WHERE {}cur_log.id > {} and cur_log.id <= {} ORDER BY cur_log.id DESC;",
+                    index_hint, region ? RegionCondition("cur_log", *region) : "", dest_id, from_id);
+    sqlite3_stmt *sql_stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), sql.length() + 1, &sql_stmt, nullptr) != SQLITE_OK) return false;
+    // columns of the previous record are null when querying backwards to a virgin pixel
+    const auto ColumnText = [](sqlite3_stmt *stmt, const int column) -> std::optional<std::string> {
+        if (sqlite3_column_type(stmt, column) == SQLITE_NULL) return std::nullopt;
+        return reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+    };
+    int step_result;
+    while ((step_result = sqlite3_step(sql_stmt)) == SQLITE_ROW) {
+        const auto x = static_cast<unsigned>(sqlite3_column_int64(sql_stmt, 2));
+        const auto y = static_cast<unsigned>(sqlite3_column_int64(sql_stmt, 3));
+        // the previous record lies in an earlier shard, look it up there
+        if (direction == BACKWARD && sqlite3_column_type(sql_stmt, 0) == SQLITE_NULL &&
+            sqlite3_column_type(sql_stmt, 6) != SQLITE_NULL && !shards.empty()) {
+            const auto prev_id = static_cast<unsigned long>(sqlite3_column_int64(sql_stmt, 6));
+            const auto prev_shard = ShardOf(prev_id);
+            if (!ShardDB(prev_shard)) break;
+            sqlite3_stmt *record_stmt = shards[prev_shard].record_stmt;
+            sqlite3_bind_int64(record_stmt, 1, static_cast<sqlite3_int64>(prev_id));
+            if (sqlite3_step(record_stmt) != SQLITE_ROW) {
+                sqlite3_reset(record_stmt);
+                break;
+            }
+            long long time;
+            callback(
+                PxlsLogColumns::ReadTimeColumn(record_stmt, 0, time) ? std::make_optional(time) : std::nullopt,
+                ColumnText(record_stmt, 1), x, y,
+                static_cast<unsigned>(sqlite3_column_int64(record_stmt, 2)),
+                ColumnText(record_stmt, 3),
+                direction
             );
-            return 0;
-        }, &callback, nullptr) != SQLITE_OK)
-            return false;
+            sqlite3_reset(record_stmt);
+            continue;
+        }
+        long long time;
+        callback(
+            PxlsLogColumns::ReadTimeColumn(sql_stmt, 0, time) ? std::make_optional(time) : std::nullopt,
+            ColumnText(sql_stmt, 1), x, y,
+            sqlite3_column_type(sql_stmt, 4) == SQLITE_NULL ?
+                std::nullopt : std::make_optional(static_cast<unsigned>(sqlite3_column_int64(sql_stmt, 4))),
+            ColumnText(sql_stmt, 5),
+            direction
+        );
     }
+    sqlite3_finalize(sql_stmt);
+    return step_result == SQLITE_DONE;
+}
+
+bool PxlsLogDB::QueryRecordBatches(const unsigned long dest_id, const RecordBatchQueryCallback &callback) {
+    // records appended after building the sidecar are only available in sqlite
+    if (!log_db || !log_columns.IsOpen() || dest_id > log_columns.RecordCount() || current_id > log_columns.RecordCount())
+        return false;
+    PxlsProfileScope profile_scope(PxlsProfiler::QUERY_RECORDS);
+    if (!log_columns.QueryBatches(current_id, dest_id, callback)) return false;
     current_id = dest_id;
     return true;
 }
 
+bool PxlsLogDB::QueryFilterBitmap(const PxlsActionFilter &filter, PxlsRecordBitmap &selected) const {
+    if (!log_db || !log_columns.IsOpen() || log_columns.RecordCount() != db_record_count) return false;
+    selected.Clear();
+    for (std::uint32_t action_id = 0; action_id < log_columns.ActionCount(); action_id++) {
+        if (filter.Selects(log_columns.ActionName(action_id)))
+            selected.Union(log_columns.ActionBitmap(action_id));
+    }
+    return true;
+}
+
+bool PxlsLogDB::QueryFilteredBatches(const unsigned long dest_id, const PxlsRecordBitmap &selected, const RecordBatchQueryCallback &callback) {
+    if (!log_db || !log_columns.IsOpen() || dest_id > log_columns.RecordCount() || current_id > log_columns.RecordCount())
+        return false;
+    PxlsProfileScope profile_scope(PxlsProfiler::QUERY_RECORDS);
+    if (!log_columns.QueryFilteredBatches(current_id, dest_id, selected, callback)) return false;
+    current_id = dest_id;
+    return true;
+}
+
+bool PxlsLogDB::QueryPixelRecord(const unsigned x, const unsigned y, const unsigned long id_limit, const RecordQueryCallback &callback) const {
+    if (!log_db || id_limit == 0) return false;
+    std::optional<unsigned long> record_id { std::nullopt };
+    sqlite3_stmt *sql_stmt;
+    // walk the shards back from the one holding id_limit, the tile index finds the last record of the pixel in each
+    for (auto index = shards.empty() ? 0 : ShardOf(std::min(id_limit, db_record_count)) + 1; index-- > 0;) {
+        sqlite3 *shard_db = ShardDB(index);
+        if (!shard_db) return false;
+        const std::string sql = std::format("SELECT date,hash,color_index,action FROM log INDEXED BY log_tile_index "
+                                            "WHERE tile_id = {} AND x = {} AND y = {} AND id <= {} ORDER BY id DESC LIMIT 1;",
+                                            TileId(x, y), x, y, id_limit);
+        if (sqlite3_prepare_v2(shard_db, sql.c_str(), sql.length() + 1, &sql_stmt, nullptr) != SQLITE_OK) return false;
+        const bool found = sqlite3_step(sql_stmt) == SQLITE_ROW;
+        if (found) {
+            long long time;
+            callback(PxlsLogColumns::ReadTimeColumn(sql_stmt, 0, time) ? std::make_optional(time) : std::nullopt,
+                std::string { reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, 1)) }, x, y,
+                static_cast<unsigned>(sqlite3_column_int64(sql_stmt, 2)),
+                std::string { reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, 3)) }, FORWARD);
+        }
+        sqlite3_finalize(sql_stmt);
+        if (found) return true;
+    }
+    if (!shards.empty()) return false;
+    if (has_pixel_head) {
+        // start from the last record of the pixel, then walk back along the prev_id chain
+        sqlite3_prepare_v2(log_db, "SELECT last_id FROM pixel_head WHERE x = ? AND y = ?;", -1, &sql_stmt, nullptr);
+        sqlite3_bind_int64(sql_stmt, 1, x);
+        sqlite3_bind_int64(sql_stmt, 2, y);
+        if (sqlite3_step(sql_stmt) == SQLITE_ROW)
+            record_id = sqlite3_column_int64(sql_stmt, 0);
+        sqlite3_finalize(sql_stmt);
+        // the pixel has never been placed
+        if (!record_id) return false;
+    } else {
+        // find the record directly, the tile index narrows it down to the records of a tile
+        const std::string sql = std::format("SELECT id FROM log{} WHERE {}x = {} AND y = {} AND id <= {} ORDER BY id DESC LIMIT 1;",
+                                            has_tile_index ? " INDEXED BY log_tile_index" : "",
+                                            has_tile_index ? std::format("tile_id = {} AND ", TileId(x, y)) : "", x, y, id_limit);
+        sqlite3_prepare_v2(log_db, sql.c_str(), sql.length() + 1, &sql_stmt, nullptr);
+        if (sqlite3_step(sql_stmt) == SQLITE_ROW)
+            record_id = sqlite3_column_int64(sql_stmt, 0);
+        sqlite3_finalize(sql_stmt);
+        if (!record_id) return false;
+    }
+    sqlite3_prepare_v2(log_db, "SELECT date,hash,color_index,action,prev_id FROM log WHERE id = ?;", -1, &sql_stmt, nullptr);
+    const auto ColumnText = [&](const int column) -> std::optional<std::string> {
+        if (sqlite3_column_type(sql_stmt, column) == SQLITE_NULL) return std::nullopt;
+        return reinterpret_cast<const char*>(sqlite3_column_text(sql_stmt, column));
+    };
+    bool result = false;
+    while (record_id) {
+        sqlite3_bind_int64(sql_stmt, 1, static_cast<sqlite3_int64>(*record_id));
+        if (sqlite3_step(sql_stmt) != SQLITE_ROW) break;
+        if (*record_id <= id_limit) {
+            long long time;
+            callback(PxlsLogColumns::ReadTimeColumn(sql_stmt, 0, time) ? std::make_optional(time) : std::nullopt,
+                ColumnText(1), x, y,
+                static_cast<unsigned>(sqlite3_column_int64(sql_stmt, 2)), ColumnText(3), FORWARD);
+            result = true;
+            break;
+        }
+        record_id = sqlite3_column_type(sql_stmt, 4) == SQLITE_NULL ?
+            std::nullopt : std::make_optional<unsigned long>(sqlite3_column_int64(sql_stmt, 4));
+        sqlite3_reset(sql_stmt);
+    }
+    sqlite3_finalize(sql_stmt);
+    return result;
+}
+
+bool PxlsLogDB::QueryRecordTime(const unsigned long id, long long &time) const {
+    if (!log_db || id == 0 || id > db_record_count) return false;
+    if (id <= log_columns.RecordCount()) {
+        time = log_columns.Time(id);
+        return true;
+    }
+    sqlite3 *db = shards.empty() ? log_db : ShardDB(ShardOf(id));
+    if (!db) return false;
+    const std::string sql = std::format("SELECT date FROM log WHERE id = {};", id);
+    sqlite3_stmt *sql_stmt;
+    sqlite3_prepare_v2(db, sql.c_str(), sql.length() + 1, &sql_stmt, nullptr);
+    bool result = false;
+    if (sqlite3_step(sql_stmt) == SQLITE_ROW)
+        result = PxlsLogColumns::ReadTimeColumn(sql_stmt, 0, time);
+    sqlite3_finalize(sql_stmt);
+    return result;
+}
+
+unsigned long PxlsLogDB::FindRecordByTime(const long long time) const {
+    // binary search for the last record not later than time
+    unsigned long low = 0, high = db_record_count;
+    while (low < high) {
+        const auto mid = low + (high - low + 1) / 2;
+        long long mid_time;
+        if (QueryRecordTime(mid, mid_time) && mid_time <= time)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
+bool PxlsLogDB::QueryColorPopulation(const unsigned long id, std::vector<unsigned long> &population) const {
+    return log_db && id <= stats_id && PxlsLogStats::QueryColorPopulation(log_db, id, population);
+}
+
+bool PxlsLogDB::QueryUserPlacementCount(const std::string &hash, const unsigned long from_id, const unsigned long to_id,
+                                        unsigned long &count) const {
+    return log_db && to_id <= stats_id && PxlsLogStats::QueryUserPlacementCount(log_db, hash, from_id, to_id, count);
+}
+
 bool PxlsLogDB::QuerySnapshotIdList(std::vector<unsigned long> &id_list) const {
     if (!log_db) return false;
     std::vector<unsigned long> ids;
+    // the snapshots of shards are listed by the manifest
+    if (!shards.empty()) {
+        for (const auto &shard: shards)
+            ids.insert(ids.end(), shard.snapshot_ids.begin(), shard.snapshot_ids.end());
+        id_list = ids;
+        return true;
+    }
+    // read the summary to avoid touching the snapshot table
+    if (const auto snapshot_ids = ReadMeta(log_db, "snapshot_ids")) {
+        std::vector<std::string> id_strs;
+        if (!snapshot_ids->empty())
+            boost::split(id_strs, *snapshot_ids, boost::is_any_of(","));
+        try {
+            for (const auto &id_str: id_strs)
+                ids.push_back(std::stoul(id_str));
+            id_list = ids;
+            return true;
+        } catch (std::logic_error&) {
+            ids.clear();
+        }
+    }
     const std::string sql = "SELECT id FROM canvas_snapshot;";
     if (sqlite3_exec(log_db, sql.c_str(), [](void* ids_ptr, int, char **argv, char**) -> int {
         static_cast<std::vector<unsigned long> *>(ids_ptr)->push_back(std::stoul(argv[0]));
@@ -221,25 +1508,30 @@ bool PxlsLogDB::QuerySnapshotIdList(std::vector<unsigned long> &id_list) const {
 }
 
 bool PxlsLogDB::QuerySnapshot(unsigned long id, const SnapshotQueryCallback &callback) const {
-    if (!log_db) return false;
-    const std::string sql = std::format("SELECT snapshot FROM canvas_snapshot WHERE id = {};", id);
-    sqlite3_stmt *sql_stmt;
-    sqlite3_prepare_v2(log_db, sql.c_str(), sql.length() + 1, &sql_stmt, nullptr);
-    if (sqlite3_step(sql_stmt) != SQLITE_ROW) {
-        sqlite3_finalize(sql_stmt);
+    if (!log_db || (!shards.empty() && (id == 0 || id > db_record_count))) return false;
+    sqlite3 *db = shards.empty() ? log_db : ShardDB(ShardOf(id));
+    if (!db) return false;
+    // id is the rowid of canvas_snapshot, so the blob can be opened directly
+    sqlite3_blob *snapshot_blob;
+    if (sqlite3_blob_open(db, "main", "canvas_snapshot", "snapshot", static_cast<sqlite3_int64>(id), 0, &snapshot_blob) != SQLITE_OK)
         return false;
-    }
-    const void *snapshot_blob = sqlite3_column_blob(sql_stmt, 0);
-    callback(snapshot_blob);
-    sqlite3_finalize(sql_stmt);
-    return true;
+    const std::size_t snapshot_bytes = sqlite3_blob_bytes(snapshot_blob);
+    const bool result = callback(snapshot_bytes, [&](const std::size_t offset, void *buffer, const std::size_t bytes) {
+        return offset <= snapshot_bytes && bytes <= snapshot_bytes - offset &&
+            sqlite3_blob_read(snapshot_blob, buffer, static_cast<int>(bytes), static_cast<int>(offset)) == SQLITE_OK;
+    });
+    sqlite3_blob_close(snapshot_blob);
+    return result;
 }
 
 bool PxlsLogDB::CreateSnapshot(unsigned long id, const void *snapshot_blob, const int snapshot_bytes) const {
-    if (!log_db) return false;
+    if (!log_db || (!shards.empty() && (id == 0 || id > db_record_count || read_only))) return false;
+    // snapshots of a sharded logdb are stored in the shard holding their id
+    sqlite3 *db = shards.empty() ? log_db : ShardDB(ShardOf(id));
+    if (!db) return false;
     const std::string sql = std::format("INSERT INTO canvas_snapshot(id,snapshot) VALUES ({},:sp);", id);
     sqlite3_stmt *sql_stmt;
-    sqlite3_prepare_v2(log_db, sql.c_str(), -1, &sql_stmt, nullptr);
+    sqlite3_prepare_v2(db, sql.c_str(), -1, &sql_stmt, nullptr);
     // bind snapshot blob
     if (sqlite3_bind_blob(sql_stmt, sqlite3_bind_parameter_index(sql_stmt, ":sp"), snapshot_blob, snapshot_bytes, SQLITE_STATIC) != SQLITE_OK ||
         sqlite3_step(sql_stmt) != SQLITE_DONE) {
@@ -247,6 +1539,31 @@ bool PxlsLogDB::CreateSnapshot(unsigned long id, const void *snapshot_blob, cons
         return false;
     }
     sqlite3_finalize(sql_stmt);
+    if (!WriteSnapshotSummary(db)) return false;
+    if (shards.empty()) return true;
+    auto &snapshot_ids = shards[ShardOf(id)].snapshot_ids;
+    snapshot_ids.insert(std::ranges::upper_bound(snapshot_ids, id), id);
+    return WriteManifest();
+}
+
+bool PxlsLogDB::QueryCacheStats(int &hit, int &miss) const {
+    if (!log_db) return false;
+    int highwater;
+    if (shards.empty())
+        return sqlite3_db_status(log_db, SQLITE_DBSTATUS_CACHE_HIT, &hit, &highwater, 0) == SQLITE_OK &&
+            sqlite3_db_status(log_db, SQLITE_DBSTATUS_CACHE_MISS, &miss, &highwater, 0) == SQLITE_OK;
+    // sum up the shards opened so far
+    hit = miss = 0;
+    std::lock_guard lock(shard_mutex);
+    for (const auto &shard: shards) {
+        int shard_hit, shard_miss;
+        if (!shard.db) continue;
+        if (sqlite3_db_status(shard.db, SQLITE_DBSTATUS_CACHE_HIT, &shard_hit, &highwater, 0) != SQLITE_OK ||
+            sqlite3_db_status(shard.db, SQLITE_DBSTATUS_CACHE_MISS, &shard_miss, &highwater, 0) != SQLITE_OK)
+            return false;
+        hit += shard_hit;
+        miss += shard_miss;
+    }
     return true;
 }
 
@@ -13,51 +13,282 @@
 #include <map>
 #include <utility>
 #include <optional>
+#include <string_view>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <mutex>
+#include <future>
+#include <thread>
+#include <cstdint>
 #include <sqlite3.h>
 #include <boost/algorithm/string.hpp>
+#include "PxlsLogColumns.h"
+#include "PxlsLogStats.h"
+#include "PxlsProfiler.h"
 
-enum QueryDirection { FORWARD, BACKWARD };
-using RecordQueryCallback = std::function<void (std::optional<std::string> date, std::optional<std::string> hash,
+// rectangular region of the canvas, used for limiting queries and rendering to a region of interest
+struct PxlsRegion {
+    unsigned x { 0 }, y { 0 }, width { 0 }, height { 0 };
+    [[nodiscard]] bool Contains(const unsigned px, const unsigned py) const {
+        return px >= x && py >= y && px - x < width && py - y < height;
+    }
+};
+// selects records by action type, used for playing back a part of the actions
+struct PxlsActionFilter {
+    std::vector<std::string> actions;
+    // whether only the records of the actions are selected, otherwise they are filtered out
+    bool only { false };
+    [[nodiscard]] bool Selects(const std::string_view action) const {
+        return (std::ranges::find(actions, action) != actions.end()) == only;
+    }
+};
+// metadata of logdb published for the gui thread, which reads it while workers convert, reopen or follow the logdb
+struct PxlsLogDBInfo {
+    bool open { false };
+    unsigned width { 0 }, height { 0 };
+    unsigned long record_count { 0 };
+    // records covered by the columnar sidecar, 0 if it is not mapped
+    unsigned long columns_record_count { 0 };
+    bool has_columns { false }, has_stats { false }, can_tail { false };
+};
+// time is the epoch time in milliseconds
+using RecordQueryCallback = std::function<void (std::optional<long long> time, std::optional<std::string> hash,
         unsigned x, unsigned y, std::optional<unsigned> color_index, std::optional<std::string> action, QueryDirection direction)>;
-using SnapshotQueryCallback = std::function<void (const void* snapshot_blob)>;
+// read bytes of a snapshot starting from offset into buffer, return false if it fails
+using SnapshotReadCallback = std::function<bool (std::size_t offset, void *buffer, std::size_t bytes)>;
+// receives the size of a snapshot and reads it in chunks, reading is only valid inside the callback
+using SnapshotQueryCallback = std::function<bool (std::size_t snapshot_bytes, const SnapshotReadCallback &read)>;
+// receives the records in order while converting pxls log, time is the epoch time in milliseconds
+using IngestCallback = std::function<void (long long time, std::string_view hash, unsigned x, unsigned y,
+        unsigned color_index, std::string_view action)>;
+// dumps the snapshot of the records received so far, return false if it can't be created
+using SnapshotDumpCallback = std::function<bool (std::vector<char> &snapshot_blob)>;
 
 class PxlsLogDB {
 public:
-    // open pxls log and convert it to logdb
-    bool OpenLogRaw(const std::string &filename);
-    // open existing logdb
-    bool OpenLogDB(const std::string &filename);
+    // open pxls log and convert it to logdb. the conversion is checkpointed, so reopening the same pxls log continues
+    // from the last checkpoint, and malformed lines are put into the quarantine table instead of aborting it.
+    // if callbacks are specified, the records are passed to ingest_callback and snapshots are created in the same pass
+    // when the conversion reaches the snapshot proportions. when resuming, the records converted before the checkpoint
+    // are passed from the logdb first, unless only snapshots that are already created would need them.
+    // pxls logs larger than the shard size are converted to a sharded logdb instead, see OpenLogRawSharded
+    bool OpenLogRaw(const std::string &filename, const IngestCallback &ingest_callback = nullptr,
+                    const SnapshotDumpCallback &snapshot_callback = nullptr);
+    // set the positions to create snapshots at when converting pxls log, which are proportions of the pxls log in bytes
+    void SnapshotProportions(std::vector<float> proportions);
+    [[nodiscard]] const auto& SnapshotProportions() const { return snapshot_proportions; }
+    // set the bytes of pxls log converted to each shard, larger pxls logs are split into shards. 0 disables sharding
+    void ShardBytes(const unsigned long long bytes) { shard_bytes = bytes; }
+    // open existing logdb readonly, which is reopened for writing in wal mode once it follows its source pxls log or
+    // its metadata written by older versions is migrated. open_read_only forbids writing it at all, which is used by
+    // connections other than the one following the log.
+    // a manifest with the extension .logdbm opens a sharded logdb, whose shards are opened when they are first queried
+    bool OpenLogDB(const std::string &filename, bool open_read_only = false);
+    // append the records written to the source pxls log since the last ingestion, store the number of them in appended_count
+    bool TailLogRaw(unsigned long &appended_count);
+    // can the logdb follow its source pxls log. the columnar sidecar is packed and can't be extended with the appended
+    // records, so the logdb can't follow the log once the sidecar is mapped
+    bool CanTail() const;
+    // reread the metadata and the statistics coverage, used by readonly connections to see the records appended by the
+    // writer. the columnar sidecar is kept, since records are only appended and it still covers a prefix of them
+    bool RefreshMetadata();
     // close logdb
     void CloseLogDB();
+    // get the metadata published when the logdb is opened, closed or appended to, which is safe to call from any thread
+    PxlsLogDBInfo Info() const;
     // methods for getting logdb metadata
     unsigned Width() const { return db_width; }
     unsigned Height() const { return db_height; }
     unsigned long RecordCount() const { return db_record_count; }
+    // date of the first and the last record
+    const std::string& StartTime() const { return db_start_time; }
+    const std::string& EndTime() const { return db_end_time; }
+    // schema version, logdb created by older versions without the meta table is regarded as version 1
+    unsigned SchemaVersion() const { return db_schema_version; }
+    // hash of the palette used when creating snapshots
+    std::optional<std::uint64_t> PaletteHash() const;
+    // write the palette hash, which requires the logdb to be converted or followed by this connection
+    bool PaletteHash(std::uint64_t palette_hash) const;
     // query records, from current_id to dest_id. when querying backwards, it queries the record with prev_id instead
-    bool QueryRecords(unsigned long dest_id, RecordQueryCallback callback);
-    // query snapshot id list
+    // if region is specified, only the records inside the region are queried, which requires the tile index to be fast
+    bool QueryRecords(unsigned long dest_id, RecordQueryCallback callback, const std::optional<PxlsRegion> &region = std::nullopt);
+    // query records in packed batches using the columnar sidecar, return false without doing anything if it is unavailable
+    bool QueryRecordBatches(unsigned long dest_id, const RecordBatchQueryCallback &callback);
+    // get the ids of the records selected by the filter from the action bitmaps of the columnar sidecar,
+    // return false if it is unavailable or doesn't cover all records
+    bool QueryFilterBitmap(const PxlsActionFilter &filter, PxlsRecordBitmap &selected) const;
+    // query the records selected by the bitmap in packed batches using the columnar sidecar, the others are skipped.
+    // when querying backwards, it queries the last selected record before each record instead
+    bool QueryFilteredBatches(unsigned long dest_id, const PxlsRecordBitmap &selected, const RecordBatchQueryCallback &callback);
+    // query the last record placed on a pixel whose id is not greater than id_limit, return false if there is none
+    bool QueryPixelRecord(unsigned x, unsigned y, unsigned long id_limit, const RecordQueryCallback &callback) const;
+    // query the epoch time in milliseconds of a record, using the columnar sidecar if possible
+    bool QueryRecordTime(unsigned long id, long long &time) const;
+    // find the last record not later than the epoch time in milliseconds, assuming records are in chronological order.
+    // return 0 if there is no such record
+    unsigned long FindRecordByTime(long long time) const;
+    // does logdb have statistics of colors and users, which are built when converting pxls log and extended when following it
+    bool HasStats() const { return stats_id != 0; }
+    // query the number of pixels of each color after applying the records up to id, indexed by color index.
+    // virgin pixels are not counted
+    bool QueryColorPopulation(unsigned long id, std::vector<unsigned long> &population) const;
+    // query the number of records placed by a user with id in (from_id, to_id]
+    bool QueryUserPlacementCount(const std::string &hash, unsigned long from_id, unsigned long to_id, unsigned long &count) const;
+    // query snapshot id list, which is read from the snapshot summary in the meta table if possible
     bool QuerySnapshotIdList(std::vector<unsigned long> &id_list) const;
-    // query a specified snapshot
+    // query a specified snapshot, which is read incrementally instead of being loaded into memory as a whole.
+    // return false if the snapshot doesn't exist, otherwise return the result of the callback
     bool QuerySnapshot(unsigned long id, const SnapshotQueryCallback &callback) const;
-    // create a new snapshot
+    // create a new snapshot, which requires the logdb to be converted or followed by this connection unless it is sharded
     bool CreateSnapshot(unsigned long id, const void *snapshot_blob, int snapshot_bytes) const;
+    // query sqlite page cache hits and misses since the logdb is opened
+    bool QueryCacheStats(int &hit, int &miss) const;
     // adjust current id pointer
     bool Seek(unsigned long id);
     // get current id pointer
     unsigned long Seek() const { return current_id; }
     // is logdb open
     bool IsOpen() const { return log_db; }
+    // path of the open logdb, or the manifest of a sharded logdb
+    const std::string& Filename() const { return db_filename; }
+    // is logdb split into shards by record id
+    bool IsSharded() const { return !shards.empty(); }
+    // number of shards, and the ones opened so far
+    std::size_t ShardCount() const { return shards.size(); }
+    std::size_t OpenShardCount() const;
+    // is the columnar sidecar mapped
+    bool HasColumns() const { return log_columns.IsOpen(); }
+    // get readonly access to the columnar sidecar
+    const PxlsLogColumns& Columns() const { return log_columns; }
+    // enable/disable writing the columnar sidecar when converting pxls log
+    void WriteColumns(const bool enable) { write_columns = enable; }
+    // enable/disable converting pxls log for following it, which leaves an unterminated last line to the tail since it
+    // may still be being written, and doesn't write the columnar sidecar. otherwise the last line is converted like the others
+    void FollowSource(const bool enable) { follow_source = enable; }
+    // does logdb have the tile index for region queries
+    bool HasTileIndex() const { return has_tile_index; }
+    // calc the tile id of a pixel
+    static unsigned TileId(const unsigned x, const unsigned y) { return (y / TILE_SIZE) << 16 | (x / TILE_SIZE); }
+    // the width and height of a tile used by the tile index
+    static constexpr unsigned TILE_SIZE { 32 };
+    // hash bytes with 64-bit FNV-1a, which can be continued from a previous hash
+    static std::uint64_t HashBytes(const char *data, std::size_t size, std::uint64_t hash = PREFIX_HASH_SEED);
+    // initial value of FNV-1a hash
+    static constexpr std::uint64_t PREFIX_HASH_SEED { 0xcbf29ce484222325ull };
+    // current schema version of logdb
+    static constexpr unsigned SCHEMA_VERSION { 3 };
+    // default bytes of pxls log converted to each shard, about 25 million records
+    static constexpr unsigned long long DEFAULT_SHARD_BYTES { 2ull << 30 };
     ~PxlsLogDB();
 private:
+    // a logdb file holding the records with ids in [first_id, last_id], prev_id of its records may point to earlier shards
+    struct Shard {
+        std::string filename;
+        unsigned long first_id { 0 }, last_id { 0 };
+        // snapshots stored in the shard, listed by the manifest so that shards aren't opened for listing them
+        std::vector<unsigned long> snapshot_ids;
+        sqlite3 *db = nullptr;
+        // look up a record by id, used for resolving prev_id pointing into this shard
+        sqlite3_stmt *record_stmt = nullptr;
+    };
+    // read metadata from the meta table, or scan the log table if the logdb is created by older versions
     bool QueryLogDBMetadata();
+    // scan the log table for metadata, which is a full table scan
+    bool ScanLogDBMetadata();
+    // reopen the connection of an unsharded logdb for writing, return false if it mustn't or can't be written
+    bool ReopenForWriting();
+    // write metadata to the meta table, creating it if necessary
+    bool WriteLogDBMetadata() const;
+    // publish the current metadata for Info
+    void PublishInfo();
+    // write snapshot summary according to the snapshot table
+    static bool WriteSnapshotSummary(sqlite3 *db);
+    // split and validate a line of pxls log, the date in record is converted to sqlite compatible format and parsed to
+    // epoch time in milliseconds
+    static bool ParseRecord(const std::string &record_line, std::vector<std::string> &record, unsigned &x, unsigned &y,
+                            long long &time);
+    // open the logdb converted before and restore the state at its last checkpoint if it matches the pxls log
+    static bool ResumeLogRaw(const std::string &db_path, std::istream &file, sqlite3 *&resumed_log_db,
+                             std::map<std::pair<unsigned, unsigned>, unsigned long> &prev_id_map,
+                             unsigned long &record_id, unsigned long long &ingested_offset, std::uint64_t &prefix_hash);
+    // read/write the key-value meta table
+    static std::optional<std::string> ReadMeta(sqlite3 *db, const std::string &key);
+    static bool ReadMetaTable(sqlite3 *db, std::map<std::string, std::string> &meta);
+    static bool WriteMeta(sqlite3 *db, const std::string &key, const std::string &value);
+    // map the columnar sidecar if it matches the logdb
+    bool OpenColumns(const std::string &filename);
+    // convert pxls log to shards of about shard_bytes each. the log is scanned once for the byte range and the first
+    // record id of each shard, which are built in parallel meanwhile, then the shards are linked in order
+    bool OpenLogRawSharded(const std::string &filename, const IngestCallback &ingest_callback,
+                           const SnapshotDumpCallback &snapshot_callback);
+    // snapshots of a shard being built, keyed by the id of the last record they contain
+    using ShardSnapshots = std::vector<std::pair<unsigned long, std::vector<char>>>;
+    // convert the lines of pxls log in [begin_offset, end_offset) to a shard, whose records are numbered from first_id
+    bool BuildShard(const std::string &log_path, const std::string &shard_path, unsigned long long begin_offset,
+                    unsigned long long end_offset, unsigned long first_id, unsigned long last_id,
+                    const ShardSnapshots &snapshots) const;
+    // link the first record of each pixel in a shard to the last one of the shards before it, head_map holds the last
+    // record ids of the pixels in those shards and is updated with the ones of this shard
+    static bool LinkShard(const std::string &shard_path, std::map<std::pair<unsigned, unsigned>, unsigned long> &head_map);
+    // read/write the manifest of a sharded logdb
+    bool OpenManifest(const std::string &filename, bool open_read_only);
+    bool WriteManifest() const;
+    // get the connection to a shard, opening it on first use. return nullptr if it can't be opened
+    sqlite3* ShardDB(std::size_t index) const;
+    // get the index of the shard holding a record id
+    std::size_t ShardOf(unsigned long id) const;
+    // query the records in (from_id, dest_id] or (dest_id, from_id] of a logdb or a shard
+    bool QueryRecordRange(sqlite3 *db, unsigned long from_id, unsigned long dest_id, const RecordQueryCallback &callback,
+                          const std::optional<PxlsRegion> &region) const;
+    // build sql condition that limits records to the region, using the tile index if possible
+    std::string RegionCondition(const std::string &table, const PxlsRegion &region) const;
     sqlite3 *log_db = nullptr;
+    std::string db_filename;
     // maximum count of records inserted a time
     const unsigned short INSERT_RECORDS_MAX_COUNT = 150;
-    unsigned long current_id = 0;
+    // count of records committed between checkpoints
+    const unsigned long CHECKPOINT_RECORDS_COUNT = 100000;
+    // milliseconds to wait for the lock held by other connections
+    const int BUSY_TIMEOUT_MS = 5000;
+    // read by the gui thread while replaying in the background
+    std::atomic<unsigned long> current_id = 0;
     // dimension based on maximum x coordinate and y coordinate
     unsigned db_width { 0 }, db_height { 0 };
     // record count
     unsigned long db_record_count { 0 };
+    // date range of records
+    std::string db_start_time, db_end_time;
+    unsigned db_schema_version { SCHEMA_VERSION };
+    // columnar sidecar for fast playback
+    PxlsLogColumns log_columns;
+    bool write_columns { true };
+    bool follow_source { false };
+    // positions to create snapshots at when converting pxls log, in ascending order
+    std::vector<float> snapshot_proportions { 1.0f / 4.0f, 1.0f / 2.0f, 3.0f / 4.0f, 1.0f };
+    // the last record id covered by statistics, 0 if there are none
+    unsigned long stats_id { 0 };
+    // bytes of pxls log converted to each shard, 0 disables sharding
+    unsigned long long shard_bytes { DEFAULT_SHARD_BYTES };
+    // shards of a sharded logdb ordered by record id, which are opened lazily by const queries as well.
+    // log_db is the first shard, which holds the metadata shared by all shards such as the palette hash
+    mutable std::vector<Shard> shards;
+    mutable std::mutex shard_mutex;
+    // whether log table has tile_id column and its index
+    bool has_tile_index { false };
+    // source pxls log and the byte offset ingested so far, used for following the log
+    std::string source_filename;
+    unsigned long long source_offset { 0 };
+    std::uint64_t source_prefix_hash { PREFIX_HASH_SEED };
+    // whether logdb has the tables required for following the log
+    bool has_pixel_head { false };
+    // logdb mustn't be written, either opened readonly or write protected
+    bool read_only { false };
+    // the connection is opened for writing, which is only done when the logdb has to be written
+    bool writable { false };
+    // metadata published for other threads
+    PxlsLogDBInfo info;
+    mutable std::mutex info_mutex;
 };
 
 #endif //PXLSLOGDB_H
@@ -0,0 +1,70 @@
+//
+// PxlsLogDBService implementation
+//
+
+#include "PxlsLogDBService.h"
+
+PxlsLogDBService::PxlsLogDBService() : worker(&PxlsLogDBService::Work, this) {}
+
+PxlsLogDBService::~PxlsLogDBService() {
+    {
+        std::lock_guard lock(mutex);
+        stop_flag = true;
+    }
+    cv.notify_all();
+    worker.join();
+}
+
+std::future<bool> PxlsLogDBService::Open(const std::string &filename) {
+    return Submit([filename](PxlsLogDB &db) { return db.OpenLogDB(filename, true); });
+}
+
+std::future<void> PxlsLogDBService::Close() {
+    return Submit([](PxlsLogDB &db) { db.CloseLogDB(); });
+}
+
+std::future<bool> PxlsLogDBService::Refresh() {
+    return Submit([](PxlsLogDB &db) { return db.IsOpen() && db.RefreshMetadata(); });
+}
+
+std::future<std::optional<PxlsLogRecord>> PxlsLogDBService::QueryPixelRecord(const unsigned x, const unsigned y, const unsigned long id_limit) {
+    return Submit([x, y, id_limit](const PxlsLogDB &db) -> std::optional<PxlsLogRecord> {
+        std::optional<PxlsLogRecord> record { std::nullopt };
+        db.QueryPixelRecord(x, y, id_limit, [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+            const unsigned record_x, const unsigned record_y, const std::optional<unsigned> color_index,
+            const std::optional<std::string> &action, QueryDirection) {
+            record = PxlsLogRecord { time, hash, record_x, record_y, color_index, action };
+        });
+        return record;
+    });
+}
+
+std::future<std::optional<std::vector<unsigned long>>> PxlsLogDBService::QueryColorPopulation(const unsigned long id) {
+    return Submit([id](const PxlsLogDB &db) -> std::optional<std::vector<unsigned long>> {
+        if (std::vector<unsigned long> population; db.QueryColorPopulation(id, population)) return population;
+        return std::nullopt;
+    });
+}
+
+std::future<std::optional<unsigned long>> PxlsLogDBService::QueryUserPlacementCount(const std::string &hash, const unsigned long from_id,
+                                                                                    const unsigned long to_id) {
+    return Submit([hash, from_id, to_id](const PxlsLogDB &db) -> std::optional<unsigned long> {
+        if (unsigned long count; db.QueryUserPlacementCount(hash, from_id, to_id, count)) return count;
+        return std::nullopt;
+    });
+}
+
+void PxlsLogDBService::Work() {
+    while (true) {
+        std::function<void (PxlsLogDB&)> request;
+        {
+            std::unique_lock lock(mutex);
+            cv.wait(lock, [&] { return stop_flag || !requests.empty(); });
+            if (requests.empty()) break;
+            request = std::move(requests.front());
+            requests.pop_front();
+        }
+        request(reader);
+    }
+    reader.CloseLogDB();
+}
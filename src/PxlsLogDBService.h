@@ -0,0 +1,79 @@
+//
+// Provide a service thread that owns a read connection to the logdb and answers queries through futures
+//
+
+#ifndef PXLSLOGDBSERVICE_H
+#define PXLSLOGDBSERVICE_H
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <functional>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include "PxlsLogDB.h"
+
+// a record returned by value, used when the query result leaves the service thread
+struct PxlsLogRecord {
+    // epoch time in milliseconds
+    std::optional<long long> time { std::nullopt };
+    std::optional<std::string> hash { std::nullopt };
+    unsigned x { 0 }, y { 0 };
+    std::optional<unsigned> color_index { std::nullopt };
+    std::optional<std::string> action { std::nullopt };
+};
+
+class PxlsLogDBService {
+public:
+    PxlsLogDBService();
+    PxlsLogDBService(const PxlsLogDBService&) = delete;
+    PxlsLogDBService& operator=(const PxlsLogDBService&) = delete;
+    ~PxlsLogDBService();
+    // open a readonly connection to the logdb, which is converted to wal mode by the writer so that reading doesn't
+    // wait for its transactions. requests are served in order, so the ones submitted afterward see the new logdb
+    std::future<bool> Open(const std::string &filename);
+    // close the read connection
+    std::future<void> Close();
+    // reread the metadata of the read connection to pick up the records appended by the writer
+    std::future<bool> Refresh();
+    // typed requests, which return nullopt if the logdb isn't open or the query fails
+    std::future<std::optional<PxlsLogRecord>> QueryPixelRecord(unsigned x, unsigned y, unsigned long id_limit);
+    std::future<std::optional<std::vector<unsigned long>>> QueryColorPopulation(unsigned long id);
+    std::future<std::optional<unsigned long>> QueryUserPlacementCount(const std::string &hash, unsigned long from_id, unsigned long to_id);
+    // submit a request running on the service thread with the readonly logdb
+    template <typename Request>
+    auto Submit(Request &&request) -> std::future<std::invoke_result_t<Request, PxlsLogDB&>> {
+        using Result = std::invoke_result_t<Request, PxlsLogDB&>;
+        auto task = std::make_shared<std::packaged_task<Result (PxlsLogDB&)>>(std::forward<Request>(request));
+        auto future = task->get_future();
+        {
+            std::lock_guard lock(mutex);
+            requests.emplace_back([task](PxlsLogDB &db) { (*task)(db); });
+        }
+        cv.notify_one();
+        return future;
+    }
+    // check if the result of a request is ready without blocking
+    template <typename Result>
+    [[nodiscard]] static bool IsReady(const std::future<Result> &future) {
+        return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+private:
+    // serve requests until stopped, the pending ones are served before exiting
+    void Work();
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop_flag { false };
+    std::deque<std::function<void (PxlsLogDB&)>> requests;
+    // only accessed by the service thread
+    PxlsLogDB reader;
+    // started after the members above are constructed
+    std::thread worker;
+};
+
+#endif //PXLSLOGDBSERVICE_H
@@ -0,0 +1,301 @@
+//
+// PxlsLogSource implementation
+//
+
+#include "PxlsLogSource.h"
+#include <algorithm>
+#include <zlib.h>
+#ifdef PXLS_WITH_ZSTD
+#include <zstd.h>
+#endif
+#include <boost/interprocess/file_mapping.hpp>
+namespace bip = boost::interprocess;
+
+namespace {
+    constexpr unsigned char GZIP_MAGIC[] { 0x1f, 0x8b };
+    constexpr unsigned char ZSTD_MAGIC[] { 0x28, 0xb5, 0x2f, 0xfd };
+
+    // bytes of a gzip member carrying its size in the extra field like bgzf, return 0 if it doesn't
+    std::size_t BgzfMemberBytes(const unsigned char *member, const std::size_t bytes) {
+        constexpr std::size_t header_bytes = 12;
+        // FEXTRA flag
+        if (bytes < header_bytes || member[0] != GZIP_MAGIC[0] || member[1] != GZIP_MAGIC[1] || !(member[3] & 0x04)) return 0;
+        const std::size_t extra_bytes = member[10] | member[11] << 8;
+        if (bytes < header_bytes + extra_bytes) return 0;
+        for (std::size_t i = header_bytes; i + 4 <= header_bytes + extra_bytes; ) {
+            const std::size_t field_bytes = member[i + 2] | member[i + 3] << 8;
+            if (member[i] == 'B' && member[i + 1] == 'C' && field_bytes == 2 && i + 6 <= header_bytes + extra_bytes) {
+                const std::size_t member_bytes = (member[i + 4] | member[i + 5] << 8) + 1;
+                return member_bytes <= bytes ? member_bytes : 0;
+            }
+            i += 4 + field_bytes;
+        }
+        return 0;
+    }
+}
+
+bool PxlsLogSource::Open(const std::string &filename, const unsigned thread_count) {
+    Close();
+    if (!std::filesystem::exists(filename) || std::filesystem::is_directory(filename)) return false;
+    source_filename = filename;
+    file_size = std::filesystem::file_size(filename);
+    compression = DetectCompression(filename);
+    if (compression == UNCOMPRESSED) {
+        file.open(filename, std::ios::binary);
+        return static_cast<bool>(file);
+    }
+    if (compression == ZSTD && !SupportsZstd()) return false;
+    try {
+        const bip::file_mapping mapping(filename.c_str(), bip::read_only);
+        region = std::make_unique<bip::mapped_region>(mapping, bip::read_only);
+    } catch (bip::interprocess_exception&) {
+        return false;
+    }
+    data = static_cast<const unsigned char*>(region->get_address());
+    const auto worker_count = std::max(thread_count != 0 ? thread_count : std::thread::hardware_concurrency(), 1u);
+    // the reader takes the first part while the others are decompressed ahead
+    max_parts = worker_count + 1;
+    stop_flag = false;
+    for (unsigned i = 0; i < worker_count; i++)
+        workers.emplace_back(&PxlsLogSource::Work, this);
+    return true;
+}
+
+bool PxlsLogSource::Rewind() {
+    if (compression == UNCOMPRESSED) {
+        file.clear();
+        file.seekg(0);
+        return static_cast<bool>(file);
+    }
+    const auto filename = source_filename;
+    return Open(filename, workers.size());
+}
+
+void PxlsLogSource::Close() {
+    {
+        std::lock_guard lock(mutex);
+        stop_flag = true;
+    }
+    cv.notify_all();
+    for (auto &worker: workers)
+        worker.join();
+    workers.clear();
+    parts.clear();
+    scan_offset = 0;
+    scan_done = false;
+    failed = false;
+    consumed_offset = 0;
+    region.reset();
+    data = nullptr;
+    file.close();
+    file.clear();
+    chunk_buffer.Reset();
+    decompressed_stream.clear();
+    compression = UNCOMPRESSED;
+    file_size = 0;
+}
+
+bool PxlsLogSource::Failed() {
+    std::lock_guard lock(mutex);
+    return failed;
+}
+
+bool PxlsLogSource::SupportsZstd() {
+#ifdef PXLS_WITH_ZSTD
+    return true;
+#else
+    return false;
+#endif
+}
+
+LogCompression PxlsLogSource::DetectCompression(const std::string &filename) {
+    std::ifstream file(filename, std::ios::binary);
+    unsigned char magic[sizeof(ZSTD_MAGIC)] {};
+    file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+    if (file.gcount() >= static_cast<std::streamsize>(sizeof(GZIP_MAGIC)) && std::equal(std::begin(GZIP_MAGIC), std::end(GZIP_MAGIC), magic))
+        return GZIP;
+    if (file.gcount() == static_cast<std::streamsize>(sizeof(ZSTD_MAGIC)) && std::equal(std::begin(ZSTD_MAGIC), std::end(ZSTD_MAGIC), magic))
+        return ZSTD;
+    return UNCOMPRESSED;
+}
+
+std::filesystem::path PxlsLogSource::StripCompressionExtension(const std::filesystem::path &filename) {
+    if (const auto ext = filename.extension(); ext == ".gz" || ext == ".zst")
+        return std::filesystem::path(filename).replace_extension();
+    return filename;
+}
+
+PxlsLogSource::ChunkBuffer::int_type PxlsLogSource::ChunkBuffer::underflow() {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    do {
+        if (!source.NextChunk(chunk)) return traits_type::eof();
+    } while (chunk.empty());
+    setg(chunk.data(), chunk.data(), chunk.data() + chunk.size());
+    return traits_type::to_int_type(*gptr());
+}
+
+bool PxlsLogSource::NextChunk(std::string &chunk) {
+    std::unique_lock lock(mutex);
+    while (true) {
+        cv.wait(lock, [&] {
+            return parts.empty() ? scan_done : !parts.front()->chunks.empty() || parts.front()->done;
+        });
+        if (parts.empty()) return false;
+        auto &part = *parts.front();
+        if (!part.chunks.empty()) {
+            chunk = std::move(part.chunks.front().first);
+            consumed_offset = part.chunks.front().second;
+            part.chunks.pop_front();
+            cv.notify_all();
+            return true;
+        }
+        // the data after a corrupted part is dropped, since the records in between are lost
+        if (part.failed) {
+            failed = true;
+            return false;
+        }
+        parts.pop_front();
+        cv.notify_all();
+    }
+}
+
+void PxlsLogSource::Work() {
+    std::unique_lock lock(mutex);
+    while (true) {
+        std::shared_ptr<Part> part;
+        cv.wait(lock, [&] {
+            if (stop_flag) return true;
+            const auto it = std::ranges::find_if(parts, [](const auto &p) { return !p->assigned; });
+            if (it != parts.end()) {
+                part = *it;
+                return true;
+            }
+            return !scan_done && parts.size() < max_parts;
+        });
+        if (stop_flag) return;
+        if (!part) {
+            part = ScanPart();
+            if (!part) {
+                scan_done = true;
+                cv.notify_all();
+                continue;
+            }
+            parts.push_back(part);
+        }
+        part->assigned = true;
+        lock.unlock();
+        const bool ok = compression == GZIP ? DecompressGzip(*part) : DecompressZstd(*part);
+        lock.lock();
+        part->done = true;
+        part->failed = !ok;
+        cv.notify_all();
+    }
+}
+
+std::shared_ptr<PxlsLogSource::Part> PxlsLogSource::ScanPart() {
+    if (scan_offset >= file_size) return nullptr;
+    auto part = std::make_shared<Part>();
+    part->offset = scan_offset;
+    const auto remaining = file_size - scan_offset;
+    // parts whose size is unknown extend to the end of the log, which is decompressed sequentially
+    part->bytes = remaining;
+    if (compression == GZIP) {
+        if (const auto member_bytes = BgzfMemberBytes(data + scan_offset, remaining))
+            part->bytes = member_bytes;
+    }
+#ifdef PXLS_WITH_ZSTD
+    else if (const auto frame_bytes = ZSTD_findFrameCompressedSize(data + scan_offset, remaining); !ZSTD_isError(frame_bytes))
+        part->bytes = frame_bytes;
+#endif
+    scan_offset += part->bytes;
+    return part;
+}
+
+bool PxlsLogSource::DecompressGzip(Part &part) {
+    z_stream stream {};
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) return false;
+    const auto *input = data + part.offset;
+    std::size_t input_pos = 0;
+    std::string chunk(CHUNK_BYTES, '\0');
+    std::size_t chunk_pos = 0;
+    bool ok = true;
+    while (true) {
+        // zlib counts bytes in 32-bit integers
+        const auto input_bytes = static_cast<uInt>(std::min<std::size_t>(part.bytes - input_pos, UINT32_MAX));
+        stream.next_in = const_cast<Bytef*>(input + input_pos);
+        stream.avail_in = input_bytes;
+        stream.next_out = reinterpret_cast<Bytef*>(chunk.data() + chunk_pos);
+        stream.avail_out = static_cast<uInt>(chunk.size() - chunk_pos);
+        const auto ret = inflate(&stream, Z_NO_FLUSH);
+        input_pos += input_bytes - stream.avail_in;
+        chunk_pos = chunk.size() - stream.avail_out;
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            ok = false;
+            break;
+        }
+        const bool member_end = ret == Z_STREAM_END;
+        // concatenated members are decompressed one after another, and the bytes after them are ignored like gzip does
+        const bool part_end = member_end && (part.bytes - input_pos < sizeof(GZIP_MAGIC) ||
+            input[input_pos] != GZIP_MAGIC[0] || input[input_pos + 1] != GZIP_MAGIC[1]);
+        if (chunk_pos == chunk.size() || part_end) {
+            chunk.resize(chunk_pos);
+            if (!PushChunk(part, std::move(chunk), part.offset + (part_end ? part.bytes : input_pos))) break;
+            chunk.assign(CHUNK_BYTES, '\0');
+            chunk_pos = 0;
+        }
+        if (part_end) break;
+        if (member_end)
+            inflateReset(&stream);
+        else if (input_pos == part.bytes && ret == Z_BUF_ERROR) {
+            // truncated member
+            ok = false;
+            break;
+        }
+    }
+    inflateEnd(&stream);
+    return ok;
+}
+
+bool PxlsLogSource::DecompressZstd(Part &part) {
+#ifdef PXLS_WITH_ZSTD
+    const auto dctx = ZSTD_createDCtx();
+    if (!dctx) return false;
+    ZSTD_inBuffer input { data + part.offset, part.bytes, 0 };
+    std::string chunk(CHUNK_BYTES, '\0');
+    ZSTD_outBuffer output { chunk.data(), chunk.size(), 0 };
+    // 0 once a frame is complete
+    std::size_t ret = 0;
+    bool ok = true;
+    while (true) {
+        ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret)) {
+            ok = false;
+            break;
+        }
+        // everything decompressed so far is flushed if the output isn't full
+        const bool part_end = input.pos == input.size && output.pos < output.size;
+        if (output.pos == output.size || part_end) {
+            chunk.resize(output.pos);
+            if (!PushChunk(part, std::move(chunk), part.offset + input.pos)) break;
+            chunk.assign(CHUNK_BYTES, '\0');
+            output = { chunk.data(), chunk.size(), 0 };
+        }
+        if (part_end) break;
+    }
+    ZSTD_freeDCtx(dctx);
+    // the last frame is truncated
+    return ok && ret == 0;
+#else
+    (void)part;
+    return false;
+#endif
+}
+
+bool PxlsLogSource::PushChunk(Part &part, std::string &&chunk, const unsigned long long compressed_end) {
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&] { return stop_flag || part.chunks.size() < PART_QUEUE_CHUNKS; });
+    if (stop_flag) return false;
+    part.chunks.emplace_back(std::move(chunk), compressed_end);
+    cv.notify_all();
+    return true;
+}
@@ -0,0 +1,106 @@
+//
+// Provide a stream of raw pxls log, which decompresses gzip and zstd logs on background threads as it is read
+//
+
+#ifndef PXLSLOGSOURCE_H
+#define PXLSLOGSOURCE_H
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <streambuf>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <boost/interprocess/mapped_region.hpp>
+
+enum LogCompression { UNCOMPRESSED, GZIP, ZSTD };
+
+class PxlsLogSource {
+public:
+    PxlsLogSource() : decompressed_stream(&chunk_buffer) {}
+    PxlsLogSource(const PxlsLogSource&) = delete;
+    PxlsLogSource& operator=(const PxlsLogSource&) = delete;
+    ~PxlsLogSource() { Close(); }
+    // open a pxls log, whose compression is detected from its magic bytes. compressed logs are split into the parts
+    // that can be decompressed independently, such as zstd frames and bgzf members, which are decompressed by up to
+    // thread_count threads ahead of the reader. 0 uses all hardware threads
+    bool Open(const std::string &filename, unsigned thread_count = 0);
+    // read from the beginning again
+    bool Rewind();
+    void Close();
+    // the decompressed log, which can't seek if it is compressed
+    std::istream& Stream() { return compression == UNCOMPRESSED ? static_cast<std::istream&>(file) : decompressed_stream; }
+    [[nodiscard]] LogCompression Compression() const { return compression; }
+    // bytes of the compressed log consumed by the data read so far, which is the progress of reading it
+    [[nodiscard]] unsigned long long CompressedOffset() const { return consumed_offset; }
+    [[nodiscard]] unsigned long long FileSize() const { return file_size; }
+    // did the stream end early because the compressed data is corrupted or truncated
+    [[nodiscard]] bool Failed();
+    // is zstd supported by this build
+    static bool SupportsZstd();
+    static LogCompression DetectCompression(const std::string &filename);
+    // the path without the extension of the compression, so that the logdb of a.log.gz is a.logdb like the one of a.log
+    static std::filesystem::path StripCompressionExtension(const std::filesystem::path &filename);
+    // bytes of each decompressed chunk passed to the reader
+    static constexpr std::size_t CHUNK_BYTES { 1 << 20 };
+    // chunks decompressed ahead for each part, which bounds the memory used by the threads
+    static constexpr std::size_t PART_QUEUE_CHUNKS { 4 };
+private:
+    // a part of the compressed log that can be decompressed independently
+    struct Part {
+        std::size_t offset { 0 }, bytes { 0 };
+        bool assigned { false }, done { false }, failed { false };
+        // decompressed chunks and the offsets in the log of the compressed bytes they end at
+        std::deque<std::pair<std::string, unsigned long long>> chunks;
+    };
+    // stream buffer taking decompressed chunks in order
+    class ChunkBuffer : public std::streambuf {
+    public:
+        explicit ChunkBuffer(PxlsLogSource &log_source) : source(log_source) {}
+        void Reset() { chunk.clear(); setg(nullptr, nullptr, nullptr); }
+    protected:
+        int_type underflow() override;
+    private:
+        PxlsLogSource &source;
+        std::string chunk;
+    };
+    // decompress parts until closed
+    void Work();
+    // find the next part after scan_offset, return nullptr at the end of the log. the mutex must be held
+    std::shared_ptr<Part> ScanPart();
+    // decompress a part, passing chunks to PushChunk. return false if the data is corrupted
+    bool DecompressGzip(Part &part);
+    bool DecompressZstd(Part &part);
+    // queue a decompressed chunk of a part, waiting while the reader is behind. return false if closed
+    bool PushChunk(Part &part, std::string &&chunk, unsigned long long compressed_end);
+    // take the next chunk in order, return false at the end of the log
+    bool NextChunk(std::string &chunk);
+    std::string source_filename;
+    LogCompression compression { UNCOMPRESSED };
+    unsigned long long file_size { 0 };
+    std::ifstream file;
+    ChunkBuffer chunk_buffer { *this };
+    std::istream decompressed_stream;
+    // the compressed log is mapped as a whole, so that parts are decompressed without copying
+    std::unique_ptr<boost::interprocess::mapped_region> region;
+    const unsigned char *data { nullptr };
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop_flag { false };
+    // parts being read or decompressed, the first one is being read
+    std::deque<std::shared_ptr<Part>> parts;
+    std::size_t max_parts { 0 };
+    std::size_t scan_offset { 0 };
+    bool scan_done { false };
+    bool failed { false };
+    // read without the mutex, since the conversion checks it for every line
+    std::atomic<unsigned long long> consumed_offset { 0 };
+};
+
+#endif //PXLSLOGSOURCE_H
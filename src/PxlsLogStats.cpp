@@ -0,0 +1,236 @@
+//
+// PxlsLogStats implementation
+//
+
+#include "PxlsLogStats.h"
+
+namespace {
+    // color populations at checkpoints, and prefix sums of the placements of each user
+    constexpr auto STATS_TABLES_SQL = "CREATE TABLE IF NOT EXISTS stats_color("
+                                      "id INTEGER NOT NULL,"
+                                      "color_index INTEGER NOT NULL,"
+                                      "population INTEGER NOT NULL,"
+                                      "PRIMARY KEY (id, color_index)"
+                                      ") WITHOUT ROWID;"
+                                      "CREATE TABLE IF NOT EXISTS stats_user("
+                                      "user_id INTEGER PRIMARY KEY,"
+                                      "hash TEXT UNIQUE NOT NULL,"
+                                      "placed INTEGER NOT NULL"
+                                      ");"
+                                      "CREATE TABLE IF NOT EXISTS stats_user_record("
+                                      "user_id INTEGER NOT NULL,"
+                                      "id INTEGER NOT NULL,"
+                                      "ordinal INTEGER NOT NULL,"
+                                      "PRIMARY KEY (user_id, id)"
+                                      ") WITHOUT ROWID;";
+
+    // color transitions of records, the color of the previous record is NULL if the pixel was virgin
+    constexpr auto TRANSITION_SQL = "SELECT l.color_index,p.color_index FROM log l LEFT JOIN log p ON p.id = l.prev_id "
+                                    "WHERE l.id > ? AND l.id <= ?;";
+
+    unsigned ColorColumn(sqlite3_stmt *sql_stmt, const int column) {
+        const auto color_index = sqlite3_column_int64(sql_stmt, column);
+        return color_index >= 0 && color_index < PxlsLogStats::COLOR_COUNT ? static_cast<unsigned>(color_index) : PxlsLogStats::COLOR_COUNT - 1;
+    }
+
+    // run a query returning a single id with an optional parameter, return false if it fails or the id is NULL
+    bool QueryId(sqlite3 *log_db, const char *sql, const unsigned long param, unsigned long &id) {
+        sqlite3_stmt *sql_stmt;
+        if (sqlite3_prepare_v2(log_db, sql, -1, &sql_stmt, nullptr) != SQLITE_OK) return false;
+        if (sqlite3_bind_parameter_count(sql_stmt) > 0)
+            sqlite3_bind_int64(sql_stmt, 1, static_cast<sqlite3_int64>(param));
+        const bool result = sqlite3_step(sql_stmt) == SQLITE_ROW && sqlite3_column_type(sql_stmt, 0) != SQLITE_NULL;
+        if (result)
+            id = static_cast<unsigned long>(sqlite3_column_int64(sql_stmt, 0));
+        sqlite3_finalize(sql_stmt);
+        return result;
+    }
+}
+
+bool PxlsLogStats::Build(sqlite3 *log_db) {
+    if (!log_db || sqlite3_exec(log_db, STATS_TABLES_SQL, nullptr, nullptr, nullptr) != SQLITE_OK ||
+        sqlite3_exec(log_db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK)
+        return false;
+    sqlite3_stmt *record_stmt, *user_query_stmt, *user_update_stmt, *ordinal_stmt, *checkpoint_stmt;
+    sqlite3_prepare_v2(log_db, "SELECT l.id,l.hash,l.color_index,p.color_index FROM log l LEFT JOIN log p ON p.id = l.prev_id "
+                               "WHERE l.id > ? ORDER BY l.id;", -1, &record_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "SELECT user_id,placed FROM stats_user WHERE hash = ?;", -1, &user_query_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "INSERT OR REPLACE INTO stats_user(user_id,hash,placed) VALUES (?,?,?);", -1, &user_update_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "INSERT INTO stats_user_record(user_id,id,ordinal) VALUES (?,?,?);", -1, &ordinal_stmt, nullptr);
+    sqlite3_prepare_v2(log_db, "INSERT OR REPLACE INTO stats_color(id,color_index,population) VALUES (?,?,?);", -1, &checkpoint_stmt, nullptr);
+    const auto Rollback = [&] {
+        sqlite3_finalize(record_stmt);
+        sqlite3_finalize(user_query_stmt);
+        sqlite3_finalize(user_update_stmt);
+        sqlite3_finalize(ordinal_stmt);
+        sqlite3_finalize(checkpoint_stmt);
+        sqlite3_exec(log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    };
+    // continue from the last checkpoint
+    const auto covered_id = CoveredId(log_db);
+    std::vector<unsigned long> population;
+    unsigned long next_user_id = 0;
+    if (!ReadCheckpoint(log_db, covered_id, population)) return Rollback();
+    QueryId(log_db, "SELECT MAX(user_id) FROM stats_user;", 0, next_user_id);
+    next_user_id++;
+    const auto WriteCheckpoint = [&](const unsigned long id) {
+        for (unsigned color_index = 0; color_index < COLOR_COUNT; color_index++) {
+            if (population[color_index] == 0) continue;
+            sqlite3_bind_int64(checkpoint_stmt, 1, static_cast<sqlite3_int64>(id));
+            sqlite3_bind_int(checkpoint_stmt, 2, static_cast<int>(color_index));
+            sqlite3_bind_int64(checkpoint_stmt, 3, static_cast<sqlite3_int64>(population[color_index]));
+            const bool checkpoint_ok = sqlite3_step(checkpoint_stmt) == SQLITE_DONE;
+            sqlite3_reset(checkpoint_stmt);
+            if (!checkpoint_ok) return false;
+        }
+        return true;
+    };
+    // user id and placement count of the users seen in this pass, the others are left in the logdb
+    std::unordered_map<std::string, std::pair<sqlite3_int64, unsigned long>> users;
+    std::string hash;
+    auto last_id = covered_id;
+    sqlite3_bind_int64(record_stmt, 1, static_cast<sqlite3_int64>(covered_id));
+    int step_result;
+    while ((step_result = sqlite3_step(record_stmt)) == SQLITE_ROW) {
+        last_id = static_cast<unsigned long>(sqlite3_column_int64(record_stmt, 0));
+        hash.assign(reinterpret_cast<const char*>(sqlite3_column_text(record_stmt, 1)), sqlite3_column_bytes(record_stmt, 1));
+        population[ColorColumn(record_stmt, 2)]++;
+        if (sqlite3_column_type(record_stmt, 3) != SQLITE_NULL)
+            population[ColorColumn(record_stmt, 3)]--;
+        auto user_it = users.find(hash);
+        if (user_it == users.end()) {
+            std::pair<sqlite3_int64, unsigned long> user { next_user_id, 0 };
+            sqlite3_bind_text(user_query_stmt, 1, hash.c_str(), static_cast<int>(hash.size()), SQLITE_STATIC);
+            if (sqlite3_step(user_query_stmt) == SQLITE_ROW)
+                user = { sqlite3_column_int64(user_query_stmt, 0), static_cast<unsigned long>(sqlite3_column_int64(user_query_stmt, 1)) };
+            else
+                next_user_id++;
+            sqlite3_reset(user_query_stmt);
+            user_it = users.emplace(hash, user).first;
+        }
+        // prefix sum of the placements of the user
+        auto &[user_id, placed] = user_it->second;
+        sqlite3_bind_int64(ordinal_stmt, 1, user_id);
+        sqlite3_bind_int64(ordinal_stmt, 2, static_cast<sqlite3_int64>(last_id));
+        sqlite3_bind_int64(ordinal_stmt, 3, static_cast<sqlite3_int64>(++placed));
+        const bool ordinal_ok = sqlite3_step(ordinal_stmt) == SQLITE_DONE;
+        sqlite3_reset(ordinal_stmt);
+        if (!ordinal_ok || (last_id % CHECKPOINT_INTERVAL == 0 && !WriteCheckpoint(last_id))) return Rollback();
+    }
+    if (step_result != SQLITE_DONE) return Rollback();
+    // the last record is always a checkpoint, which marks the records covered
+    if (last_id != covered_id && last_id % CHECKPOINT_INTERVAL != 0 && !WriteCheckpoint(last_id)) return Rollback();
+    for (const auto &[user_hash, user]: users) {
+        sqlite3_bind_int64(user_update_stmt, 1, user.first);
+        sqlite3_bind_text(user_update_stmt, 2, user_hash.c_str(), static_cast<int>(user_hash.size()), SQLITE_STATIC);
+        sqlite3_bind_int64(user_update_stmt, 3, static_cast<sqlite3_int64>(user.second));
+        const bool update_ok = sqlite3_step(user_update_stmt) == SQLITE_DONE;
+        sqlite3_reset(user_update_stmt);
+        if (!update_ok) return Rollback();
+    }
+    sqlite3_finalize(record_stmt);
+    sqlite3_finalize(user_query_stmt);
+    sqlite3_finalize(user_update_stmt);
+    sqlite3_finalize(ordinal_stmt);
+    sqlite3_finalize(checkpoint_stmt);
+    if (sqlite3_exec(log_db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(log_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    return true;
+}
+
+unsigned long PxlsLogStats::CoveredId(sqlite3 *log_db) {
+    unsigned long id = 0;
+    // the table doesn't exist if statistics have never been built
+    QueryId(log_db, "SELECT MAX(id) FROM stats_color;", 0, id);
+    return id;
+}
+
+bool PxlsLogStats::ReadCheckpoint(sqlite3 *log_db, const unsigned long id, std::vector<unsigned long> &population) {
+    population.assign(COLOR_COUNT, 0);
+    // there are no pixels before the first record
+    if (id == 0) return true;
+    sqlite3_stmt *sql_stmt;
+    if (sqlite3_prepare_v2(log_db, "SELECT color_index,population FROM stats_color WHERE id = ?;", -1, &sql_stmt, nullptr) != SQLITE_OK)
+        return false;
+    sqlite3_bind_int64(sql_stmt, 1, static_cast<sqlite3_int64>(id));
+    int step_result;
+    while ((step_result = sqlite3_step(sql_stmt)) == SQLITE_ROW)
+        population[ColorColumn(sql_stmt, 0)] = static_cast<unsigned long>(sqlite3_column_int64(sql_stmt, 1));
+    sqlite3_finalize(sql_stmt);
+    return step_result == SQLITE_DONE;
+}
+
+bool PxlsLogStats::QueryColorPopulation(sqlite3 *log_db, const unsigned long id, std::vector<unsigned long> &population) {
+    if (!log_db || id > CoveredId(log_db)) return false;
+    // start from the nearest checkpoint, the last record is always one
+    unsigned long prev_checkpoint = 0, next_checkpoint = 0;
+    QueryId(log_db, "SELECT MAX(id) FROM stats_color WHERE id <= ?;", id, prev_checkpoint);
+    if (!QueryId(log_db, "SELECT MIN(id) FROM stats_color WHERE id >= ?;", id, next_checkpoint)) return false;
+    const bool forward = id - prev_checkpoint <= next_checkpoint - id;
+    const auto checkpoint = forward ? prev_checkpoint : next_checkpoint;
+    std::vector<unsigned long> new_population;
+    if (!ReadCheckpoint(log_db, checkpoint, new_population)) return false;
+    // redo the records after the checkpoint, or undo the records before it
+    sqlite3_stmt *sql_stmt;
+    if (sqlite3_prepare_v2(log_db, TRANSITION_SQL, -1, &sql_stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_int64(sql_stmt, 1, static_cast<sqlite3_int64>(forward ? checkpoint : id));
+    sqlite3_bind_int64(sql_stmt, 2, static_cast<sqlite3_int64>(forward ? id : checkpoint));
+    int step_result;
+    while ((step_result = sqlite3_step(sql_stmt)) == SQLITE_ROW) {
+        const auto color_index = ColorColumn(sql_stmt, 0);
+        const bool has_prev = sqlite3_column_type(sql_stmt, 1) != SQLITE_NULL;
+        if (forward) {
+            new_population[color_index]++;
+            if (has_prev) new_population[ColorColumn(sql_stmt, 1)]--;
+        } else {
+            new_population[color_index]--;
+            if (has_prev) new_population[ColorColumn(sql_stmt, 1)]++;
+        }
+    }
+    sqlite3_finalize(sql_stmt);
+    if (step_result != SQLITE_DONE) return false;
+    population = std::move(new_population);
+    return true;
+}
+
+bool PxlsLogStats::UserPlacementCount(sqlite3_stmt *ordinal_stmt, const std::int64_t user_id, const unsigned long id, unsigned long &count) {
+    sqlite3_bind_int64(ordinal_stmt, 1, user_id);
+    sqlite3_bind_int64(ordinal_stmt, 2, static_cast<sqlite3_int64>(id));
+    const auto step_result = sqlite3_step(ordinal_stmt);
+    count = step_result == SQLITE_ROW ? static_cast<unsigned long>(sqlite3_column_int64(ordinal_stmt, 0)) : 0;
+    sqlite3_reset(ordinal_stmt);
+    return step_result == SQLITE_ROW || step_result == SQLITE_DONE;
+}
+
+bool PxlsLogStats::QueryUserPlacementCount(sqlite3 *log_db, const std::string &hash, const unsigned long from_id,
+                                           const unsigned long to_id, unsigned long &count) {
+    if (!log_db || to_id > CoveredId(log_db)) return false;
+    sqlite3_stmt *user_stmt;
+    if (sqlite3_prepare_v2(log_db, "SELECT user_id FROM stats_user WHERE hash = ?;", -1, &user_stmt, nullptr) != SQLITE_OK)
+        return false;
+    sqlite3_bind_text(user_stmt, 1, hash.c_str(), static_cast<int>(hash.size()), SQLITE_STATIC);
+    const auto step_result = sqlite3_step(user_stmt);
+    const auto user_id = step_result == SQLITE_ROW ? sqlite3_column_int64(user_stmt, 0) : 0;
+    sqlite3_finalize(user_stmt);
+    // the user hasn't placed any pixel
+    if (step_result == SQLITE_DONE) {
+        count = 0;
+        return true;
+    }
+    if (step_result != SQLITE_ROW) return false;
+    // the difference of the prefix sums at both ends, each of which is a single index lookup
+    sqlite3_stmt *ordinal_stmt;
+    if (sqlite3_prepare_v2(log_db, "SELECT ordinal FROM stats_user_record WHERE user_id = ? AND id <= ? ORDER BY id DESC LIMIT 1;",
+        -1, &ordinal_stmt, nullptr) != SQLITE_OK)
+        return false;
+    unsigned long from_count = 0, to_count = 0;
+    const bool result = UserPlacementCount(ordinal_stmt, user_id, from_id, from_count) &&
+        UserPlacementCount(ordinal_stmt, user_id, to_id, to_count);
+    sqlite3_finalize(ordinal_stmt);
+    if (!result) return false;
+    count = to_count > from_count ? to_count - from_count : 0;
+    return true;
+}
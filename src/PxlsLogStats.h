@@ -0,0 +1,39 @@
+//
+// Provide methods to build and query range statistics of colors and users stored in the LogDB
+//
+
+#ifndef PXLSLOGSTATS_H
+#define PXLSLOGSTATS_H
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <cstdint>
+#include <sqlite3.h>
+
+class PxlsLogStats {
+public:
+    // build statistics of the records not covered yet, so that it can be extended after appending records.
+    // it runs in its own transaction
+    static bool Build(sqlite3 *log_db);
+    // the last record id covered by statistics, 0 if there are none
+    static unsigned long CoveredId(sqlite3 *log_db);
+    // query the number of pixels of each color after the records up to id are applied, indexed by color index.
+    // virgin pixels are not counted. the nearest checkpoint is corrected by replaying at most half an interval of
+    // color transitions, forward (redo) or backward (undo)
+    static bool QueryColorPopulation(sqlite3 *log_db, unsigned long id, std::vector<unsigned long> &population);
+    // query the number of records placed by a user with id in (from_id, to_id]
+    static bool QueryUserPlacementCount(sqlite3 *log_db, const std::string &hash, unsigned long from_id, unsigned long to_id,
+                                        unsigned long &count);
+    // number of color indices, larger color indices are counted as the fallback color index like the canvas
+    static constexpr unsigned COLOR_COUNT { 256 };
+    // records between checkpoints of color populations
+    static constexpr unsigned long CHECKPOINT_INTERVAL { 1024 };
+private:
+    // read the color populations stored at a checkpoint
+    static bool ReadCheckpoint(sqlite3 *log_db, unsigned long id, std::vector<unsigned long> &population);
+    // get the placement count of a user up to id from its prefix sums
+    static bool UserPlacementCount(sqlite3_stmt *ordinal_stmt, std::int64_t user_id, unsigned long id, unsigned long &count);
+};
+
+#endif //PXLSLOGSTATS_H
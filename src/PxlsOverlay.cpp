@@ -74,7 +74,7 @@ PxlsInfoPanel::PxlsInfoPanel(const unsigned window_w, const unsigned window_h) {
     window_width = window_w; window_height = window_h;
 }
 
-void PxlsInfoPanel::Render(const PxlsCanvas &canvas) {
+void PxlsInfoPanel::Render(const PxlsCanvas &canvas, const PxlsLogDB &db, PxlsLogDBService &db_service) {
     Rectangle panel_rect;
     unsigned control_line_index = 0;
     // generate bound rect for the next control
@@ -99,26 +99,51 @@ void PxlsInfoPanel::Render(const PxlsCanvas &canvas) {
     }
     unsigned canvas_x, canvas_y;
     if (canvas.GetNearestPixelPos(GetMousePosition(), canvas_x, canvas_y)) {
-        auto color = canvas.GetPaletteColor(canvas.Canvas()[canvas_x][canvas_y].color_index);
+        auto pixel = canvas.Pixel(canvas_x, canvas_y);
+        // the metadata is left behind by color-only replay, look up the record of the pixel instead
+        bool restoring = false;
+        if (is_expanded && pixel.manipulate_count != 0 && canvas.IsMetadataStale(canvas_x, canvas_y)) {
+            if (const auto key = std::make_tuple(canvas_x, canvas_y, db.Seek()); restored_key != key) {
+                restored_key = key;
+                restored_pixel = PxlsCanvasPixel {};
+                restored_future = db_service.QueryPixelRecord(canvas_x, canvas_y, db.Seek());
+            }
+            if (PxlsLogDBService::IsReady(restored_future)) {
+                if (const auto record = restored_future.get()) {
+                    if (record->time) restored_pixel.last_time = sys_time_ms { std::chrono::milliseconds(*record->time) };
+                    if (record->action) restored_pixel.last_action = *record->action;
+                    if (record->hash) restored_pixel.last_hash_id = PxlsHashTable::Intern(*record->hash);
+                }
+            }
+            restoring = restored_future.valid();
+            pixel.last_time = restored_pixel.last_time;
+            pixel.last_action = restored_pixel.last_action;
+            pixel.last_hash_id = restored_pixel.last_hash_id;
+        }
+        auto color = canvas.GetPaletteColor(pixel.color_index);
         // pixel position
         GuiLabel(NextControlBounds(), std::format("({}, {})", canvas_x, canvas_y).c_str());
         // pixel color
         GuiLabel(NextControlBounds(), std::format("{} ({}, #{:02X}{:02X}{:02X})",
-            canvas.GetPaletteColorName(canvas.Canvas()[canvas_x][canvas_y].color_index),
-            canvas.Canvas()[canvas_x][canvas_y].color_index, color.r, color.g, color.b).c_str());
+            canvas.GetPaletteColorName(pixel.color_index),
+            pixel.color_index, color.r, color.g, color.b).c_str());
         if (is_expanded) {
-            if (canvas.Canvas()[canvas_x][canvas_y].manipulate_count == 0) {
+            if (pixel.manipulate_count == 0) {
                 GuiLabel(NextControlBounds(), "Virgin pixel");
+            } else if (restoring) {
+                GuiLabel(NextControlBounds(), std::format("Total action count: {}",
+                    pixel.manipulate_count).c_str());
+                GuiLabel(NextControlBounds(), "Looking up the last record...");
             } else {
                 // pixel detail
                 GuiLabel(NextControlBounds(), std::format("Total action count: {}",
-                    canvas.Canvas()[canvas_x][canvas_y].manipulate_count).c_str());
+                    pixel.manipulate_count).c_str());
                 GuiLabel(NextControlBounds(), std::format("Last action type: {}",
-                canvas.Canvas()[canvas_x][canvas_y].last_action).c_str());
+                pixel.last_action).c_str());
                 GuiLabel(NextControlBounds(), std::format("Last action time: {:%F %T}",
-                    canvas.Canvas()[canvas_x][canvas_y].last_time).c_str());
+                    pixel.last_time).c_str());
                 GuiLabel(NextControlBounds(), "Last record hash:");
-                GuiLabel(NextControlBounds(), canvas.Canvas()[canvas_x][canvas_y].last_hash.c_str());
+                GuiLabel(NextControlBounds(), std::string(PxlsHashTable::Lookup(pixel.last_hash_id)).c_str());
             }
         }
     }
@@ -147,7 +172,7 @@ void PxlsCursorOverlay::Render(const PxlsCanvas &canvas) {
             mouse_pos.y + OVERLAY_OFFSET.y,
             OVERLAY_OFFSET.width,
             OVERLAY_OFFSET.height }, 0.2f, 20,
-            canvas.GetPaletteColor(canvas.Canvas()[canvas_x][canvas_y].color_index));
+            canvas.GetPaletteColor(canvas.ColorIndex(canvas_x, canvas_y)));
         DrawRectangleRoundedLinesEx(Rectangle {
             mouse_pos.x + OVERLAY_OFFSET.x,
             mouse_pos.y + OVERLAY_OFFSET.y,
@@ -162,14 +187,104 @@ PxlsPlaybackPanel::PxlsPlaybackPanel(const unsigned window_w, const unsigned win
 }
 
 bool PxlsPlaybackPanel::InitPlayback(const PxlsLogDB &db) {
-    if (IsCanvasUpdating()) return false;
-    playback_state = PAUSE; playback_head = 0; playback_speed = 100;
+    if (IsCanvasUpdating() || IsTailing()) return false;
+    StopPrefetch();
+    playback_state = PAUSE; playback_head = 0;
+    playback_speed = DEFAULT_PLAYBACK_SPEED; speed_unit = RECORDS_PER_SECOND;
+    scheduled_id = std::nullopt;
+    region = std::nullopt;
+    filter = std::nullopt;
+    filter_bitmap.Clear();
+    filter_corrections.clear();
+    pending_filter = std::nullopt;
     db.QuerySnapshotIdList(snapshot_ids);
+    keyframe_cache.Clear();
+    return true;
+}
+
+bool PxlsPlaybackPanel::Region(const std::optional<PxlsRegion> &r, PxlsLogDB &db, PxlsCanvas &canvas) {
+    if (IsCanvasUpdating() || IsTailing()) return false;
+    StopPrefetch();
+    canvas.Region(r);
+    region = canvas.Region();
+    // cached keyframes are only up to date inside the old region
+    keyframe_cache.Clear();
+    // pixels inside the new region may be out of date, so rebuild the canvas from the beginning
+    canvas.ClearCanvas();
+    db.Seek(0);
     return true;
 }
 
+bool PxlsPlaybackPanel::Filter(const std::optional<PxlsActionFilter> &f, PxlsLogDB &db, PxlsCanvas &canvas) {
+    if (IsCanvasUpdating() || IsTailing()) return false;
+    if (!f) {
+        ApplyFilter(std::nullopt, {}, {}, db, canvas);
+        return true;
+    }
+    if (!db.HasColumns() || db.Columns().RecordCount() != db.RecordCount()) return false;
+    StopPrefetch();
+    pending_filter.emplace();
+    pending_filter->filter = *f;
+    // finding the records scans all of them, so prevent gui from freezing like long canvas updates
+    update_progress = 0;
+    update_progress_total = db.RecordCount();
+    PxlsDialog::AcquireToken(CANVAS_FUTURE_TOKEN);
+    canvas_future = std::async([&] {
+        auto &pending = *pending_filter;
+        // snapshots contain all records, so they are corrected before being used under the filter
+        pending.ready = db.QueryFilterBitmap(pending.filter, pending.bitmap) &&
+            db.Columns().FilterCorrections(pending.bitmap, snapshot_ids, pending.corrections);
+        PxlsDialog::ReleaseToken(CANVAS_FUTURE_TOKEN);
+        if (!pending.ready)
+            PxlsDialog::AcquireToken(FILTER_FAILURE_TOKEN);
+    });
+    return true;
+}
 
-void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
+void PxlsPlaybackPanel::ApplyFilter(std::optional<PxlsActionFilter> &&f, PxlsRecordBitmap &&bitmap, PxlsFilterCorrectionDeltas &&corrections,
+                                    PxlsLogDB &db, PxlsCanvas &canvas) {
+    StopPrefetch();
+    filter = std::move(f);
+    filter_bitmap = std::move(bitmap);
+    filter_corrections = std::move(corrections);
+    // cached keyframes contain the records selected by the old filter
+    keyframe_cache.Clear();
+    canvas.ClearCanvas();
+    db.Seek(0);
+}
+
+bool PxlsPlaybackPanel::Tail(PxlsLogDB &db) {
+    if (IsCanvasUpdating() || IsTailing()) return false;
+    tail_width = db.Width(); tail_height = db.Height();
+    tail_record_count = db.RecordCount();
+    // ingesting runs the statistics build as well, so prevent gui from freezing. no pending box is shown, since the
+    // canvas stays as it is
+    tail_future = std::async(std::launch::async, [&] {
+        unsigned long appended_count = 0;
+        db.TailLogRaw(appended_count);
+        return appended_count;
+    });
+    return true;
+}
+
+bool PxlsPlaybackPanel::FinishTail(PxlsLogDB &db, PxlsCanvas &canvas) {
+    if (!tail_future.valid() || IsTailing() || IsCanvasUpdating() || tail_future.get() == 0) return false;
+    const bool pinned = playback_head == tail_record_count && db.Seek() == tail_record_count;
+    if (db.Width() != tail_width || db.Height() != tail_height) {
+        // the canvas grows, so seek again from the nearest snapshot. the snapshots keep their smaller dimension and
+        // stay loadable, while the cached keyframes have the size of the old canvas
+        StopPrefetch();
+        canvas.InitCanvas(db.Width(), db.Height(), window_width, window_height);
+        canvas.Region(region);
+        db.Seek(0);
+        keyframe_cache.Clear();
+    }
+    if (pinned)
+        playback_head = db.RecordCount();
+    return true;
+}
+
+void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas, const double frame_start_time) {
     const Rectangle progress_panel_rect = { MARGIN,
         static_cast<float>(window_height) - PANEL_HEIGHT - MARGIN,
         static_cast<float>(window_width) - 2 * MARGIN, PANEL_HEIGHT };
@@ -181,6 +296,8 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
         return next_rect;
     };
 
+    // the controls read the published metadata, since the logdb may be appended to in the background
+    const auto db_info = db.Info();
     // render panel gui
     GuiPanel(progress_panel_rect, nullptr);
     // disable playback control when a dialog is open
@@ -197,11 +314,12 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
         playback_state = PLAY;
     // jump to end button
     if (GuiLabelButton(NextControlBounds(PLAYBACK_BTN_WIDTH), GuiIconText(ICON_PLAYER_NEXT, nullptr)))
-        playback_head = db.RecordCount();
+        playback_head = db_info.record_count;
 
     int button_result;
     // playback speed label
-    const auto speed_label_str = std::format("{} rec/f", playback_speed);
+    const auto speed_label_str = speed_unit == RECORDS_PER_SECOND ?
+        std::format("{:.0f} rec/s", playback_speed) : std::format("{:g}x", playback_speed);
     if (GuiLabelButton(NextControlBounds(std::max(SPEED_LABEL_MIN_WIDTH, static_cast<float>(GetTextWidth(speed_label_str.c_str())))),
         speed_label_str.c_str()) && PxlsDialog::CurrentToken() != PLAYBACK_SPEED_TOKEN) {
         // try to acquire the dialog token
@@ -209,7 +327,7 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
     }
 
     // head label
-    const auto head_label_str = std::format("{} / {}", db.Seek(), db.RecordCount());
+    const auto head_label_str = std::format("{} / {}", db.Seek(), db_info.record_count);
     if (GuiLabelButton(NextControlBounds(std::max(HEAD_LABEL_MIN_WIDTH, static_cast<float>(GetTextWidth(head_label_str.c_str())))),
         head_label_str.c_str()) && PxlsDialog::CurrentToken() != PLAYBACK_HEAD_TOKEN) {
         // try to acquire the dialog token
@@ -219,7 +337,7 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
     // progress bar
     auto playback_head_raw = static_cast<float>(playback_head);
     GuiSliderBar(NextControlBounds(progress_panel_rect.width - control_x),
-        nullptr, nullptr, &playback_head_raw, 0.0f, static_cast<float>(db.RecordCount()));
+        nullptr, nullptr, &playback_head_raw, 0.0f, static_cast<float>(db_info.record_count));
     if (!PxlsDialog::IsDialogOpen())
         playback_head = static_cast<unsigned long>(std::floorf(playback_head_raw));
     // revert back to normal
@@ -229,12 +347,22 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
         std::string speed_value_str;
         // render the dialog as long as the dialog is open
         PxlsDialog::TextInputBox(window_width, window_height, 0, "Set playback speed",
-                                        "Input playback speed(-10000 - 10000 rec/f):", speed_value_str, button_result);
+                                        "Input playback speed(rec/s, or canvas time scale like 60x):", speed_value_str, button_result);
         if (button_result == 1) {
             try {
-                if (const auto pb_speed = std::stoi(speed_value_str); pb_speed != 0)
-                    playback_speed = std::clamp(pb_speed, -10000, 10000);
-            } catch (std::invalid_argument&) {}
+                boost::algorithm::trim(speed_value_str);
+                // a trailing x means the speed is relative to the canvas time
+                const bool is_time_scale = speed_value_str.ends_with('x') || speed_value_str.ends_with('X');
+                if (is_time_scale)
+                    speed_value_str.pop_back();
+                if (const auto pb_speed = std::stod(speed_value_str); pb_speed != 0 && std::isfinite(pb_speed)) {
+                    const auto max_speed = is_time_scale ? MAX_CANVAS_TIME_SCALE : MAX_RECORDS_PER_SECOND;
+                    playback_speed = std::clamp(pb_speed, -max_speed, max_speed);
+                    speed_unit = is_time_scale ? CANVAS_TIME_SCALE : RECORDS_PER_SECOND;
+                    // restart the schedule from the current position
+                    scheduled_id = std::nullopt;
+                }
+            } catch (std::invalid_argument&) {} catch (std::out_of_range&) {}
         }
         if (button_result != -1)
             PxlsDialog::ReleaseToken(0);
@@ -244,10 +372,10 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
         std::string head_value_str;
         // render the dialog as long as the dialog is open
         PxlsDialog::TextInputBox(window_width, window_height, 1, "Set playback head",
-                                        std::format("Input playback head(0 - {}):", db.RecordCount()), head_value_str, button_result);
+                                        std::format("Input playback head(0 - {}):", db_info.record_count), head_value_str, button_result);
         if (button_result == 1) {
             try {
-                playback_head = std::clamp(std::stoul(head_value_str), 0ul, db.RecordCount());
+                playback_head = std::clamp(std::stoul(head_value_str), 0ul, db_info.record_count);
             } catch (std::invalid_argument&) {}
         }
         if (button_result != -1)
@@ -260,8 +388,15 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
             std::format("Updating canvas, please wait... ({} / {})", update_progress, update_progress_total));
         progress_mutex.unlock();
     }
-    // wait for the update process to finish before doing the next canvas update
-    if (!IsCanvasUpdating()) {
+    // wait for the update process to finish before doing the next canvas update, and for the tail writing the logdb
+    if (!IsCanvasUpdating() && !IsTailing()) {
+        // apply the filter found in the background, the canvas is rebuilt under it below
+        if (pending_filter) {
+            if (pending_filter->ready)
+                ApplyFilter(std::move(pending_filter->filter), std::move(pending_filter->bitmap),
+                            std::move(pending_filter->corrections), db, canvas);
+            pending_filter = std::nullopt;
+        }
         // do playback and update canvas
         if (playback_head != db.Seek())
             UpdateCanvas(playback_head, db, canvas);
@@ -272,11 +407,14 @@ void PxlsPlaybackPanel::Render(PxlsLogDB &db, PxlsCanvas &canvas) {
             else if (db.Seek() == 0 && playback_speed < 0)
                 UpdateCanvas(db.RecordCount(), db, canvas);
             else
-                UpdateCanvas(std::clamp(static_cast<long long>(db.Seek()) + playback_speed, 0ll, static_cast<long long>(db.RecordCount())), db, canvas);
+                SchedulePlayback(db, canvas, frame_start_time);
             // pause when the playback head reaches the end
             if ((db.Seek() == 0 && playback_speed < 0) || (db.Seek() == db.RecordCount() && playback_speed > 0))
                 playback_state = PAUSE;
         }
+        // the schedule restarts when playback resumes
+        if (playback_state == PAUSE)
+            scheduled_id = std::nullopt;
         playback_head = db.Seek();
     }
 }
@@ -291,41 +429,172 @@ void PxlsPlaybackPanel::UpdateCanvas(const unsigned pb_head, PxlsLogDB &db, Pxls
         JumpToNearestSnapshot(pb_head, db, canvas);
         // return if the nearest snapshot id is pb_head itself
         if (db.Seek() == pb_head) return;
-        if (std::abs(static_cast<long long>(db.Seek()) - pb_head) > ASYNC_PROCESS_THRESHOLD) {
+        const auto replay_count = std::abs(static_cast<long long>(db.Seek()) - pb_head);
+        // keep the canvas state reached by a long seek, so that scrubbing around it later is fast
+        const auto CacheSeekResult = [&, replay_count] {
+            if (replay_count < CACHE_SEEK_THRESHOLD) return;
+            PxlsCanvasState state;
+            canvas.SaveState(state);
+            keyframe_cache.Insert(db.Seek(), std::move(state));
+        };
+        if (replay_count > ASYNC_PROCESS_THRESHOLD) {
             // enable async processing to prevent gui from freezing for a long time
             update_progress = 0;
-            update_progress_total = std::abs(static_cast<long long>(db.Seek()) - pb_head);
+            update_progress_total = replay_count;
             PxlsDialog::AcquireToken(CANVAS_FUTURE_TOKEN);
-            canvas_future = std::async([&, pb_head] {
-                db.QueryRecords(pb_head, [&](const std::optional<std::string> &date, const std::optional<std::string> &hash,
-                    const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
-                    if (direction == FORWARD) {
-                        canvas.PerformAction(x, y, REDO, date, action, hash, color_index);
-                    } else {
-                        canvas.PerformAction(x, y, UNDO, date, action, hash, color_index);
-                    }
+            canvas_future = std::async([&, pb_head, CacheSeekResult] {
+                Replay(pb_head, db, canvas, [&](const unsigned long count) {
                     progress_mutex.lock();
-                    update_progress++;
+                    update_progress += count;
                     progress_mutex.unlock();
                 });
+                CacheSeekResult();
                 PxlsDialog::ReleaseToken(CANVAS_FUTURE_TOKEN);
                 playback_head = db.Seek();
             });
         } else {
             // use usual sync processing to prevent pending box from showing frequently
-            db.QueryRecords(pb_head, [&](const std::optional<std::string> &date, const std::optional<std::string> &hash,
-                const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
-                if (direction == FORWARD) {
-                    canvas.PerformAction(x, y, REDO, date, action, hash, color_index);
-                } else {
-                    canvas.PerformAction(x, y, UNDO, date, action, hash, color_index);
-                }
-            });
+            Replay(pb_head, db, canvas);
+            CacheSeekResult();
         }
     }
 }
 
-void PxlsPlaybackPanel::JumpToNearestSnapshot(const unsigned pb_head, PxlsLogDB &db, PxlsCanvas &canvas) const {
+void PxlsPlaybackPanel::Replay(const unsigned long dest_id, PxlsLogDB &db, PxlsCanvas &canvas,
+                               const std::function<void (unsigned long)> &progress) {
+    // filtered playback walks the action bitmaps, which cover all records while the filter is set
+    if (filter) {
+        db.QueryFilteredBatches(dest_id, filter_bitmap, [&](const PxlsRecordBatch &batch) {
+            canvas.PerformBatch(batch, db.Columns());
+            if (progress) progress(batch.count);
+        });
+        return;
+    }
+    // walk the columnar sidecar directly if possible, region queries still rely on the tile index
+    if (!region && db.QueryRecordBatches(dest_id, [&](const PxlsRecordBatch &batch) {
+        canvas.PerformBatch(batch, db.Columns());
+        if (progress) progress(batch.count);
+    }))
+        return;
+    db.QueryRecords(dest_id, [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+        const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
+        if (direction == FORWARD) {
+            canvas.PerformAction(x, y, REDO, time, action, hash, color_index);
+        } else {
+            canvas.PerformAction(x, y, UNDO, time, action, hash, color_index);
+        }
+        if (progress) progress(1);
+    }, region);
+}
+
+double PxlsPlaybackPanel::SchedulePosition(const PxlsLogDB &db) const {
+    if (speed_unit == RECORDS_PER_SECOND)
+        return static_cast<double>(db.Seek());
+    // the canvas time of the current record, or just before the first record at the beginning
+    long long time = 0;
+    if (db.Seek() == 0) {
+        if (db.QueryRecordTime(1, time)) time--;
+    } else {
+        db.QueryRecordTime(db.Seek(), time);
+    }
+    return static_cast<double>(time);
+}
+
+unsigned long PxlsPlaybackPanel::ScheduleTarget(const PxlsLogDB &db) const {
+    const auto target_id = speed_unit == RECORDS_PER_SECOND ?
+        static_cast<unsigned long>(std::clamp(scheduled_position, 0.0, static_cast<double>(db.RecordCount()))) :
+        db.FindRecordByTime(static_cast<long long>(std::floor(scheduled_position)));
+    // records with the same time may be found behind the current one
+    return playback_speed > 0 ? std::max(target_id, db.Seek()) : std::min(target_id, db.Seek());
+}
+
+void PxlsPlaybackPanel::SchedulePlayback(PxlsLogDB &db, PxlsCanvas &canvas, const double frame_start_time) {
+    // restart the schedule if the playback head is moved by others
+    if (scheduled_id != db.Seek())
+        scheduled_position = SchedulePosition(db);
+    // advance the schedule by elapsed real time, independent of frame rate
+    const auto elapsed = std::min(static_cast<double>(GetFrameTime()), MAX_FRAME_ELAPSED);
+    scheduled_position += playback_speed * elapsed * (speed_unit == CANVAS_TIME_SCALE ? 1000.0 : 1.0);
+    const auto target_id = ScheduleTarget(db);
+    const auto Distance = [&] {
+        return static_cast<unsigned long>(std::abs(static_cast<long long>(target_id) - static_cast<long long>(db.Seek())));
+    };
+    // spend the remaining time of the frame on playback
+    auto start_time = GetTime();
+    const auto deadline = start_time + std::max(MIN_PLAYBACK_BUDGET,
+        (TARGET_FRAME_TIME - (start_time - frame_start_time)) * PLAYBACK_BUDGET_RATIO);
+    // jump via keyframes when the target is further than what replaying can reach in this frame
+    if (replay_rate > 0 && static_cast<double>(Distance()) > replay_rate * (deadline - start_time)) {
+        JumpToNearestSnapshot(target_id, db, canvas);
+        start_time = GetTime();
+    }
+    unsigned long replayed_count = 0;
+    while (db.Seek() != target_id && GetTime() < deadline) {
+        const auto chunk_count = std::min(Distance(), static_cast<unsigned long>(PLAYBACK_CHUNK_SIZE));
+        const auto chunk_dest = target_id > db.Seek() ? db.Seek() + chunk_count : db.Seek() - chunk_count;
+        const auto current_id = db.Seek();
+        if (!PlayPrefetched(chunk_dest, db, canvas))
+            Replay(chunk_dest, db, canvas);
+        replayed_count += static_cast<unsigned long>(std::abs(static_cast<long long>(db.Seek()) - static_cast<long long>(current_id)));
+        // stop if the records can't be queried
+        if (db.Seek() == current_id) break;
+    }
+    // smooth the measured throughput
+    if (const auto replay_time = GetTime() - start_time; replayed_count > 0 && replay_time > 0) {
+        const auto rate = static_cast<double>(replayed_count) / replay_time;
+        replay_rate = replay_rate > 0 ? replay_rate * 0.8 + rate * 0.2 : rate;
+    }
+    scheduled_id = db.Seek();
+}
+
+bool PxlsPlaybackPanel::PlayPrefetched(const unsigned long dest_id, PxlsLogDB &db, PxlsCanvas &canvas) {
+    // region playback relies on the tile index, and records beyond the ones covered by the sidecar are only in sqlite
+    if (region || filter || !db.HasColumns() || dest_id > db.Columns().RecordCount() || db.Seek() > db.Columns().RecordCount()) {
+        StopPrefetch();
+        return false;
+    }
+    // keep keyframes warmed by the prefetcher
+    if (auto keyframe = prefetcher.TakeKeyframe())
+        keyframe_cache.Insert(keyframe->first, std::move(keyframe->second));
+    const long long step = dest_id > db.Seek() ? PLAYBACK_CHUNK_SIZE : -static_cast<long long>(PLAYBACK_CHUNK_SIZE);
+    // drop the page being played if the playback head jumps or the direction changes
+    if (playing_page && (prefetcher.Step() != step || playing_id != db.Seek()))
+        playing_page = std::nullopt;
+    if (!playing_page) {
+        // restart prefetching from the playback head
+        if (prefetcher.Step() != step || prefetcher.NextId() != db.Seek()) {
+            std::vector<unsigned long> uncached_snapshot_ids;
+            std::ranges::copy_if(snapshot_ids, std::back_inserter(uncached_snapshot_ids),
+                [&](const unsigned long id) { return !keyframe_cache.Contains(id); });
+            if (!prefetcher.Start(db, db.Seek(), step, uncached_snapshot_ids))
+                return false;
+        }
+        playing_page = prefetcher.Take(db.Seek());
+        if (!playing_page) return false;
+        playing_batch = playing_batch_offset = 0;
+    }
+    // play the page up to dest_id, the rest of it is played later
+    auto remaining_count = static_cast<std::size_t>(std::abs(static_cast<long long>(dest_id) - static_cast<long long>(db.Seek())));
+    const auto &batches = playing_page->batches;
+    while (remaining_count > 0 && playing_batch < batches.size()) {
+        const auto batch = batches[playing_batch].View();
+        const auto count = std::min(remaining_count, batch.count - playing_batch_offset);
+        canvas.PerformBatch(batch.Slice(playing_batch_offset, count), db.Columns());
+        remaining_count -= count;
+        playing_batch_offset += count;
+        if (playing_batch_offset == batch.count) {
+            playing_batch++;
+            playing_batch_offset = 0;
+        }
+    }
+    db.Seek(step > 0 ? dest_id - remaining_count : dest_id + remaining_count);
+    playing_id = db.Seek();
+    if (playing_batch == batches.size())
+        playing_page = std::nullopt;
+    return true;
+}
+
+void PxlsPlaybackPanel::JumpToNearestSnapshot(const unsigned pb_head, PxlsLogDB &db, PxlsCanvas &canvas) {
     unsigned long min_dist = std::abs(static_cast<long long>(db.Seek()) - pb_head);
     std::optional<unsigned long> snapshot_id { std::nullopt };
     // regard 0 as a special snapshot id
@@ -338,19 +607,169 @@ void PxlsPlaybackPanel::JumpToNearestSnapshot(const unsigned pb_head, PxlsLogDB
             min_dist = std::abs(static_cast<long long>(id) - pb_head);
         }
     }
+    // cached keyframes are preferred over snapshots at the same distance, since they don't need decoding
+    if (const auto keyframe_id = keyframe_cache.Nearest(pb_head); keyframe_id &&
+        (std::abs(static_cast<long long>(*keyframe_id) - pb_head) < min_dist ||
+        (snapshot_id && std::abs(static_cast<long long>(*keyframe_id) - pb_head) == min_dist)) &&
+        canvas.LoadState(*keyframe_cache.Get(*keyframe_id))) {
+        db.Seek(*keyframe_id);
+        return;
+    }
     if (snapshot_id) {
         if (*snapshot_id == 0)
             canvas.ClearCanvas();
         else {
-            // load snapshot
-            db.QuerySnapshot(*snapshot_id, [&](const void* snapshot_blob) {
-                canvas.LoadSnapshot(static_cast<const PxlsCanvasSnapshotPixel*>(snapshot_blob));
-            });
+            // a snapshot that can't be opened leaves the canvas as it is, so replay from the current position then
+            std::vector<PxlsFilterCorrection> corrections;
+            if (filter && !db.Columns().MergeCorrections(filter_corrections, *snapshot_id, corrections)) return;
+            // load snapshot and cache the decoded canvas state. the canvas is cleared if the snapshot is decoded
+            // partially, so replay from the beginning then
+            bool snapshot_opened = false;
+            if (!db.QuerySnapshot(*snapshot_id, [&](const std::size_t snapshot_bytes, const SnapshotReadCallback &read) {
+                snapshot_opened = true;
+                return canvas.LoadSnapshot(snapshot_bytes, read);
+            })) {
+                if (snapshot_opened) {
+                    canvas.ClearCanvas();
+                    db.Seek(0);
+                }
+                return;
+            }
+            if (filter)
+                canvas.ApplyCorrections(corrections, db.Columns());
+            PxlsCanvasState state;
+            canvas.SaveState(state);
+            keyframe_cache.Insert(*snapshot_id, std::move(state));
         }
         db.Seek(*snapshot_id);
     }
 }
 
+//===========================PxlsProfilerOverlay===========================
+PxlsProfilerOverlay::PxlsProfilerOverlay(const unsigned window_w, const unsigned window_h) {
+    window_width = window_w; window_height = window_h;
+}
+
+void PxlsProfilerOverlay::Render(const PxlsLogDB *db) {
+    const Rectangle panel_rect { static_cast<float>(window_width) - DIMENSION.x - RIGHT_MARGIN, TOP_MARGIN, DIMENSION.x, DIMENSION.y };
+    unsigned control_line_index = 0;
+    // generate bound rect for the next control
+    auto NextControlBounds = [&] {
+        return Rectangle {
+            panel_rect.x + PADDING,
+            panel_rect.y + PADDING + 16.0f * static_cast<float>(control_line_index++),
+            panel_rect.width - 2 * PADDING,
+            15 };
+    };
+    const auto totals = PxlsProfiler::Totals();
+    // update rates once per sampling interval
+    if (const auto now = GetTime(); now - interval_start >= SAMPLING_INTERVAL) {
+        const auto elapsed = now - interval_start;
+        records_per_second = (totals[PxlsProfiler::PERFORM_ACTION].items - interval_totals[PxlsProfiler::PERFORM_ACTION].items) / elapsed;
+        for (unsigned zone = 0; zone < PxlsProfiler::ZONE_COUNT; zone++)
+            zone_ms_per_second[zone] = (totals[zone].total_ns - interval_totals[zone].total_ns) / 1e6 / elapsed;
+        interval_totals = totals;
+        interval_start = now;
+    }
+    GuiPanel(panel_rect, nullptr);
+    GuiLabel(NextControlBounds(), std::format("Frame: {:.2f} ms ({} fps)", GetFrameTime() * 1000.0f, GetFPS()).c_str());
+    GuiLabel(NextControlBounds(), std::format("Records: {:.0f} rec/s", records_per_second).c_str());
+    GuiLabel(NextControlBounds(), std::format("Last snapshot load: {:.2f} ms",
+        totals[PxlsProfiler::LOAD_SNAPSHOT].last_ns / 1e6).c_str());
+    if (int cache_hit, cache_miss; db && db->QueryCacheStats(cache_hit, cache_miss)) {
+        GuiLabel(NextControlBounds(), std::format("SQLite cache: {} hits, {} misses", cache_hit, cache_miss).c_str());
+    } else {
+        GuiLabel(NextControlBounds(), "SQLite cache: n/a");
+    }
+    GuiLabel(NextControlBounds(), "Time spent per second:");
+    for (unsigned zone = 0; zone < PxlsProfiler::ZONE_COUNT; zone++) {
+        GuiLabel(NextControlBounds(), std::format("  {}: {:.1f} ms",
+            PxlsProfiler::ZoneName(static_cast<PxlsProfiler::Zone>(zone)), zone_ms_per_second[zone]).c_str());
+    }
+}
+
+//===========================PxlsStatsPanel===========================
+PxlsStatsPanel::PxlsStatsPanel(const unsigned window_w, const unsigned window_h) {
+    window_width = window_w; window_height = window_h;
+}
+
+void PxlsStatsPanel::Render(const PxlsCanvas &canvas, const PxlsLogDB &db, PxlsLogDBService &db_service) {
+    const Rectangle panel_rect { static_cast<float>(window_width) - DIMENSION.x - RIGHT_MARGIN,
+        static_cast<float>(window_height) - DIMENSION.y - BOTTOM_MARGIN, DIMENSION.x, DIMENSION.y };
+    unsigned control_line_index = 0;
+    // generate bound rect for the next control
+    auto NextControlBounds = [&] {
+        return Rectangle {
+            panel_rect.x + PADDING,
+            panel_rect.y + PADDING + 16.0f * static_cast<float>(control_line_index++),
+            panel_rect.width - 2 * PADDING,
+            15 };
+    };
+    GuiPanel(panel_rect, nullptr);
+    const auto db_info = db.Info();
+    if (!db_info.has_stats) {
+        GuiLabel(NextControlBounds(), "Statistics: n/a");
+        return;
+    }
+    // query populations again when the playback head moves, at most one query is in flight
+    if (PxlsLogDBService::IsReady(population_future)) {
+        if (auto result = population_future.get()) population = std::move(*result);
+    }
+    if (!population_future.valid() && population_id != db.Seek()) {
+        population_id = db.Seek();
+        population_future = db_service.QueryColorPopulation(db.Seek());
+    }
+    GuiLabel(NextControlBounds(), std::format("Colors at record {}:", population_id.value_or(0)).c_str());
+    if (!population.empty()) {
+        const auto placed = std::accumulate(population.begin(), population.end(), 0ul);
+        const auto pixel_count = static_cast<unsigned long>(db_info.width) * db_info.height;
+        std::vector<unsigned> top_colors(population.size());
+        std::iota(top_colors.begin(), top_colors.end(), 0u);
+        const auto top_count = std::min<std::size_t>(TOP_COLOR_COUNT, top_colors.size());
+        std::partial_sort(top_colors.begin(), top_colors.begin() + top_count, top_colors.end(),
+            [&](const unsigned a, const unsigned b) { return population[a] > population[b]; });
+        for (std::size_t i = 0; i < top_count && population[top_colors[i]] != 0; i++) {
+            const auto color_index = top_colors[i];
+            const auto bounds = NextControlBounds();
+            // bar of the share among placed pixels in the color itself
+            const auto share = static_cast<float>(population[color_index]) / static_cast<float>(placed);
+            DrawRectangleRec({ bounds.x, bounds.y + 2, 40.0f * share, bounds.height - 4 }, canvas.GetPaletteColor(color_index));
+            DrawRectangleLinesEx({ bounds.x, bounds.y + 2, 40.0f, bounds.height - 4 }, 1.0f, BLACK);
+            GuiLabel({ bounds.x + 45.0f, bounds.y, bounds.width - 45.0f, bounds.height }, std::format("{}: {} ({:.1f}%)",
+                canvas.GetPaletteColorName(color_index), population[color_index], share * 100.0f).c_str());
+        }
+        control_line_index = 1 + TOP_COLOR_COUNT;
+        GuiLabel(NextControlBounds(), std::format("Virgin pixels: {}", pixel_count > placed ? pixel_count - placed : 0).c_str());
+    } else {
+        control_line_index = 1 + TOP_COLOR_COUNT;
+        GuiLabel(NextControlBounds(), population_future.valid() ? "Querying..." : "Virgin pixels: n/a");
+    }
+    // placements of the user who placed the hovered pixel, whose metadata isn't left behind by color-only replay
+    unsigned canvas_x, canvas_y;
+    if (PxlsDialog::CurrentToken() != PxlsPlaybackPanel::CANVAS_FUTURE_TOKEN &&
+        canvas.GetNearestPixelPos(GetMousePosition(), canvas_x, canvas_y) &&
+        canvas.Pixel(canvas_x, canvas_y).manipulate_count != 0 && !canvas.IsMetadataStale(canvas_x, canvas_y)) {
+        const auto hash_id = canvas.Pixel(canvas_x, canvas_y).last_hash_id;
+        if (const auto key = std::make_pair(hash_id, db.Seek()); user_key != key) {
+            user_key = key;
+            user_placed = user_total = std::nullopt;
+            const std::string hash(PxlsHashTable::Lookup(hash_id));
+            user_placed_future = db_service.QueryUserPlacementCount(hash, 0, db.Seek());
+            user_total_future = db_service.QueryUserPlacementCount(hash, 0, db_info.record_count);
+        }
+        if (PxlsLogDBService::IsReady(user_placed_future)) user_placed = user_placed_future.get();
+        if (PxlsLogDBService::IsReady(user_total_future)) user_total = user_total_future.get();
+        const auto CountText = [](const std::future<std::optional<unsigned long>> &future, const std::optional<unsigned long> &count) {
+            return future.valid() ? std::string("...") : count ? std::to_string(*count) : std::string("n/a");
+        };
+        GuiLabel(NextControlBounds(), std::format("Hovered user placed {} pixels so far,",
+            CountText(user_placed_future, user_placed)).c_str());
+        GuiLabel(NextControlBounds(), std::format("{} pixels in the whole log", CountText(user_total_future, user_total)).c_str());
+    } else {
+        GuiLabel(NextControlBounds(), "Hover a pixel to see its user");
+    }
+}
+
 //===========================PxlsToolbar===========================
 void PxlsToolbar::Render(const std::vector<ToolbarItem> &items, const ToolbarCallback &callback) {
     unsigned btn_x = MARGIN;
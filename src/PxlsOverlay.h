@@ -12,10 +12,21 @@
 #include <format>
 #include <future>
 #include <mutex>
+#include <cmath>
+#include <functional>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <algorithm>
+#include <numeric>
 #include "raylib.h"
 #include "raygui.h"
 #include "PxlsCanvas.h"
 #include "PxlsLogDB.h"
+#include "PxlsLogDBService.h"
+#include "PxlsProfiler.h"
+#include "PxlsKeyframeCache.h"
+#include "PxlsPrefetcher.h"
 
 class PxlsDialog {
 public:
@@ -60,11 +71,19 @@ private:
 class PxlsInfoPanel {
 public:
     PxlsInfoPanel(unsigned window_w, unsigned window_h);
-    // render info panel using raylib and raygui
-    void Render(const PxlsCanvas &canvas);
+    // render info panel using raylib and raygui, the stale metadata of the hovered pixel is restored from the logdb
+    // by the service thread without blocking the gui
+    void Render(const PxlsCanvas &canvas, const PxlsLogDB &db, PxlsLogDBService &db_service);
+    // is the pixel metadata shown
+    [[nodiscard]] bool IsExpanded() const { return is_expanded; }
 private:
     // is panel expanded
     bool is_expanded = false;
+    // metadata restored for the hovered pixel, keyed by its position and the record id it is restored at
+    std::optional<std::tuple<unsigned, unsigned, unsigned long>> restored_key { std::nullopt };
+    PxlsCanvasPixel restored_pixel;
+    // pending lookup of the hovered pixel
+    std::future<std::optional<PxlsLogRecord>> restored_future;
     // window dimension
     unsigned window_width { 0 }, window_height { 0 };
     // the dimension of normal panel
@@ -87,40 +106,120 @@ private:
 };
 
 enum PlaybackState { PLAY, PAUSE };
+// records played per second, or canvas time played per second relative to real time
+enum PlaybackSpeedUnit { RECORDS_PER_SECOND, CANVAS_TIME_SCALE };
 using PlaybackCallback = std::function<void (unsigned pb_head)>;
 
 class PxlsPlaybackPanel {
 public:
     PxlsPlaybackPanel(unsigned window_w, unsigned window_h);
-    // render playback panel using raylib and raygui and perform playback operation
-    void Render(PxlsLogDB &db, PxlsCanvas &canvas);
+    // render playback panel using raylib and raygui and perform playback operation,
+    // frame_start_time is the time the current frame begins, which limits the time spent on playback
+    void Render(PxlsLogDB &db, PxlsCanvas &canvas, double frame_start_time);
     // check if the canvas is updating by checking canvas_future
     [[nodiscard]] bool IsCanvasUpdating() const {
         return canvas_future.valid() &&
             canvas_future.wait_for(std::chrono::seconds(0)) == std::future_status::timeout;
     }
     bool InitPlayback(const PxlsLogDB &db);
+    // load nearest snapshot or cached keyframe of the target playback head
+    void JumpToNearestSnapshot(unsigned pb_head, PxlsLogDB &db, PxlsCanvas &canvas);
+    // set memory budget of the keyframe cache in bytes
+    void CacheBudget(const std::size_t budget_bytes) { keyframe_cache.Budget(budget_bytes); }
+    // stop prefetching, which must be done before the logdb is closed or reopened
+    void StopPrefetch() { prefetcher.Stop(); playing_page = std::nullopt; }
+    // set region of interest, only the records inside the region are replayed afterward
+    bool Region(const std::optional<PxlsRegion> &r, PxlsLogDB &db, PxlsCanvas &canvas);
+    [[nodiscard]] const auto& Region() const { return region; }
+    // set action filter, only the records selected by it are replayed afterward. the records it selects are found in
+    // the background like updating the canvas, and the filter is applied once they are ready. return false if the
+    // columnar sidecar doesn't cover all records, which has the action bitmaps the filter relies on
+    bool Filter(const std::optional<PxlsActionFilter> &f, PxlsLogDB &db, PxlsCanvas &canvas);
+    [[nodiscard]] const auto& Filter() const { return filter; }
+    // append new records of the source pxls log in the background, return false if it can't be started now.
+    // playback waits for it meanwhile, since it writes the logdb
+    bool Tail(PxlsLogDB &db);
+    // apply the records appended by the finished tail, the canvas grows with them and the playback head keeps up with
+    // them if it is pinned to the end. return true if there are any
+    bool FinishTail(PxlsLogDB &db, PxlsCanvas &canvas);
+    // wait for the tail and drop its result, which must be done before the logdb is closed or reopened
+    void StopTail() { if (tail_future.valid()) tail_future.get(); }
+    // check if the log is being followed by checking tail_future
+    [[nodiscard]] bool IsTailing() const {
+        return tail_future.valid() &&
+            tail_future.wait_for(std::chrono::seconds(0)) == std::future_status::timeout;
+    }
     // dialog tokens
     static constexpr unsigned PLAYBACK_SPEED_TOKEN { 0 };
     static constexpr unsigned PLAYBACK_HEAD_TOKEN { 1 };
     static constexpr unsigned CANVAS_FUTURE_TOKEN { 2 };
+    // acquired when filtering fails, the message box is left to the caller since the panel may be hidden
+    static constexpr unsigned FILTER_FAILURE_TOKEN { 12 };
 private:
+    // a filter whose selected records and snapshot corrections are being found by canvas_future
+    struct PendingFilter {
+        PxlsActionFilter filter;
+        PxlsRecordBitmap bitmap;
+        PxlsFilterCorrectionDeltas corrections;
+        bool ready { false };
+    };
+    // replace the filter and rebuild the canvas under it
+    void ApplyFilter(std::optional<PxlsActionFilter> &&f, PxlsRecordBitmap &&bitmap, PxlsFilterCorrectionDeltas &&corrections,
+                     PxlsLogDB &db, PxlsCanvas &canvas);
     // update canvas according to playback head
     void UpdateCanvas(unsigned pb_head, PxlsLogDB &db, PxlsCanvas &canvas);
-    // load nearest snapshot of the target playback head
-    void JumpToNearestSnapshot(unsigned pb_head, PxlsLogDB &db, PxlsCanvas &canvas) const;
+    // replay records from the current id of logdb to dest_id without jumping to snapshots,
+    // progress is called with the number of records replayed by each step
+    void Replay(unsigned long dest_id, PxlsLogDB &db, PxlsCanvas &canvas, const std::function<void (unsigned long)> &progress = nullptr);
+    // advance playback to the position scheduled by the playback speed, within the time budget of the frame
+    void SchedulePlayback(PxlsLogDB &db, PxlsCanvas &canvas, double frame_start_time);
+    // the position in playback speed unit at the current id of logdb
+    [[nodiscard]] double SchedulePosition(const PxlsLogDB &db) const;
+    // the record id reached at the scheduled position, which never moves against the playback direction
+    [[nodiscard]] unsigned long ScheduleTarget(const PxlsLogDB &db) const;
+    // replay towards dest_id using the records decoded by the prefetcher, return false if they are unavailable
+    bool PlayPrefetched(unsigned long dest_id, PxlsLogDB &db, PxlsCanvas &canvas);
     // window dimension
     unsigned window_width { 0 }, window_height { 0 };
     // playback state
     PlaybackState playback_state { PAUSE };
     // playback head
     unsigned long playback_head { 0 };
-    // playback speed
-    int playback_speed { 100 };
+    // playback speed, which is signed and measured in speed_unit
+    double playback_speed { DEFAULT_PLAYBACK_SPEED };
+    PlaybackSpeedUnit speed_unit { RECORDS_PER_SECOND };
+    // the position playback should have reached, in records or canvas epoch milliseconds according to speed_unit
+    double scheduled_position { 0.0 };
+    // current id of logdb after the last scheduled frame, the schedule restarts if it is changed by seeking
+    std::optional<unsigned long> scheduled_id { std::nullopt };
+    // measured replay throughput in records per second
+    double replay_rate { 0.0 };
+    // region of interest
+    std::optional<PxlsRegion> region { std::nullopt };
+    // action filter, the ids of the records it selects and the corrections of snapshots under it
+    std::optional<PxlsActionFilter> filter { std::nullopt };
+    PxlsRecordBitmap filter_bitmap;
+    PxlsFilterCorrectionDeltas filter_corrections;
+    // only accessed by canvas_future until it is ready
+    std::optional<PendingFilter> pending_filter { std::nullopt };
     // snapshot id list
     std::vector<unsigned long> snapshot_ids;
+    // decoded snapshots and canvas states visited by seeking
+    PxlsKeyframeCache keyframe_cache;
+    // decode upcoming records and keyframes in the background while playing
+    PxlsPrefetcher prefetcher;
+    // the prefetched page being played, and the position of the next record to play in it
+    std::optional<PxlsPrefetchedPage> playing_page { std::nullopt };
+    std::size_t playing_batch { 0 }, playing_batch_offset { 0 };
+    // current id of logdb after playing the page, which the next part of it continues from
+    unsigned long playing_id { 0 };
     // the future of updating canvas
     std::future<void> canvas_future;
+    // the future of following the log, which yields the number of appended records
+    std::future<unsigned long> tail_future;
+    // dimension and record count of logdb when the tail started
+    unsigned tail_width { 0 }, tail_height { 0 };
+    unsigned long tail_record_count { 0 };
     // progress shown while updating canvas
     unsigned long update_progress { 0 };
     unsigned long update_progress_total { 0 };
@@ -139,6 +238,73 @@ private:
     static constexpr float CONTROL_GAP { 5.0f };
     // the threshold of absolute id difference that should be reached before using async method
     static constexpr unsigned ASYNC_PROCESS_THRESHOLD { 70000 };
+    // the minimum number of records replayed by a seek before caching the canvas state it reaches
+    static constexpr unsigned CACHE_SEEK_THRESHOLD { 20000 };
+    // default playback speed in records per second
+    static constexpr double DEFAULT_PLAYBACK_SPEED { 6000.0 };
+    // maximum absolute playback speed of each unit
+    static constexpr double MAX_RECORDS_PER_SECOND { 1e9 };
+    static constexpr double MAX_CANVAS_TIME_SCALE { 1e7 };
+    // frame time at the target fps, and the part of its remaining time spent on playback
+    static constexpr double TARGET_FRAME_TIME { 1.0 / 60 };
+    static constexpr double PLAYBACK_BUDGET_RATIO { 0.75 };
+    // the minimum time spent on playback per frame, so that playback proceeds even when frames are slow
+    static constexpr double MIN_PLAYBACK_BUDGET { 0.002 };
+    // elapsed time of a frame is capped, so that a stalled frame doesn't make playback leap
+    static constexpr double MAX_FRAME_ELAPSED { 0.25 };
+    // number of records replayed between checking the time budget, which is also the page size of prefetching
+    static constexpr unsigned PLAYBACK_CHUNK_SIZE { 4096 };
+};
+
+class PxlsProfilerOverlay {
+public:
+    PxlsProfilerOverlay(unsigned window_w, unsigned window_h);
+    // render profiler statistics of hot paths using raylib and raygui, pass nullptr if the logdb is unavailable
+    void Render(const PxlsLogDB *db);
+private:
+    // window dimension
+    unsigned window_width { 0 }, window_height { 0 };
+    // totals at the beginning of the current sampling interval
+    std::array<PxlsProfileTotals, PxlsProfiler::ZONE_COUNT> interval_totals {};
+    double interval_start { 0.0 };
+    // rates calculated in the last sampling interval
+    double records_per_second { 0.0 };
+    std::array<double, PxlsProfiler::ZONE_COUNT> zone_ms_per_second {};
+    // the dimension of panel
+    static constexpr Vector2 DIMENSION { 260.0f, 236.0f };
+    // the margin and padding of panel
+    static constexpr float RIGHT_MARGIN { 10.0f };
+    static constexpr float TOP_MARGIN { 10.0f };
+    static constexpr float PADDING { 5.0f };
+    // rates are calculated over this interval in seconds
+    static constexpr double SAMPLING_INTERVAL { 1.0 };
+};
+
+class PxlsStatsPanel {
+public:
+    PxlsStatsPanel(unsigned window_w, unsigned window_h);
+    // render color populations at the playback head and placements of the hovered user using raylib and raygui,
+    // which are queried by the service thread from the statistics of the logdb
+    void Render(const PxlsCanvas &canvas, const PxlsLogDB &db, PxlsLogDBService &db_service);
+private:
+    // window dimension
+    unsigned window_width { 0 }, window_height { 0 };
+    // color populations at the record id they are queried at
+    std::optional<unsigned long> population_id { std::nullopt };
+    std::vector<unsigned long> population;
+    std::future<std::optional<std::vector<unsigned long>>> population_future;
+    // placements of the hovered user, keyed by its hash id and the record id they are queried at
+    std::optional<std::pair<std::uint32_t, unsigned long>> user_key { std::nullopt };
+    std::optional<unsigned long> user_placed { std::nullopt }, user_total { std::nullopt };
+    std::future<std::optional<unsigned long>> user_placed_future, user_total_future;
+    // the dimension of panel
+    static constexpr Vector2 DIMENSION { 260.0f, 170.0f };
+    // the margin and padding of panel
+    static constexpr float RIGHT_MARGIN { 10.0f };
+    static constexpr float BOTTOM_MARGIN { 40.0f };
+    static constexpr float PADDING { 5.0f };
+    // the number of most populous colors shown
+    static constexpr unsigned TOP_COLOR_COUNT { 6 };
 };
 
 struct ToolbarItem {
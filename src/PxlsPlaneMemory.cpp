@@ -0,0 +1,159 @@
+//
+// PxlsPlaneMemory implementation
+//
+
+#include "PxlsPlaneMemory.h"
+#include <filesystem>
+#include <fstream>
+#include <format>
+#include <random>
+#include <cstdlib>
+#include <optional>
+#include <boost/interprocess/file_mapping.hpp>
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#endif
+namespace bip = boost::interprocess;
+
+std::mutex PxlsPlaneMemory::mutex;
+std::string PxlsPlaneMemory::scratch_dir;
+std::size_t PxlsPlaneMemory::resident_budget { 0 };
+std::size_t PxlsPlaneMemory::plane_bytes { 0 };
+std::size_t PxlsPlaneMemory::mapped_bytes { 0 };
+std::map<const void*, PxlsPlaneMemory::Mapping> PxlsPlaneMemory::mappings;
+unsigned long PxlsPlaneMemory::scratch_count { 0 };
+
+void PxlsPlaneMemory::Configure(const std::string &dir, const std::size_t budget) {
+    std::error_code ec;
+    if (!dir.empty())
+        std::filesystem::create_directories(dir, ec);
+    std::lock_guard lock(mutex);
+    scratch_dir = dir;
+    resident_budget = budget;
+}
+
+std::string PxlsPlaneMemory::DefaultScratchDir() {
+    const auto Env = [](const char *name) -> std::optional<std::filesystem::path> {
+        if (const char *value = std::getenv(name); value && *value) return value;
+        return std::nullopt;
+    };
+    if (const auto dir = Env("PXLS_SCRATCH_DIR")) return dir->string();
+    // XDG_CACHE_HOME, or its default on linux and macos, or the local app data on windows
+    std::filesystem::path cache_dir;
+    if (const auto dir = Env("XDG_CACHE_HOME"))
+        cache_dir = *dir;
+    else if (const auto home = Env("HOME"))
+        cache_dir = *home / ".cache";
+    else if (const auto local_app_data = Env("LOCALAPPDATA"))
+        cache_dir = *local_app_data;
+    else
+        return std::filesystem::temp_directory_path().string();
+    return (cache_dir / "pxls-canvas-viewer").string();
+}
+
+bool PxlsPlaneMemory::Enabled() {
+    std::lock_guard lock(mutex);
+    return resident_budget != 0 && !scratch_dir.empty();
+}
+
+std::size_t PxlsPlaneMemory::ResidentBudget() {
+    std::lock_guard lock(mutex);
+    return resident_budget;
+}
+
+void* PxlsPlaneMemory::Allocate(const std::size_t bytes) {
+    {
+        std::lock_guard lock(mutex);
+        plane_bytes += bytes;
+        if (resident_budget != 0 && !scratch_dir.empty() && bytes >= MIN_MAPPED_BYTES && plane_bytes > resident_budget) {
+            if (void *ptr = Map(bytes)) return ptr;
+        }
+    }
+    try {
+        return ::operator new(bytes);
+    } catch (std::bad_alloc&) {
+        std::lock_guard lock(mutex);
+        plane_bytes -= bytes;
+        throw;
+    }
+}
+
+void* PxlsPlaneMemory::Map(const std::size_t bytes) {
+    // scratch files of other processes may lie in the same directory, so a random tag is added to the name
+    static const auto process_tag = std::random_device {}();
+    const auto path = (std::filesystem::path(scratch_dir) /
+                       std::format("pxls-plane-{:08x}-{}.tmp", process_tag, scratch_count++)).string();
+    Mapping mapping { bytes, path, nullptr };
+    std::error_code ec;
+    try {
+        std::ofstream(path, std::ios::binary | std::ios::trunc).close();
+        std::filesystem::resize_file(path, bytes);
+        bip::file_mapping file(path.c_str(), bip::read_write);
+        mapping.region = std::make_unique<bip::mapped_region>(file, bip::read_write, 0, bytes);
+    } catch (bip::interprocess_exception&) {
+        std::filesystem::remove(path, ec);
+        return nullptr;
+    } catch (std::filesystem::filesystem_error&) {
+        std::filesystem::remove(path, ec);
+        return nullptr;
+    }
+    // the mapping keeps the file alive, so nothing is left behind if the process exits abnormally
+    if (std::filesystem::remove(path, ec))
+        mapping.path.clear();
+    void *ptr = mapping.region->get_address();
+    mapped_bytes += bytes;
+    mappings.emplace(ptr, std::move(mapping));
+    return ptr;
+}
+
+void PxlsPlaneMemory::Free(void *ptr, const std::size_t bytes) {
+    std::unique_lock lock(mutex);
+    plane_bytes -= bytes;
+    const auto it = mappings.find(ptr);
+    if (it == mappings.end()) {
+        lock.unlock();
+        ::operator delete(ptr);
+        return;
+    }
+    mapped_bytes -= it->second.bytes;
+    const auto path = it->second.path;
+    mappings.erase(it);
+    if (!path.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+    }
+}
+
+bool PxlsPlaneMemory::IsMapped(const void *ptr) {
+    std::lock_guard lock(mutex);
+    auto it = mappings.upper_bound(ptr);
+    if (it == mappings.begin()) return false;
+    --it;
+    return static_cast<const char*>(ptr) < static_cast<const char*>(it->first) + it->second.bytes;
+}
+
+void PxlsPlaneMemory::Evict(const void *ptr, const std::size_t bytes) {
+#if __has_include(<sys/mman.h>)
+    if (bytes == 0 || !IsMapped(ptr)) return;
+    // only whole pages inside the range are dropped, the pages shared with the rest of the plane are kept
+    const auto page_size = bip::mapped_region::get_page_size();
+    const auto begin = (reinterpret_cast<std::uintptr_t>(ptr) + page_size - 1) / page_size * page_size;
+    const auto end = (reinterpret_cast<std::uintptr_t>(ptr) + bytes) / page_size * page_size;
+    // the mapping is shared with the scratch file, so dropping pages doesn't lose their contents
+    if (begin < end)
+        madvise(reinterpret_cast<void*>(begin), end - begin, MADV_DONTNEED);
+#else
+    // the OS trims the working set of file-backed pages by itself
+    (void)ptr; (void)bytes;
+#endif
+}
+
+std::size_t PxlsPlaneMemory::PlaneBytes() {
+    std::lock_guard lock(mutex);
+    return plane_bytes;
+}
+
+std::size_t PxlsPlaneMemory::MappedBytes() {
+    std::lock_guard lock(mutex);
+    return mapped_bytes;
+}
@@ -0,0 +1,78 @@
+//
+// Provide an allocator for canvas planes, which backs large planes with memory-mapped scratch files once the planes
+// exceed a resident budget, so that their pages can be evicted by the OS instead of exhausting memory
+//
+
+#ifndef PXLSPLANEMEMORY_H
+#define PXLSPLANEMEMORY_H
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <boost/interprocess/mapped_region.hpp>
+
+class PxlsPlaneMemory {
+public:
+    // back the planes allocated after the live planes exceed resident_budget bytes with scratch files in scratch_dir,
+    // which is created if missing. a budget of 0 disables it, and the planes allocated before are kept where they are
+    static void Configure(const std::string &scratch_dir, std::size_t resident_budget);
+    // PXLS_SCRATCH_DIR if set, otherwise a directory in the user cache directory. the temporary directory is avoided
+    // since it is often tmpfs, whose pages are backed by memory and swap like the heap
+    [[nodiscard]] static std::string DefaultScratchDir();
+    [[nodiscard]] static bool Enabled();
+    [[nodiscard]] static std::size_t ResidentBudget();
+    // allocate bytes for a plane, which is mapped from a scratch file if it is large enough and the planes exceed the
+    // budget. falls back to the heap if the scratch file can't be mapped
+    static void* Allocate(std::size_t bytes);
+    static void Free(void *ptr, std::size_t bytes);
+    // is the memory inside a plane mapped from a scratch file
+    [[nodiscard]] static bool IsMapped(const void *ptr);
+    // drop the resident pages inside [ptr, ptr + bytes) of a mapped plane, they are read back from the scratch file
+    // when touched again. the memory of heap planes is left untouched
+    static void Evict(const void *ptr, std::size_t bytes);
+    // bytes of the live planes, and the ones mapped from scratch files
+    [[nodiscard]] static std::size_t PlaneBytes();
+    [[nodiscard]] static std::size_t MappedBytes();
+    // planes smaller than this are always allocated on the heap
+    static constexpr std::size_t MIN_MAPPED_BYTES { 1 << 20 };
+    // resident budget used by the viewer, which is enough for several states of a 2000x2000 canvas
+    static constexpr std::size_t DEFAULT_RESIDENT_BUDGET { 1ull << 30 };
+private:
+    struct Mapping {
+        std::size_t bytes { 0 };
+        // the scratch file is removed once mapped if the OS permits, otherwise when it is unmapped
+        std::string path;
+        std::unique_ptr<boost::interprocess::mapped_region> region;
+    };
+    // create a scratch file of bytes and map it, return nullptr if it fails. the mutex must be held
+    static void* Map(std::size_t bytes);
+    static std::mutex mutex;
+    static std::string scratch_dir;
+    static std::size_t resident_budget;
+    static std::size_t plane_bytes, mapped_bytes;
+    // mapped planes by address
+    static std::map<const void*, Mapping> mappings;
+    // number of scratch files created, used for naming them
+    static unsigned long scratch_count;
+};
+
+// stateless allocator of canvas planes, so that planes can be moved between canvases and canvas states
+template <typename T>
+struct PxlsPlaneAllocator {
+    using value_type = T;
+    PxlsPlaneAllocator() = default;
+    template <typename U>
+    PxlsPlaneAllocator(const PxlsPlaneAllocator<U>&) {}
+    T* allocate(const std::size_t n) { return static_cast<T*>(PxlsPlaneMemory::Allocate(n * sizeof(T))); }
+    void deallocate(T *ptr, const std::size_t n) { PxlsPlaneMemory::Free(ptr, n * sizeof(T)); }
+    template <typename U>
+    bool operator==(const PxlsPlaneAllocator<U>&) const { return true; }
+};
+
+// a canvas plane indexed by y * width + x
+template <typename T>
+using PxlsPlane = std::vector<T, PxlsPlaneAllocator<T>>;
+
+#endif //PXLSPLANEMEMORY_H
@@ -0,0 +1,131 @@
+//
+// PxlsPrefetcher implementation
+//
+
+#include "PxlsPrefetcher.h"
+
+void PxlsPrefetchedBatch::Assign(const PxlsRecordBatch &batch) {
+    direction = batch.direction;
+    x.assign(batch.x, batch.x + batch.count);
+    y.assign(batch.y, batch.y + batch.count);
+    color_index.assign(batch.color_index, batch.color_index + batch.count);
+    action_id.assign(batch.action_id, batch.action_id + batch.count);
+    user_id.assign(batch.user_id, batch.user_id + batch.count);
+    time.assign(batch.time, batch.time + batch.count);
+    if (batch.has_prev)
+        has_prev.assign(batch.has_prev, batch.has_prev + batch.count);
+    else
+        has_prev.clear();
+}
+
+PxlsRecordBatch PxlsPrefetchedBatch::View() const {
+    PxlsRecordBatch batch;
+    batch.direction = direction;
+    batch.count = x.size();
+    batch.x = x.data(); batch.y = y.data();
+    batch.color_index = color_index.data(); batch.action_id = action_id.data();
+    batch.user_id = user_id.data(); batch.time = time.data();
+    batch.has_prev = has_prev.empty() ? nullptr : has_prev.data();
+    return batch;
+}
+
+bool PxlsPrefetcher::Start(const PxlsLogDB &db, const unsigned long from_id, const long long step,
+                           const std::vector<unsigned long> &snapshot_ids) {
+    Stop();
+    if (!db.HasColumns() || step == 0 || from_id > db.Columns().RecordCount()) return false;
+    stop_flag = false;
+    finished = false;
+    page_step = step;
+    next_take_id = from_id;
+    worker = std::thread(&PxlsPrefetcher::Work, this, std::cref(db), from_id, db.Width(), db.Height(), snapshot_ids);
+    return true;
+}
+
+void PxlsPrefetcher::Stop() {
+    if (worker.joinable()) {
+        {
+            std::lock_guard lock(mutex);
+            stop_flag = true;
+        }
+        cv.notify_all();
+        worker.join();
+    }
+    ring.clear();
+    keyframe = std::nullopt;
+    page_step = 0;
+}
+
+std::optional<PxlsPrefetchedPage> PxlsPrefetcher::Take(const unsigned long from_id) {
+    if (!IsRunning() || from_id != next_take_id) return std::nullopt;
+    std::unique_lock lock(mutex);
+    // the worker produces this page next, so waiting for it is never slower than querying synchronously
+    cv.wait(lock, [&] { return !ring.empty() || finished; });
+    if (ring.empty()) return std::nullopt;
+    auto page = std::move(ring.front());
+    ring.pop_front();
+    next_take_id = page.to_id;
+    lock.unlock();
+    cv.notify_all();
+    return page;
+}
+
+std::optional<std::pair<unsigned long, PxlsCanvasState>> PxlsPrefetcher::TakeKeyframe() {
+    std::lock_guard lock(mutex);
+    auto taken_keyframe = std::move(keyframe);
+    keyframe = std::nullopt;
+    return taken_keyframe;
+}
+
+void PxlsPrefetcher::Work(const PxlsLogDB &db, unsigned long from_id, const unsigned width, const unsigned height,
+                          std::vector<unsigned long> snapshot_ids) {
+    const auto &columns = db.Columns();
+    const auto record_count = columns.RecordCount();
+    const auto IsAhead = [&](const unsigned long id) { return page_step > 0 ? id > from_id : id < from_id; };
+    // snapshots are warmed in the order they will be reached
+    std::sort(snapshot_ids.begin(), snapshot_ids.end());
+    if (page_step < 0)
+        std::reverse(snapshot_ids.begin(), snapshot_ids.end());
+    auto next_snapshot = snapshot_ids.begin();
+    std::optional<unsigned long> warmed_id { std::nullopt };
+    std::unique_lock lock(mutex);
+    while (true) {
+        // only the first snapshot ahead of the prefetched pages is warmed
+        while (next_snapshot != snapshot_ids.end() && !IsAhead(*next_snapshot))
+            ++next_snapshot;
+        const auto CanWarm = [&] { return !keyframe && next_snapshot != snapshot_ids.end() && warmed_id != *next_snapshot; };
+        cv.wait(lock, [&] { return stop_flag || (!finished && ring.size() < RING_CAPACITY) || CanWarm(); });
+        if (stop_flag) return;
+        if (!finished && ring.size() < RING_CAPACITY) {
+            // reached the end of records
+            if (!IsAhead(page_step > 0 ? record_count : 0)) {
+                finished = true;
+                cv.notify_all();
+                continue;
+            }
+            lock.unlock();
+            PxlsPrefetchedPage page;
+            page.from_id = from_id;
+            page.to_id = static_cast<unsigned long>(std::clamp(static_cast<long long>(from_id) + page_step,
+                0ll, static_cast<long long>(record_count)));
+            columns.QueryBatches(page.from_id, page.to_id, [&](const PxlsRecordBatch &batch) {
+                page.batches.emplace_back().Assign(batch);
+            });
+            lock.lock();
+            from_id = page.to_id;
+            ring.push_back(std::move(page));
+            cv.notify_all();
+            continue;
+        }
+        // the ring is full, decode the next keyframe in the meantime
+        warmed_id = *next_snapshot;
+        lock.unlock();
+        PxlsCanvasState state;
+        state.width = width; state.height = height;
+        const bool decoded = db.QuerySnapshot(*warmed_id, [&](const std::size_t snapshot_bytes, const SnapshotReadCallback &read) {
+            return PxlsCanvas::DecodeSnapshot(snapshot_bytes, read, state);
+        });
+        lock.lock();
+        if (decoded)
+            keyframe = std::make_pair(*warmed_id, std::move(state));
+    }
+}
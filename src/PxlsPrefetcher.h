@@ -0,0 +1,75 @@
+//
+// Provide a background prefetcher that decodes upcoming record batches and keyframes during playback
+//
+
+#ifndef PXLSPREFETCHER_H
+#define PXLSPREFETCHER_H
+#include <vector>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cstdint>
+#include "PxlsLogDB.h"
+#include "PxlsCanvas.h"
+
+// a record batch owning its arrays, so that it outlives the query producing it
+struct PxlsPrefetchedBatch {
+    QueryDirection direction { FORWARD };
+    std::vector<std::uint16_t> x, y;
+    std::vector<std::uint8_t> color_index, action_id, has_prev;
+    std::vector<std::uint32_t> user_id;
+    std::vector<long long> time;
+    // copy arrays of a batch
+    void Assign(const PxlsRecordBatch &batch);
+    // view as a record batch, which is valid as long as the arrays are not changed
+    [[nodiscard]] PxlsRecordBatch View() const;
+};
+
+// records from from_id to to_id, which is the records played in a frame
+struct PxlsPrefetchedPage {
+    unsigned long from_id { 0 }, to_id { 0 };
+    std::vector<PxlsPrefetchedBatch> batches;
+};
+
+class PxlsPrefetcher {
+public:
+    PxlsPrefetcher() = default;
+    PxlsPrefetcher(const PxlsPrefetcher&) = delete;
+    PxlsPrefetcher& operator=(const PxlsPrefetcher&) = delete;
+    ~PxlsPrefetcher() { Stop(); }
+    // start decoding pages of step records from from_id using the columnar sidecar of the logdb,
+    // and warm the given snapshots in the direction of playback. the logdb must stay open until stopped
+    bool Start(const PxlsLogDB &db, unsigned long from_id, long long step, const std::vector<unsigned long> &snapshot_ids);
+    // stop the worker and drop everything prefetched
+    void Stop();
+    [[nodiscard]] bool IsRunning() const { return worker.joinable(); }
+    // step of the pages and the first record id of the next page to be taken
+    [[nodiscard]] long long Step() const { return page_step; }
+    [[nodiscard]] unsigned long NextId() const { return next_take_id; }
+    // take the next page, waiting for the worker if it is still decoding it. return nullopt if no page starts at from_id
+    std::optional<PxlsPrefetchedPage> Take(unsigned long from_id);
+    // take a keyframe decoded by the worker
+    std::optional<std::pair<unsigned long, PxlsCanvasState>> TakeKeyframe();
+    // maximum number of pages decoded ahead, which should cover the time of decoding a keyframe
+    static constexpr std::size_t RING_CAPACITY { 32 };
+private:
+    // decode pages and keyframes until stopped, the dimension is passed in since the logdb may grow meanwhile
+    void Work(const PxlsLogDB &db, unsigned long from_id, unsigned width, unsigned height, std::vector<unsigned long> snapshot_ids);
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stop_flag { false };
+    // whether the worker has reached the end of the records in the direction of playback
+    bool finished { false };
+    long long page_step { 0 };
+    unsigned long next_take_id { 0 };
+    // decoded pages, ordered by playback
+    std::deque<PxlsPrefetchedPage> ring;
+    std::optional<std::pair<unsigned long, PxlsCanvasState>> keyframe { std::nullopt };
+};
+
+#endif //PXLSPREFETCHER_H
@@ -0,0 +1,118 @@
+//
+// PxlsProfiler implementation
+//
+
+#include "PxlsProfiler.h"
+#include "nlohmann/json.hpp"
+using json = nlohmann::ordered_json;
+
+std::atomic<bool> PxlsProfiler::enabled { false };
+std::vector<std::shared_ptr<PxlsProfiler::ThreadData>> PxlsProfiler::threads;
+std::vector<PxlsProfiler::ThreadData*> PxlsProfiler::free_threads;
+std::mutex PxlsProfiler::threads_mutex;
+thread_local PxlsProfileScope *PxlsProfileScope::current_scope = nullptr;
+
+PxlsProfiler::ThreadLease::~ThreadLease() {
+    if (!data) return;
+    std::lock_guard lock(threads_mutex);
+    free_threads.push_back(data);
+}
+
+PxlsProfiler::ThreadData& PxlsProfiler::CurrentThreadData() {
+    thread_local ThreadLease lease;
+    if (!lease.data) {
+        std::lock_guard lock(threads_mutex);
+        // the events of the previous owner are kept, they are dumped under the same thread index
+        if (!free_threads.empty()) {
+            lease.data = free_threads.back();
+            free_threads.pop_back();
+        } else {
+            auto new_thread_data = std::make_shared<ThreadData>();
+            new_thread_data->thread_index = threads.size();
+            threads.push_back(new_thread_data);
+            lease.data = new_thread_data.get();
+        }
+    }
+    return *lease.data;
+}
+
+void PxlsProfiler::Record(const Zone zone, const std::uint64_t start_ns, const std::uint64_t duration_ns, const std::uint64_t self_ns,
+                          const std::uint64_t items) {
+    auto &thread_data = CurrentThreadData();
+    // only the owning thread writes, so relaxed load and store are enough
+    const auto Add = [](std::atomic<std::uint64_t> &counter, const std::uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    };
+    Add(thread_data.count[zone], 1);
+    Add(thread_data.total_ns[zone], self_ns);
+    Add(thread_data.items[zone], items);
+    thread_data.last_ns[zone].store(self_ns, std::memory_order_relaxed);
+    // append trace event to the ring, which keeps the whole duration since the trace viewer shows nested scopes itself
+    const auto event_index = thread_data.event_count.load(std::memory_order_relaxed);
+    auto &event = thread_data.events[event_index % TRACE_CAPACITY];
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_ns.store(duration_ns, std::memory_order_relaxed);
+    event.zone.store(zone, std::memory_order_relaxed);
+    thread_data.event_count.store(event_index + 1, std::memory_order_release);
+}
+
+std::array<PxlsProfileTotals, PxlsProfiler::ZONE_COUNT> PxlsProfiler::Totals() {
+    std::array<PxlsProfileTotals, ZONE_COUNT> totals {};
+    std::lock_guard lock(threads_mutex);
+    for (const auto &thread_data: threads) {
+        for (unsigned zone = 0; zone < ZONE_COUNT; zone++) {
+            totals[zone].count += thread_data->count[zone].load(std::memory_order_relaxed);
+            totals[zone].total_ns += thread_data->total_ns[zone].load(std::memory_order_relaxed);
+            totals[zone].items += thread_data->items[zone].load(std::memory_order_relaxed);
+            // use the latest one among all threads
+            if (const auto last_ns = thread_data->last_ns[zone].load(std::memory_order_relaxed); last_ns != 0)
+                totals[zone].last_ns = last_ns;
+        }
+    }
+    return totals;
+}
+
+bool PxlsProfiler::DumpChromeTrace(const std::string &filename) {
+    std::ofstream file(filename);
+    if (!file) return false;
+    json trace_events = json::array();
+    {
+        std::lock_guard lock(threads_mutex);
+        for (const auto &thread_data: threads) {
+            const auto event_count = thread_data->event_count.load(std::memory_order_acquire);
+            const auto first_event = event_count > TRACE_CAPACITY ? event_count - TRACE_CAPACITY : 0;
+            for (auto i = first_event; i < event_count; i++) {
+                const auto &event = thread_data->events[i % TRACE_CAPACITY];
+                // chrome trace uses microseconds
+                trace_events.push_back({
+                    { "name", ZoneName(static_cast<Zone>(event.zone.load(std::memory_order_relaxed))) },
+                    { "ph", "X" },
+                    { "ts", event.start_ns.load(std::memory_order_relaxed) / 1000.0 },
+                    { "dur", event.duration_ns.load(std::memory_order_relaxed) / 1000.0 },
+                    { "pid", 1 },
+                    { "tid", thread_data->thread_index }
+                });
+            }
+        }
+    }
+    json trace = json::object();
+    trace["traceEvents"] = trace_events;
+    trace["displayTimeUnit"] = "ms";
+    file << trace.dump();
+    return static_cast<bool>(file);
+}
+
+const char* PxlsProfiler::ZoneName(const Zone zone) {
+    switch (zone) {
+        case QUERY_RECORDS: return "QueryRecords";
+        case PERFORM_ACTION: return "PerformAction";
+        case LOAD_SNAPSHOT: return "LoadSnapshot";
+        case RENDER: return "Render";
+        case OPEN_LOG_INGEST: return "OpenLogRaw/ingest";
+        case OPEN_LOG_INSERT: return "OpenLogRaw/insert";
+        case OPEN_LOG_INDEX: return "OpenLogRaw/index";
+        case OPEN_LOG_COLUMNS: return "OpenLogRaw/columns";
+        case OPEN_LOG_STATS: return "OpenLogRaw/stats";
+        default: return "unknown";
+    }
+}
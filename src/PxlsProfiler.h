@@ -0,0 +1,116 @@
+//
+// Provide scoped timers and counters for hot paths, collected per thread without locking
+//
+
+#ifndef PXLSPROFILER_H
+#define PXLSPROFILER_H
+#include <array>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <fstream>
+#include <cstdint>
+
+// accumulated statistics of a profile zone, the times exclude the scopes nested inside it
+struct PxlsProfileTotals {
+    std::uint64_t count { 0 };
+    std::uint64_t total_ns { 0 };
+    std::uint64_t last_ns { 0 };
+    // number of items processed, e.g. records
+    std::uint64_t items { 0 };
+};
+
+class PxlsProfiler {
+public:
+    enum Zone {
+        QUERY_RECORDS, PERFORM_ACTION, LOAD_SNAPSHOT, RENDER,
+        OPEN_LOG_INGEST, OPEN_LOG_INSERT, OPEN_LOG_INDEX, OPEN_LOG_COLUMNS, OPEN_LOG_STATS,
+        ZONE_COUNT
+    };
+    // enable/disable profiling, scopes cost a single atomic load when disabled
+    static void Enabled(const bool enable) { enabled.store(enable, std::memory_order_relaxed); }
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+    // record a finished scope of the calling thread, self_ns is its duration excluding the nested scopes
+    static void Record(Zone zone, std::uint64_t start_ns, std::uint64_t duration_ns, std::uint64_t self_ns, std::uint64_t items);
+    // sum up the statistics of all threads
+    static std::array<PxlsProfileTotals, ZONE_COUNT> Totals();
+    // dump recorded scopes in chrome trace format
+    static bool DumpChromeTrace(const std::string &filename);
+    // get zone name
+    static const char* ZoneName(Zone zone);
+    // monotonic time in nanoseconds
+    static std::uint64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    // number of trace events kept per thread, older events are overwritten
+    static constexpr std::size_t TRACE_CAPACITY { 16384 };
+private:
+    struct TraceEvent {
+        std::atomic<std::uint64_t> start_ns { 0 };
+        std::atomic<std::uint64_t> duration_ns { 0 };
+        std::atomic<std::uint32_t> zone { 0 };
+    };
+    // statistics of a thread, only written by the owning thread
+    struct ThreadData {
+        unsigned thread_index { 0 };
+        std::array<std::atomic<std::uint64_t>, ZONE_COUNT> count {};
+        std::array<std::atomic<std::uint64_t>, ZONE_COUNT> total_ns {};
+        std::array<std::atomic<std::uint64_t>, ZONE_COUNT> last_ns {};
+        std::array<std::atomic<std::uint64_t>, ZONE_COUNT> items {};
+        std::array<TraceEvent, TRACE_CAPACITY> events {};
+        std::atomic<std::uint64_t> event_count { 0 };
+    };
+    // returns the data of the owning thread to the pool when the thread exits
+    struct ThreadLease {
+        ThreadData *data { nullptr };
+        ~ThreadLease();
+    };
+    // get the data of the calling thread, taking it from the pool or registering a new one on first use
+    static ThreadData& CurrentThreadData();
+    static std::atomic<bool> enabled;
+    // registered thread data, which outlives the threads so that their scopes can still be dumped
+    static std::vector<std::shared_ptr<ThreadData>> threads;
+    // data of the exited threads, reused by new threads so that short-lived ones don't allocate trace rings each
+    static std::vector<ThreadData*> free_threads;
+    static std::mutex threads_mutex;
+};
+
+// time the enclosing scope and record it into the profiler
+class PxlsProfileScope {
+public:
+    explicit PxlsProfileScope(const PxlsProfiler::Zone zone, const std::uint64_t items = 0)
+        : zone(zone), items(items), start_ns(PxlsProfiler::Enabled() ? PxlsProfiler::NowNs() : 0) {
+        if (start_ns != 0) {
+            parent = current_scope;
+            current_scope = this;
+        }
+    }
+    ~PxlsProfileScope() {
+        if (start_ns == 0) return;
+        const auto duration_ns = PxlsProfiler::NowNs() - start_ns;
+        current_scope = parent;
+        // the time of this scope belongs to the zone of this scope only, not to the enclosing one
+        if (parent)
+            parent->nested_ns += duration_ns;
+        PxlsProfiler::Record(zone, start_ns, duration_ns, duration_ns - std::min(nested_ns, duration_ns), items);
+    }
+    PxlsProfileScope(const PxlsProfileScope&) = delete;
+    PxlsProfileScope& operator=(const PxlsProfileScope&) = delete;
+    // add processed items
+    void AddItems(const std::uint64_t n) { items += n; }
+private:
+    PxlsProfiler::Zone zone;
+    std::uint64_t items;
+    std::uint64_t start_ns;
+    // time spent in the scopes nested inside this one
+    std::uint64_t nested_ns { 0 };
+    PxlsProfileScope *parent { nullptr };
+    // innermost running scope of the calling thread
+    static thread_local PxlsProfileScope *current_scope;
+};
+
+#endif //PXLSPROFILER_H
@@ -0,0 +1,259 @@
+//
+// PxlsRecordBitmap implementation
+//
+
+#include "PxlsRecordBitmap.h"
+#include <algorithm>
+#include <iterator>
+#include <bit>
+
+namespace {
+    constexpr std::uint32_t CONTAINER_BITS { 65536 };
+
+    // serialized header of a container, followed by its array or bitset padded to 8 bytes
+    struct SerializedContainer {
+        std::uint16_t key { 0 };
+        std::uint16_t is_bitset { 0 };
+        std::uint32_t cardinality { 0 };
+    };
+
+    std::size_t PaddedBytes(const std::size_t bytes) { return (bytes + 7) & ~std::size_t { 7 }; }
+
+    // find the first set bit at or after pos, or CONTAINER_BITS if there is none. invert finds clear bits instead
+    std::uint32_t NextBit(const std::vector<std::uint64_t> &bitset, const std::uint32_t pos, const bool invert) {
+        if (pos >= CONTAINER_BITS) return CONTAINER_BITS;
+        auto w = pos / 64;
+        auto word = (invert ? ~bitset[w] : bitset[w]) & (~0ull << (pos % 64));
+        while (word == 0) {
+            if (++w == bitset.size()) return CONTAINER_BITS;
+            word = invert ? ~bitset[w] : bitset[w];
+        }
+        return w * 64 + std::countr_zero(word);
+    }
+
+    // find the last set bit at or before pos, or -1 if there is none. invert finds clear bits instead
+    long PrevBit(const std::vector<std::uint64_t> &bitset, const long pos, const bool invert) {
+        if (pos < 0) return -1;
+        auto w = static_cast<std::size_t>(pos / 64);
+        const auto shift = pos % 64;
+        auto word = (invert ? ~bitset[w] : bitset[w]) & (shift == 63 ? ~0ull : (1ull << (shift + 1)) - 1);
+        while (word == 0) {
+            if (w-- == 0) return -1;
+            word = invert ? ~bitset[w] : bitset[w];
+        }
+        return static_cast<long>(w * 64 + 63 - std::countl_zero(word));
+    }
+}
+
+bool PxlsRecordBitmap::Container::Contains(const std::uint16_t low) const {
+    if (IsBitset()) return bitset[low / 64] >> (low % 64) & 1;
+    return std::binary_search(array.begin(), array.end(), low);
+}
+
+void PxlsRecordBitmap::Container::ToBitset() {
+    bitset.assign(BITSET_WORDS, 0);
+    for (const auto low: array)
+        bitset[low / 64] |= 1ull << (low % 64);
+    array.clear();
+    array.shrink_to_fit();
+}
+
+void PxlsRecordBitmap::Add(const std::uint32_t id) {
+    const auto key = static_cast<std::uint16_t>(id >> 16);
+    const auto low = static_cast<std::uint16_t>(id);
+    if (containers.empty() || containers.back().key != key)
+        containers.emplace_back(key);
+    auto &container = containers.back();
+    if (container.IsBitset()) {
+        if (container.Contains(low)) return;
+        container.bitset[low / 64] |= 1ull << (low % 64);
+    } else {
+        if (!container.array.empty() && container.array.back() >= low) return;
+        container.array.push_back(low);
+        if (container.array.size() > ARRAY_MAX_CARDINALITY)
+            container.ToBitset();
+    }
+    container.cardinality++;
+}
+
+void PxlsRecordBitmap::Union(const PxlsRecordBitmap &other) {
+    std::vector<Container> merged;
+    merged.reserve(containers.size() + other.containers.size());
+    auto it = containers.begin();
+    auto other_it = other.containers.begin();
+    while (it != containers.end() || other_it != other.containers.end()) {
+        if (other_it == other.containers.end() || (it != containers.end() && it->key < other_it->key)) {
+            merged.push_back(std::move(*it++));
+            continue;
+        }
+        if (it == containers.end() || other_it->key < it->key) {
+            merged.push_back(*other_it++);
+            continue;
+        }
+        // merge containers with the same key
+        Container container { it->key };
+        if (!it->IsBitset() && !other_it->IsBitset() && it->cardinality + other_it->cardinality <= ARRAY_MAX_CARDINALITY) {
+            std::ranges::set_union(it->array, other_it->array, std::back_inserter(container.array));
+            container.cardinality = container.array.size();
+        } else {
+            container.array = it->array;
+            container.ToBitset();
+            const auto &other_container = *other_it;
+            if (other_container.IsBitset()) {
+                for (std::uint32_t w = 0; w < BITSET_WORDS; w++)
+                    container.bitset[w] |= other_container.bitset[w];
+            } else {
+                for (const auto low: other_container.array)
+                    container.bitset[low / 64] |= 1ull << (low % 64);
+            }
+            if (it->IsBitset()) {
+                for (std::uint32_t w = 0; w < BITSET_WORDS; w++)
+                    container.bitset[w] |= it->bitset[w];
+            }
+            for (const auto word: container.bitset)
+                container.cardinality += std::popcount(word);
+        }
+        merged.push_back(std::move(container));
+        ++it; ++other_it;
+    }
+    containers = std::move(merged);
+}
+
+const PxlsRecordBitmap::Container* PxlsRecordBitmap::Find(const std::uint16_t key) const {
+    const auto it = std::ranges::lower_bound(containers, key, {}, &Container::key);
+    return it != containers.end() && it->key == key ? &*it : nullptr;
+}
+
+bool PxlsRecordBitmap::Contains(const std::uint32_t id) const {
+    const auto *container = Find(static_cast<std::uint16_t>(id >> 16));
+    return container && container->Contains(static_cast<std::uint16_t>(id));
+}
+
+std::uint64_t PxlsRecordBitmap::Cardinality() const {
+    std::uint64_t cardinality = 0;
+    for (const auto &container: containers)
+        cardinality += container.cardinality;
+    return cardinality;
+}
+
+void PxlsRecordBitmap::ForEachRun(const std::uint32_t from_id, const std::uint32_t to_id, const bool reverse,
+                                  const RecordRunCallback &callback) const {
+    if (from_id >= to_id) return;
+    const std::uint32_t first_id = from_id + 1, last_id = to_id;
+    // runs spanning containers are merged before calling back
+    bool has_pending = false;
+    std::uint32_t pending_first = 0, pending_last = 0;
+    const auto Emit = [&](const std::uint32_t first, const std::uint32_t last) {
+        if (has_pending && (reverse ? last + 1 == pending_first : pending_last + 1 == first)) {
+            (reverse ? pending_first : pending_last) = reverse ? first : last;
+            return;
+        }
+        if (has_pending)
+            callback(pending_first, pending_last);
+        has_pending = true;
+        pending_first = first; pending_last = last;
+    };
+    const auto VisitContainer = [&](const Container &container) {
+        const std::uint32_t base = static_cast<std::uint32_t>(container.key) << 16;
+        // bounds of the low 16 bits inside the range
+        const std::uint32_t low_begin = first_id > base ? first_id - base : 0;
+        const std::uint32_t low_end = std::min<std::uint64_t>(static_cast<std::uint64_t>(last_id) - base, CONTAINER_BITS - 1);
+        if (container.IsBitset()) {
+            if (!reverse) {
+                for (auto pos = NextBit(container.bitset, low_begin, false); pos <= low_end;) {
+                    const auto end = NextBit(container.bitset, pos, true);
+                    Emit(base + pos, base + std::min(end - 1, low_end));
+                    pos = NextBit(container.bitset, end, false);
+                }
+            } else {
+                for (auto pos = PrevBit(container.bitset, low_end, false); pos >= static_cast<long>(low_begin);) {
+                    const auto begin = PrevBit(container.bitset, pos, true);
+                    Emit(base + static_cast<std::uint32_t>(std::max<long>(begin + 1, low_begin)), base + static_cast<std::uint32_t>(pos));
+                    pos = PrevBit(container.bitset, begin, false);
+                }
+            }
+            return;
+        }
+        const auto &array = container.array;
+        const auto begin = std::lower_bound(array.begin(), array.end(), low_begin) - array.begin();
+        const auto end = std::upper_bound(array.begin(), array.end(), low_end) - array.begin();
+        if (!reverse) {
+            for (auto i = begin; i < end;) {
+                auto j = i;
+                while (j + 1 < end && array[j + 1] == array[j] + 1) j++;
+                Emit(base + array[i], base + array[j]);
+                i = j + 1;
+            }
+        } else {
+            for (auto i = end - 1; i >= begin;) {
+                auto j = i;
+                while (j - 1 >= begin && array[j - 1] + 1 == array[j]) j--;
+                Emit(base + array[j], base + array[i]);
+                i = j - 1;
+            }
+        }
+    };
+    const auto first_key = static_cast<std::uint16_t>(first_id >> 16), last_key = static_cast<std::uint16_t>(last_id >> 16);
+    const auto begin = std::ranges::lower_bound(containers, first_key, {}, &Container::key);
+    const auto end = std::ranges::upper_bound(containers, last_key, {}, &Container::key);
+    if (!reverse) {
+        for (auto it = begin; it != end; ++it)
+            VisitContainer(*it);
+    } else {
+        for (auto it = end; it != begin;)
+            VisitContainer(*--it);
+    }
+    if (has_pending)
+        callback(pending_first, pending_last);
+}
+
+void PxlsRecordBitmap::Serialize(std::vector<char> &bytes) const {
+    const auto Append = [&](const void *data, const std::size_t size) {
+        const auto offset = bytes.size();
+        bytes.resize(offset + PaddedBytes(size));
+        std::memcpy(bytes.data() + offset, data, size);
+    };
+    const std::uint64_t container_count = containers.size();
+    Append(&container_count, sizeof(container_count));
+    for (const auto &container: containers) {
+        const SerializedContainer header { container.key, container.IsBitset(), container.cardinality };
+        Append(&header, sizeof(header));
+        if (container.IsBitset())
+            Append(container.bitset.data(), container.bitset.size() * sizeof(std::uint64_t));
+        else
+            Append(container.array.data(), container.array.size() * sizeof(std::uint16_t));
+    }
+}
+
+bool PxlsRecordBitmap::Deserialize(const char *data, const std::size_t bytes) {
+    containers.clear();
+    std::size_t offset = 0;
+    const auto Read = [&](void *dest, const std::size_t size) {
+        if (offset + size > bytes) return false;
+        std::memcpy(dest, data + offset, size);
+        offset += PaddedBytes(size);
+        return true;
+    };
+    std::uint64_t container_count;
+    if (!Read(&container_count, sizeof(container_count)) || container_count > CONTAINER_BITS) return false;
+    std::vector<Container> new_containers(container_count);
+    for (auto &container: new_containers) {
+        SerializedContainer header;
+        if (!Read(&header, sizeof(header)) || header.cardinality == 0 || header.cardinality > CONTAINER_BITS ||
+            (&container != new_containers.data() && header.key <= (&container - 1)->key))
+            return false;
+        container.key = header.key;
+        container.cardinality = header.cardinality;
+        if (header.is_bitset) {
+            container.bitset.resize(BITSET_WORDS);
+            if (!Read(container.bitset.data(), BITSET_WORDS * sizeof(std::uint64_t))) return false;
+        } else {
+            container.array.resize(header.cardinality);
+            if (!Read(container.array.data(), header.cardinality * sizeof(std::uint16_t)) ||
+                !std::ranges::is_sorted(container.array))
+                return false;
+        }
+    }
+    containers = std::move(new_containers);
+    return true;
+}
@@ -0,0 +1,53 @@
+//
+// Provide a roaring-style compressed bitmap of record ids, used for selecting records by action type
+//
+
+#ifndef PXLSRECORDBITMAP_H
+#define PXLSRECORDBITMAP_H
+#include <vector>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+
+// receives a run of consecutive ids from first to last inclusively
+using RecordRunCallback = std::function<void (std::uint32_t first, std::uint32_t last)>;
+
+class PxlsRecordBitmap {
+public:
+    // add an id, ids must be added in ascending order
+    void Add(std::uint32_t id);
+    // add all ids of another bitmap
+    void Union(const PxlsRecordBitmap &other);
+    [[nodiscard]] bool Contains(std::uint32_t id) const;
+    [[nodiscard]] std::uint64_t Cardinality() const;
+    [[nodiscard]] bool Empty() const { return containers.empty(); }
+    // call back with the maximal runs of ids in (from_id, to_id], in descending order if reverse is set
+    void ForEachRun(std::uint32_t from_id, std::uint32_t to_id, bool reverse, const RecordRunCallback &callback) const;
+    // append the serialized bitmap to bytes, which is 8-byte aligned if bytes is
+    void Serialize(std::vector<char> &bytes) const;
+    // restore a serialized bitmap, return false if it is malformed
+    bool Deserialize(const char *data, std::size_t bytes);
+    void Clear() { containers.clear(); }
+    // containers with more ids than this are stored as bitsets
+    static constexpr std::uint32_t ARRAY_MAX_CARDINALITY { 4096 };
+    static constexpr std::uint32_t BITSET_WORDS { 65536 / 64 };
+private:
+    // ids sharing the high 16 bits, the low 16 bits are stored in a sorted array if they are sparse, or a bitset otherwise
+    struct Container {
+        Container() = default;
+        explicit Container(const std::uint16_t container_key) : key(container_key) {}
+        std::uint16_t key { 0 };
+        std::uint32_t cardinality { 0 };
+        std::vector<std::uint16_t> array;
+        std::vector<std::uint64_t> bitset;
+        [[nodiscard]] bool IsBitset() const { return !bitset.empty(); }
+        [[nodiscard]] bool Contains(std::uint16_t low) const;
+        void ToBitset();
+    };
+    // find the container of the high 16 bits, return nullptr if there is none
+    [[nodiscard]] const Container* Find(std::uint16_t key) const;
+    // containers ordered by key
+    std::vector<Container> containers;
+};
+
+#endif //PXLSRECORDBITMAP_H
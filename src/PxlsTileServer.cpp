@@ -0,0 +1,374 @@
+//
+// PxlsTileServer implementation
+//
+
+#include "PxlsTileServer.h"
+#include <array>
+#include <optional>
+#include <charconv>
+#include <csignal>
+#include <format>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/signal_set.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+namespace net = boost::asio;
+namespace beast = boost::beast;
+namespace http = beast::http;
+using tcp = net::ip::tcp;
+
+namespace {
+    // parse a whole string as an unsigned number
+    template <typename T>
+    bool ParseNumber(const std::string_view str, T &value) {
+        const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+        return ec == std::errc {} && ptr == str.data() + str.size();
+    }
+
+    // a connection reading requests one at a time, which is kept alive as long as the client wants
+    class TileSession : public std::enable_shared_from_this<TileSession> {
+    public:
+        TileSession(tcp::socket &&socket, PxlsTileServer &tile_server) : stream(std::move(socket)), server(tile_server) {}
+        void Start() { Read(); }
+    private:
+        void Read() {
+            request = {};
+            http::async_read(stream, buffer, request, [self = shared_from_this()](const beast::error_code ec, std::size_t) {
+                if (ec) {
+                    beast::error_code ignored;
+                    self->stream.socket().shutdown(tcp::socket::shutdown_send, ignored);
+                    return;
+                }
+                self->Handle();
+            });
+        }
+        void Handle() {
+            if (request.method() != http::verb::get) {
+                Write(http::status::method_not_allowed, "text/plain", nullptr);
+                return;
+            }
+            // the response may be produced by a worker, so it is written on the thread of the connection
+            const auto target = request.target();
+            server.HandleRequest({ target.data(), target.size() }, [self = shared_from_this()](const http::status status, const std::string_view content_type,
+                                                                               std::shared_ptr<const std::string> body) {
+                net::post(self->stream.get_executor(), [self, status, content_type = std::string(content_type), body = std::move(body)] {
+                    self->Write(status, content_type, body);
+                });
+            });
+        }
+        void Write(const http::status status, const std::string_view content_type, const std::shared_ptr<const std::string> &body) {
+            auto response = std::make_shared<http::response<http::string_body>>(status, request.version());
+            response->set(http::field::content_type, std::string(content_type));
+            // dashboards on other origins fetch the tiles
+            response->set(http::field::access_control_allow_origin, "*");
+            if (body)
+                response->body() = *body;
+            response->keep_alive(request.keep_alive());
+            response->prepare_payload();
+            http::async_write(stream, *response, [self = shared_from_this(), response](const beast::error_code ec, std::size_t) {
+                if (ec || !response->keep_alive()) {
+                    beast::error_code ignored;
+                    self->stream.socket().shutdown(tcp::socket::shutdown_send, ignored);
+                    return;
+                }
+                self->Read();
+            });
+        }
+        beast::tcp_stream stream;
+        beast::flat_buffer buffer;
+        http::request<http::empty_body> request;
+        PxlsTileServer &server;
+    };
+
+    // accept connections until the io context is stopped
+    void Accept(tcp::acceptor &acceptor, PxlsTileServer &server) {
+        acceptor.async_accept([&acceptor, &server](const beast::error_code ec, tcp::socket socket) {
+            if (!ec)
+                std::make_shared<TileSession>(std::move(socket), server)->Start();
+            if (acceptor.is_open())
+                Accept(acceptor, server);
+        });
+    }
+}
+
+bool PxlsTileServer::Open(const std::string &logdb_filename, const std::string &palette_filename, const unsigned worker_count) {
+    Close();
+    if (worker_count == 0 || !index_db.OpenLogDB(logdb_filename, true)) return false;
+    width = index_db.Width(); height = index_db.Height();
+    if (width == 0 || height == 0 || !index_db.QuerySnapshotIdList(snapshot_ids)) {
+        index_db.CloseLogDB();
+        return false;
+    }
+    native_zoom = 0;
+    while ((static_cast<unsigned long long>(TILE_SIZE) << native_zoom) < std::max(width, height))
+        native_zoom++;
+    for (unsigned i = 0; i < worker_count; i++) {
+        auto worker = std::make_unique<Worker>();
+        // tiles only need colors, so the metadata of pixels isn't replayed
+        if (!worker->db.OpenLogDB(logdb_filename, true) || !worker->canvas.LoadPaletteFromJson(palette_filename) ||
+            !worker->canvas.InitCanvas(width, height, TILE_SIZE, TILE_SIZE)) {
+            Close();
+            return false;
+        }
+        worker->canvas.ColorOnly(true);
+        workers.push_back(std::move(worker));
+    }
+    stop_flag = false;
+    for (const auto &worker: workers)
+        worker->thread = std::thread(&PxlsTileServer::Work, this, std::ref(*worker));
+    return true;
+}
+
+void PxlsTileServer::Close() {
+    {
+        std::lock_guard lock(mutex);
+        stop_flag = true;
+    }
+    for (const auto &worker: workers) {
+        worker->cv.notify_all();
+        if (worker->thread.joinable())
+            worker->thread.join();
+        for (const auto &request: worker->requests)
+            request.on_tile(nullptr);
+    }
+    workers.clear();
+    index_db.CloseLogDB();
+    std::lock_guard lock(cache_mutex);
+    tiles.clear();
+    tile_lru.clear();
+    cache_usage = 0;
+}
+
+void PxlsTileServer::CacheBudget(const std::size_t budget_bytes) {
+    std::lock_guard lock(cache_mutex);
+    cache_budget = budget_bytes;
+    while (cache_usage > cache_budget && !tile_lru.empty()) {
+        const auto it = tiles.find(tile_lru.back());
+        cache_usage -= it->second.png->size();
+        tiles.erase(it);
+        tile_lru.pop_back();
+    }
+}
+
+bool PxlsTileServer::Run(const unsigned short port) {
+    if (workers.empty()) return false;
+    io_context.restart();
+    tcp::acceptor acceptor(io_context);
+    beast::error_code ec;
+    const tcp::endpoint endpoint { net::ip::address_v4::loopback(), port };
+    acceptor.open(endpoint.protocol(), ec);
+    if (!ec) acceptor.set_option(net::socket_base::reuse_address(true), ec);
+    if (!ec) acceptor.bind(endpoint, ec);
+    if (!ec) acceptor.listen(net::socket_base::max_listen_connections, ec);
+    if (ec) return false;
+    net::signal_set signals(io_context, SIGINT, SIGTERM);
+    signals.async_wait([&](const beast::error_code&, int) { io_context.stop(); });
+    Accept(acceptor, *this);
+    io_context.run();
+    return true;
+}
+
+void PxlsTileServer::RequestTile(const unsigned z, const unsigned x, const unsigned y, const unsigned long id, const TileCallback &on_tile) {
+    if (id > index_db.RecordCount() || !IsTileInRange(z, x, y)) {
+        on_tile(nullptr);
+        return;
+    }
+    if (auto png = CachedTileOf(std::format("{}/{}/{}/{}", z, x, y, id))) {
+        on_tile(std::move(png));
+        return;
+    }
+    std::unique_lock lock(mutex);
+    if (stop_flag) {
+        lock.unlock();
+        on_tile(nullptr);
+        return;
+    }
+    const auto Distance = [id](const unsigned long other_id) { return other_id > id ? other_id - id : id - other_id; };
+    // join the worker heading closest to the id, or spread the request to the least busy worker if all of them are far
+    Worker *picked = nullptr;
+    for (const auto &worker: workers) {
+        if (!picked || Distance(worker->heading_id) < Distance(picked->heading_id))
+            picked = worker.get();
+    }
+    if (Distance(picked->heading_id) > SHARE_DISTANCE) {
+        for (const auto &worker: workers) {
+            if (worker->requests.size() < picked->requests.size() ||
+                (worker->requests.size() == picked->requests.size() && Distance(worker->heading_id) < Distance(picked->heading_id)))
+                picked = worker.get();
+        }
+    }
+    picked->requests.push_back({ z, x, y, id, on_tile });
+    picked->heading_id = id;
+    picked->cv.notify_one();
+}
+
+void PxlsTileServer::HandleRequest(const std::string_view target, const ResponseCallback &respond) {
+    const auto query_pos = target.find('?');
+    const auto path = target.substr(0, query_pos);
+    auto query = query_pos == std::string_view::npos ? std::string_view {} : target.substr(query_pos + 1);
+    const auto Error = [&](const http::status status) {
+        respond(status, "text/plain", std::make_shared<const std::string>(http::obsolete_reason(status)));
+    };
+    if (path == "/info") {
+        json info = {
+            { "width", width }, { "height", height }, { "record_count", index_db.RecordCount() },
+            { "start_time", index_db.StartTime() }, { "end_time", index_db.EndTime() },
+            { "tile_size", TILE_SIZE }, { "native_zoom", native_zoom }, { "max_zoom", native_zoom + MAX_OVERZOOM }
+        };
+        respond(http::status::ok, "application/json", std::make_shared<const std::string>(info.dump()));
+        return;
+    }
+    // /tile/{z}/{x}/{y}
+    constexpr std::string_view tile_prefix = "/tile/";
+    if (!path.starts_with(tile_prefix)) {
+        Error(http::status::not_found);
+        return;
+    }
+    std::array<unsigned, 3> zxy {};
+    auto rest = path.substr(tile_prefix.size());
+    for (std::size_t i = 0; i < zxy.size(); i++) {
+        const auto slash_pos = rest.find('/');
+        if ((slash_pos == std::string_view::npos) != (i == zxy.size() - 1) || !ParseNumber(rest.substr(0, slash_pos), zxy[i])) {
+            Error(http::status::bad_request);
+            return;
+        }
+        rest = slash_pos == std::string_view::npos ? std::string_view {} : rest.substr(slash_pos + 1);
+    }
+    // ?id= or ?t=, the last one wins if both are given
+    std::optional<unsigned long> id;
+    while (!query.empty()) {
+        const auto amp_pos = query.find('&');
+        const auto param = query.substr(0, amp_pos);
+        query.remove_prefix(amp_pos == std::string_view::npos ? query.size() : amp_pos + 1);
+        unsigned long id_value;
+        long long time;
+        if (param.starts_with("id=") && ParseNumber(param.substr(3), id_value))
+            id = id_value;
+        else if (param.starts_with("t=") && std::from_chars(param.data() + 2, param.data() + param.size(), time).ec == std::errc {})
+            id = index_db.FindRecordByTime(time);
+    }
+    if (!id) {
+        Error(http::status::bad_request);
+        return;
+    }
+    RequestTile(zxy[0], zxy[1], zxy[2], *id, [respond](std::shared_ptr<const std::string> png) {
+        if (png)
+            respond(http::status::ok, "image/png", std::move(png));
+        else
+            respond(http::status::not_found, "text/plain", std::make_shared<const std::string>(http::obsolete_reason(http::status::not_found)));
+    });
+}
+
+void PxlsTileServer::Work(Worker &worker) {
+    std::unique_lock lock(mutex);
+    while (true) {
+        worker.cv.wait(lock, [&] { return stop_flag || !worker.requests.empty(); });
+        if (stop_flag) return;
+        auto requests = std::move(worker.requests);
+        worker.requests.clear();
+        lock.unlock();
+        // sweep through the ids in one direction, starting from the end closer to the canvas
+        std::ranges::stable_sort(requests, {}, &TileRequest::id);
+        const auto current_id = static_cast<long long>(worker.db.Seek());
+        if (std::abs(current_id - static_cast<long long>(requests.back().id)) < std::abs(current_id - static_cast<long long>(requests.front().id)))
+            std::ranges::reverse(requests);
+        for (const auto &request: requests) {
+            const auto key = std::format("{}/{}/{}/{}", request.z, request.x, request.y, request.id);
+            // the same tile may have been rendered after the request was queued
+            auto png = CachedTileOf(key);
+            if (!png) {
+                SeekWorker(worker, request.id);
+                png = EncodeTile(worker.canvas, request.z, request.x, request.y);
+                if (png)
+                    CacheTile(key, png);
+            }
+            request.on_tile(std::move(png));
+        }
+        lock.lock();
+    }
+}
+
+void PxlsTileServer::SeekWorker(Worker &worker, const unsigned long id) const {
+    auto &db = worker.db;
+    auto &canvas = worker.canvas;
+    const auto Distance = [id](const unsigned long other_id) { return other_id > id ? other_id - id : id - other_id; };
+    // regard 0 as a snapshot of the empty canvas
+    unsigned long snapshot_id = 0;
+    for (const auto other_id: snapshot_ids) {
+        if (Distance(other_id) < Distance(snapshot_id))
+            snapshot_id = other_id;
+    }
+    if (Distance(snapshot_id) < Distance(db.Seek())) {
+        // a snapshot that can't be opened leaves the canvas as it is, a partially decoded one restarts from record 0
+        bool snapshot_opened = false;
+        if (snapshot_id != 0 && db.QuerySnapshot(snapshot_id, [&](const std::size_t snapshot_bytes, const SnapshotReadCallback &read) {
+            snapshot_opened = true;
+            return canvas.LoadSnapshot(snapshot_bytes, read);
+        }))
+            db.Seek(snapshot_id);
+        else if (snapshot_id == 0 || snapshot_opened) {
+            canvas.ClearCanvas();
+            db.Seek(0);
+        }
+    }
+    if (!db.QueryRecordBatches(id, [&](const PxlsRecordBatch &batch) {
+        canvas.PerformBatch(batch, db.Columns());
+    }))
+        db.QueryRecords(id, [&](const std::optional<long long> &time, const std::optional<std::string> &hash,
+            const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
+            canvas.PerformAction(x, y, direction == FORWARD ? REDO : UNDO, time, action, hash, color_index);
+        });
+}
+
+std::shared_ptr<const std::string> PxlsTileServer::EncodeTile(const PxlsCanvas &canvas, const unsigned z, const unsigned x, const unsigned y) const {
+    if (!IsTileInRange(z, x, y)) return nullptr;
+    // pixels outside the canvas are transparent
+    std::vector<Color> pixels(TILE_SIZE * TILE_SIZE, BLANK);
+    for (unsigned tile_y = 0; tile_y < TILE_SIZE; tile_y++) {
+        // position in the canvas, scaled by the zoom level relative to the native one
+        const auto canvas_y = (static_cast<unsigned long long>(y) * TILE_SIZE + tile_y) << native_zoom >> z;
+        if (canvas_y >= height) break;
+        for (unsigned tile_x = 0; tile_x < TILE_SIZE; tile_x++) {
+            const auto canvas_x = (static_cast<unsigned long long>(x) * TILE_SIZE + tile_x) << native_zoom >> z;
+            if (canvas_x >= width) break;
+            pixels[tile_y * TILE_SIZE + tile_x] = canvas.GetPaletteColor(canvas.ColorIndex(canvas_x, canvas_y));
+        }
+    }
+    const Image image { pixels.data(), TILE_SIZE, TILE_SIZE, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+    int png_bytes = 0;
+    unsigned char *png_data = ExportImageToMemory(image, ".png", &png_bytes);
+    if (!png_data) return nullptr;
+    auto png = std::make_shared<const std::string>(reinterpret_cast<const char*>(png_data), png_bytes);
+    MemFree(png_data);
+    return png;
+}
+
+bool PxlsTileServer::IsTileInRange(const unsigned z, const unsigned x, const unsigned y) const {
+    if (z > native_zoom + MAX_OVERZOOM) return false;
+    // the first canvas pixel of the tile must be inside the canvas
+    return (static_cast<unsigned long long>(x) * TILE_SIZE << native_zoom >> z) < width &&
+        (static_cast<unsigned long long>(y) * TILE_SIZE << native_zoom >> z) < height;
+}
+
+std::shared_ptr<const std::string> PxlsTileServer::CachedTileOf(const std::string &key) {
+    std::lock_guard lock(cache_mutex);
+    const auto it = tiles.find(key);
+    if (it == tiles.end()) return nullptr;
+    tile_lru.splice(tile_lru.begin(), tile_lru, it->second.lru_it);
+    return it->second.png;
+}
+
+void PxlsTileServer::CacheTile(const std::string &key, const std::shared_ptr<const std::string> &png) {
+    std::lock_guard lock(cache_mutex);
+    if (png->size() > cache_budget || tiles.contains(key)) return;
+    tile_lru.push_front(key);
+    tiles[key] = { png, tile_lru.begin() };
+    cache_usage += png->size();
+    while (cache_usage > cache_budget) {
+        const auto it = tiles.find(tile_lru.back());
+        cache_usage -= it->second.png->size();
+        tiles.erase(it);
+        tile_lru.pop_back();
+    }
+}
@@ -0,0 +1,106 @@
+//
+// Provide a local HTTP server that renders PNG tiles of the canvas at arbitrary record ids or times
+//
+
+#ifndef PXLSTILESERVER_H
+#define PXLSTILESERVER_H
+#include <vector>
+#include <string>
+#include <string_view>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <boost/asio/io_context.hpp>
+#include <boost/beast/http/status.hpp>
+#include "PxlsLogDB.h"
+#include "PxlsCanvas.h"
+
+class PxlsTileServer {
+public:
+    // called with an encoded tile, or nullptr if the tile is out of range or the server is stopping
+    using TileCallback = std::function<void (std::shared_ptr<const std::string>)>;
+    // called with the status, content type and body of the response to a request
+    using ResponseCallback = std::function<void (boost::beast::http::status, std::string_view, std::shared_ptr<const std::string>)>;
+    PxlsTileServer() = default;
+    PxlsTileServer(const PxlsTileServer&) = delete;
+    PxlsTileServer& operator=(const PxlsTileServer&) = delete;
+    ~PxlsTileServer() { Close(); }
+    // open the logdb readonly and start worker_count replay workers, each of which has its own connection and canvas
+    bool Open(const std::string &logdb_filename, const std::string &palette_filename, unsigned worker_count = DEFAULT_WORKER_COUNT);
+    // stop the workers and close the logdb, the requests left are answered with nullptr
+    void Close();
+    // set memory budget of the tile cache in bytes, least recently used tiles are evicted when it is exceeded
+    void CacheBudget(std::size_t budget_bytes);
+    // serve http on localhost until Stop is called or the process is interrupted, return false if the port can't be bound
+    bool Run(unsigned short port);
+    // make Run return, which can be called from any thread
+    void Stop() { io_context.stop(); }
+    // render a tile of the canvas after the records up to id as png, on_tile is called from a worker unless the tile
+    // is cached or out of range. requests for nearby ids are queued on the same worker, which replays through them in
+    // one sweep instead of each one starting from a snapshot
+    void RequestTile(unsigned z, unsigned x, unsigned y, unsigned long id, const TileCallback &on_tile);
+    // handle the target of a get request, either /tile/{z}/{x}/{y}?id={record id} or ?t={epoch time in milliseconds},
+    // or /info for the metadata. respond may be called from a worker
+    void HandleRequest(std::string_view target, const ResponseCallback &respond);
+    // zoom level at which a tile pixel is a canvas pixel, the whole canvas fits into the tile at zoom level 0
+    [[nodiscard]] unsigned NativeZoom() const { return native_zoom; }
+    // width and height of tiles in pixels
+    static constexpr unsigned TILE_SIZE { 256 };
+    // zoom levels above the native one, where canvas pixels are magnified
+    static constexpr unsigned MAX_OVERZOOM { 4 };
+    static constexpr unsigned DEFAULT_WORKER_COUNT { 4 };
+    static constexpr std::size_t DEFAULT_CACHE_BUDGET { 64 << 20 };
+    // requests within this number of records from where a worker is heading are queued on it
+    static constexpr unsigned long SHARE_DISTANCE { 100000 };
+private:
+    struct TileRequest {
+        unsigned z { 0 }, x { 0 }, y { 0 };
+        unsigned long id { 0 };
+        TileCallback on_tile;
+    };
+    struct Worker {
+        PxlsLogDB db;
+        PxlsCanvas canvas;
+        std::vector<TileRequest> requests;
+        std::condition_variable cv;
+        // the record id the canvas reaches after the queued requests
+        unsigned long heading_id { 0 };
+        std::thread thread;
+    };
+    struct CachedTile {
+        std::shared_ptr<const std::string> png;
+        std::list<std::string>::iterator lru_it;
+    };
+    // serve the queued requests of a worker until closed
+    void Work(Worker &worker);
+    // bring the canvas of a worker to the record id, through the nearest snapshot if it is closer than the canvas
+    void SeekWorker(Worker &worker, unsigned long id) const;
+    // encode a tile of the canvas as png, return nullptr if it doesn't overlap the canvas
+    [[nodiscard]] std::shared_ptr<const std::string> EncodeTile(const PxlsCanvas &canvas, unsigned z, unsigned x, unsigned y) const;
+    // is the tile inside the zoom levels and overlapping the canvas
+    [[nodiscard]] bool IsTileInRange(unsigned z, unsigned x, unsigned y) const;
+    // look up/insert the tile cache
+    std::shared_ptr<const std::string> CachedTileOf(const std::string &key);
+    void CacheTile(const std::string &key, const std::shared_ptr<const std::string> &png);
+    // connection used for the requests by time and the metadata, only accessed by the thread running the server
+    PxlsLogDB index_db;
+    unsigned width { 0 }, height { 0 };
+    unsigned native_zoom { 0 };
+    std::vector<unsigned long> snapshot_ids;
+    // workers and their queues, which are guarded by the mutex
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex mutex;
+    bool stop_flag { false };
+    // encoded tiles by z/x/y/id, the most recently used one comes first in the lru list
+    std::unordered_map<std::string, CachedTile> tiles;
+    std::list<std::string> tile_lru;
+    std::size_t cache_budget { DEFAULT_CACHE_BUDGET }, cache_usage { 0 };
+    std::mutex cache_mutex;
+    boost::asio::io_context io_context;
+};
+
+#endif //PXLSTILESERVER_H
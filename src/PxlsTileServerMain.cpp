@@ -0,0 +1,67 @@
+//
+// Entry of the tile server, which serves canvas tiles of a logdb on localhost
+//
+
+#include <string>
+#include <filesystem>
+#include <iostream>
+#include "PxlsTileServer.h"
+#include "PxlsPlaneMemory.h"
+
+struct TileServerOptions {
+    std::string logdb;
+    std::string palette { "palette.json" };
+    // directory of the scratch files backing canvas planes, the one of the logdb if empty
+    std::string scratch_dir;
+    unsigned short port { 8080 };
+    unsigned worker_count { PxlsTileServer::DEFAULT_WORKER_COUNT };
+    std::size_t cache_budget { PxlsTileServer::DEFAULT_CACHE_BUDGET };
+};
+
+bool ParseOptions(const int argc, char **argv, TileServerOptions &options) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg { argv[i] };
+        if (!arg.starts_with("--")) {
+            options.logdb = arg;
+            continue;
+        }
+        if (i + 1 >= argc) return false;
+        const std::string value { argv[++i] };
+        try {
+            if (arg == "--palette") options.palette = value;
+            else if (arg == "--port") options.port = static_cast<unsigned short>(std::stoul(value));
+            else if (arg == "--workers") options.worker_count = std::stoul(value);
+            else if (arg == "--cache-bytes") options.cache_budget = std::stoull(value);
+            else if (arg == "--scratch-dir") options.scratch_dir = value;
+            else return false;
+        } catch (std::logic_error&) {
+            return false;
+        }
+    }
+    return !options.logdb.empty() && options.worker_count > 0;
+}
+
+int main(const int argc, char **argv) {
+    TileServerOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "Usage: pxls-tile-server LOGDB [--palette FILE] [--port PORT] [--workers N] [--cache-bytes B] [--scratch-dir DIR]\n";
+        return 1;
+    }
+    // every worker keeps a canvas, which is paged from scratch files beyond the budget. they are placed next to the
+    // logdb by default, since the temporary directory is often tmpfs, which is backed by memory itself
+    if (options.scratch_dir.empty())
+        options.scratch_dir = std::filesystem::absolute(options.logdb).parent_path().string();
+    PxlsPlaneMemory::Configure(options.scratch_dir, PxlsPlaneMemory::DEFAULT_RESIDENT_BUDGET);
+    PxlsTileServer server;
+    if (!server.Open(options.logdb, options.palette, options.worker_count)) {
+        std::cerr << "Failed to open " << options.logdb << " or " << options.palette << '\n';
+        return 2;
+    }
+    server.CacheBudget(options.cache_budget);
+    std::cerr << "Serving http://127.0.0.1:" << options.port << "/tile/{z}/{x}/{y}?id=N or ?t=MS\n";
+    if (!server.Run(options.port)) {
+        std::cerr << "Failed to listen on port " << options.port << '\n';
+        return 3;
+    }
+    return 0;
+}
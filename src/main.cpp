@@ -8,6 +8,8 @@
 #include "raylib.h"
 #include "raygui.h"
 #include "PxlsLogDB.h"
+#include "PxlsLogDBService.h"
+#include "PxlsLogSource.h"
 #include "PxlsCanvas.h"
 #include "PxlsOverlay.h"
 #include "tinyfiledialogs.h"
@@ -15,17 +17,22 @@
 constexpr unsigned SCREEN_WIDTH = 1280;
 constexpr unsigned SCREEN_HEIGHT = 960;
 constexpr unsigned char OVERLAY_ALPHA = 204;
+// interval in seconds between polling the source pxls log in follow mode
+constexpr double TAIL_INTERVAL = 1.0;
 
 constexpr unsigned RAW_LOG_FUTURE_TOKEN = { 3 };
 constexpr unsigned LOGDB_FUTURE_TOKEN = { 4 };
 constexpr unsigned LOAD_LOG_FAILURE_TOKEN = { 5 };
 constexpr unsigned LOAD_PALETTE_FAILURE_TOKEN = { 6 };
-constexpr unsigned SNAPSHOT_FUTURE_TOKEN = { 7 };
+constexpr unsigned REGION_INPUT_TOKEN = { 8 };
+constexpr unsigned DUMP_TRACE_FAILURE_TOKEN = { 9 };
+constexpr unsigned PALETTE_MISMATCH_TOKEN = { 10 };
+constexpr unsigned FILTER_INPUT_TOKEN = { 11 };
 
 constexpr std::string APP_TITLE { "Pxls Canvas Viewer" };
 constexpr std::array<std::string, 2> required_files { "style.rgs", "palette.json" };
-constexpr std::array log_filter_pattern { "*.log", "*.logdb" };
-constexpr std::array<float, 4> snapshot_proportion { 1.0f / 4.0f, 1.0 / 2.0f, 3.0f / 4.0f, 1.0f };
+constexpr std::array log_filter_pattern { "*.log", "*.log.gz", "*.log.zst", "*.logdb", "*.logdbm" };
+constexpr std::array trace_filter_pattern { "*.json" };
 std::vector<ToolbarItem> toolbar_items {
     { GuiIconText(ICON_FILE_OPEN, nullptr), "Load a Pxls log or LogDB", "OPEN_LOG" },
     { GuiIconText(ICON_BRUSH_PAINTER, nullptr), "Load a palette in JSON format", "OPEN_PALETTE" },
@@ -33,6 +40,12 @@ std::vector<ToolbarItem> toolbar_items {
     { GuiIconText(ICON_FILETYPE_PLAY, nullptr), "Toggle playback panel", "TOGGLE_PLAYBACK", false, true },
     { GuiIconText(ICON_INFO, nullptr), "Toggle info panel", "TOGGLE_INFO", false, true },
     { GuiIconText(ICON_CURSOR_POINTER, nullptr), "Toggle cursor overlay", "TOGGLE_CURSOR_OVERLAY", false, true },
+    { GuiIconText(ICON_CROP, nullptr), "Set region of interest", "SET_REGION" },
+    { GuiIconText(ICON_PLAYER_RECORD, nullptr), "Follow the growing Pxls log", "TOGGLE_FOLLOW" },
+    { GuiIconText(ICON_CPU, nullptr), "Toggle profiler overlay", "TOGGLE_PROFILER" },
+    { GuiIconText(ICON_VERTICAL_BARS, nullptr), "Toggle stats panel", "TOGGLE_STATS" },
+    { GuiIconText(ICON_FILTER, nullptr), "Filter records by action type", "SET_FILTER" },
+    { GuiIconText(ICON_FILE_EXPORT, nullptr), "Dump profiler trace in Chrome trace format", "DUMP_TRACE" },
     { GuiIconText(ICON_EXIT, nullptr), "Exit program", "EXIT" }
 };
 std::future<void> raw_log_future, logdb_future;
@@ -60,11 +73,18 @@ int main() {
             return 1;
         }
     }
+    // planes beyond the budget are mapped from scratch files, so giant canvases are paged by the OS instead of exhausting memory
+    PxlsPlaneMemory::Configure(PxlsPlaneMemory::DefaultScratchDir(), PxlsPlaneMemory::DEFAULT_RESIDENT_BUDGET);
     PxlsLogDB db;
+    // serves the lookups of the gui with its own connection, so they don't contend with replaying and following the log
+    PxlsLogDBService db_service;
     PxlsCanvas canvas;
     PxlsInfoPanel info_panel(SCREEN_WIDTH, SCREEN_HEIGHT);
     PxlsPlaybackPanel playback_panel(SCREEN_WIDTH, SCREEN_HEIGHT);
+    PxlsProfilerOverlay profiler_overlay(SCREEN_WIDTH, SCREEN_HEIGHT);
+    PxlsStatsPanel stats_panel(SCREEN_WIDTH, SCREEN_HEIGHT);
     bool exit_flag = false;
+    double last_tail_time = 0.0;
 
     if (!canvas.LoadPaletteFromJson("palette.json")) {
         tinyfd_messageBox(
@@ -86,6 +106,7 @@ int main() {
     while (!WindowShouldClose())
     {
         BeginDrawing();
+        const auto frame_start_time = GetTime();
         // update title if necessary
         filename_title_mutex.lock();
         if (filename_title) {
@@ -93,56 +114,77 @@ int main() {
             filename_title = std::nullopt;
         }
         filename_title_mutex.unlock();
-        // render canvas only if LogDB is open and the canvas is not updating
-        if (db.IsOpen() && !is_log_loading() && !playback_panel.IsCanvasUpdating())
+        // the metadata is read from the snapshot published by the logdb, since workers may be reopening it
+        const auto db_info = db.Info();
+        // the canvas is only accessed by one thread at a time, so render it only if it is not being initialized by
+        // loading or updated by playback. the lookups of the gui go through db_service and don't wait for them
+        if (db_info.open && !is_log_loading() && !playback_panel.IsCanvasUpdating())
             canvas.Render();
         else
             ClearBackground(PxlsCanvas::BACKGROUND_COLOR);
+        // replay colors only while no pixel metadata is shown, which is restored on demand when the info panel is expanded
+        if (db_info.open && !is_log_loading() && !playback_panel.IsCanvasUpdating())
+            canvas.ColorOnly(!toolbar_items[4].pressed || !info_panel.IsExpanded());
         // render overlay and gui
-        if (db.IsOpen() && !is_log_loading() && toolbar_items[5].pressed)
+        if (db_info.open && !is_log_loading() && toolbar_items[5].pressed)
             PxlsCursorOverlay::Render(canvas);
         // update toolbar state
-        toolbar_items[2].disabled = toolbar_items[3].disabled = toolbar_items[4].disabled = toolbar_items[5].disabled = !db.IsOpen();
+        toolbar_items[2].disabled = toolbar_items[3].disabled = toolbar_items[4].disabled = toolbar_items[5].disabled =
+            toolbar_items[6].disabled = toolbar_items[9].disabled = !db_info.open;
+        toolbar_items[6].pressed = playback_panel.Region().has_value();
+        toolbar_items[10].disabled = !db_info.open || !db_info.has_columns;
+        toolbar_items[10].pressed = playback_panel.Filter().has_value();
+        // logdbs with the columnar sidecar can't follow the log, and the others can't be filtered, since the action
+        // bitmaps are in the sidecar. without an open logdb, it decides whether the next pxls log is converted for
+        // following it, and it is kept pressed while converting
+        toolbar_items[7].disabled = is_log_loading() || (db_info.open && !db_info.can_tail);
+        if (toolbar_items[7].disabled && !is_log_loading())
+            toolbar_items[7].pressed = false;
+        // apply the records appended in the background, which the service sees after refreshing its metadata
+        if (playback_panel.FinishTail(db, canvas))
+            db_service.Refresh();
+        // ingest new records of the growing pxls log in the background
+        if (toolbar_items[7].pressed && db_info.open && !is_log_loading() &&
+            GetTime() - last_tail_time >= TAIL_INTERVAL && playback_panel.Tail(db))
+            last_tail_time = GetTime();
         PxlsToolbar::Render(toolbar_items, [&](const std::string &command) {
             if (command == "OPEN_LOG") {
                 // show open file dialog
                 const auto file_path_raw = tinyfd_openFileDialog(
                     "Choose a Pxls log or LogDB",
                     nullptr,
-                    2,
+                    log_filter_pattern.size(),
                     log_filter_pattern.data(),
                     "Pxls log / LogDB files",
                     0);
                 if (file_path_raw && std::filesystem::exists(file_path_raw) && !std::filesystem::is_directory(file_path_raw)) {
                     const std::string file_path { file_path_raw };
-                    const auto ext = std::filesystem::path { file_path }.extension().string();
+                    // a.log.gz and a.log.zst are converted like a.log
+                    const auto ext = PxlsLogSource::StripCompressionExtension(file_path).extension().string();
                     const auto filename = std::filesystem::path { file_path }.filename().string();
+                    // the prefetcher and the service read the logdb and the tail writes it, so stop them before the
+                    // logdb is reopened
+                    playback_panel.StopPrefetch();
+                    playback_panel.StopTail();
+                    db_service.Close().wait();
                     if (ext == ".log") {
+                        db.FollowSource(toolbar_items[7].pressed);
                         PxlsDialog::AcquireToken(RAW_LOG_FUTURE_TOKEN);
                         raw_log_future = std::async([&, file_path, filename] {
-                            if (db.OpenLogRaw(file_path)) {
+                            // snapshots are created while converting, so the records are only replayed once
+                            PxlsSnapshotBuilder snapshot_builder;
+                            if (db.OpenLogRaw(file_path, [&](const long long time, const std::string_view hash, const unsigned x, const unsigned y,
+                                const unsigned color_index, const std::string_view action) {
+                                snapshot_builder.PerformAction(x, y, time, action, hash, color_index);
+                            }, [&](std::vector<char> &snapshot_blob) {
+                                return snapshot_builder.DumpSnapshot(snapshot_blob);
+                            })) {
+                                db_service.Open(db.Filename());
                                 canvas.InitCanvas(db.Width(), db.Height(), SCREEN_WIDTH, SCREEN_HEIGHT);
-                                PxlsDialog::ReleaseToken(RAW_LOG_FUTURE_TOKEN);
-                                PxlsDialog::AcquireToken(SNAPSHOT_FUTURE_TOKEN);
-                                for (const auto &proportion: snapshot_proportion) {
-                                    const unsigned long snapshot_id = std::floorf(db.RecordCount() * proportion);
-                                    std::shared_ptr<PxlsCanvasSnapshotPixel[]> snapshot_blob;
-                                    db.QueryRecords(snapshot_id, [&](const std::optional<std::string> &date, const std::optional<std::string> &hash,
-                                        const unsigned x, const unsigned y, const std::optional<unsigned> color_index, const std::optional<std::string> &action, const QueryDirection direction) {
-                                        if (direction == FORWARD) {
-                                            canvas.PerformAction(x, y, REDO, date, action, hash, color_index);
-                                        } else {
-                                            canvas.PerformAction(x, y, UNDO, date, action, hash, color_index);
-                                        }
-                                    });
-                                    canvas.DumpSnapshot(snapshot_blob);
-                                    if (!db.CreateSnapshot(snapshot_id, snapshot_blob.get(), db.Width() * db.Height() * sizeof(PxlsCanvasSnapshotPixel)))
-                                        break;
-                                }
-                                db.Seek(0);
-                                canvas.ClearCanvas();
+                                // remember the palette the snapshots are created with
+                                db.PaletteHash(canvas.PaletteHash());
                                 playback_panel.InitPlayback(db);
-                                PxlsDialog::ReleaseToken(SNAPSHOT_FUTURE_TOKEN);
+                                PxlsDialog::ReleaseToken(RAW_LOG_FUTURE_TOKEN);
                                 // set title
                                 filename_title_mutex.lock();
                                 filename_title = filename;
@@ -156,9 +198,12 @@ int main() {
                         PxlsDialog::AcquireToken(LOGDB_FUTURE_TOKEN);
                         logdb_future = std::async([&, file_path, filename] {
                             if (db.OpenLogDB(file_path)) {
+                                db_service.Open(db.Filename());
                                 canvas.InitCanvas(db.Width(), db.Height(), SCREEN_WIDTH, SCREEN_HEIGHT);
                                 playback_panel.InitPlayback(db);
                                 PxlsDialog::ReleaseToken(LOGDB_FUTURE_TOKEN);
+                                if (const auto palette_hash = db.PaletteHash(); palette_hash && *palette_hash != canvas.PaletteHash())
+                                    PxlsDialog::AcquireToken(PALETTE_MISMATCH_TOKEN);
                                 // set title
                                 filename_title_mutex.lock();
                                 filename_title = filename;
@@ -185,6 +230,9 @@ int main() {
                 }
             }
             else if (command == "CLOSE") {
+                playback_panel.StopPrefetch();
+                playback_panel.StopTail();
+                db_service.Close();
                 db.CloseLogDB();
                 SetWindowTitle(APP_TITLE.c_str());
             }
@@ -194,20 +242,46 @@ int main() {
                 toolbar_items[4].pressed = !toolbar_items[4].pressed;
             else if (command == "TOGGLE_CURSOR_OVERLAY")
                 toolbar_items[5].pressed = !toolbar_items[5].pressed;
+            else if (command == "SET_REGION")
+                PxlsDialog::AcquireToken(REGION_INPUT_TOKEN);
+            else if (command == "SET_FILTER")
+                PxlsDialog::AcquireToken(FILTER_INPUT_TOKEN);
+            else if (command == "TOGGLE_FOLLOW")
+                toolbar_items[7].pressed = !toolbar_items[7].pressed;
+            else if (command == "TOGGLE_PROFILER") {
+                toolbar_items[8].pressed = !toolbar_items[8].pressed;
+                PxlsProfiler::Enabled(toolbar_items[8].pressed);
+            }
+            else if (command == "TOGGLE_STATS")
+                toolbar_items[9].pressed = !toolbar_items[9].pressed;
+            else if (command == "DUMP_TRACE") {
+                const auto file_path = tinyfd_saveFileDialog(
+                    "Save profiler trace",
+                    "trace.json",
+                    1,
+                    trace_filter_pattern.data(),
+                    "Chrome trace files");
+                if (file_path && !PxlsProfiler::DumpChromeTrace(file_path))
+                    PxlsDialog::AcquireToken(DUMP_TRACE_FAILURE_TOKEN);
+            }
             else if (command == "EXIT")
                 exit_flag = true;
         });
-        if (db.IsOpen() && !is_log_loading()) {
+        // the panels read the canvas and the playback state, which are initialized by loading
+        if (db_info.open && !is_log_loading()) {
             if (toolbar_items[4].pressed)
-                info_panel.Render(canvas);
+                info_panel.Render(canvas, db, db_service);
+            if (toolbar_items[9].pressed)
+                stats_panel.Render(canvas, db, db_service);
             if (toolbar_items[3].pressed)
-                playback_panel.Render(db, canvas);
+                playback_panel.Render(db, canvas, frame_start_time);
         }
+        // render profiler overlay, the connection whose cache is inspected is only accessible when it is not being reopened
+        if (toolbar_items[8].pressed)
+            profiler_overlay.Render(db_info.open && !is_log_loading() ? &db : nullptr);
         // render pending box
         PxlsDialog::PendingBox(SCREEN_WIDTH, SCREEN_HEIGHT, RAW_LOG_FUTURE_TOKEN,
             "Building LogDB, please wait patiently...");
-        PxlsDialog::PendingBox(SCREEN_WIDTH, SCREEN_HEIGHT, SNAPSHOT_FUTURE_TOKEN,
-            "Creating snapshots to improve playback experience, please wait patiently...");
         PxlsDialog::PendingBox(SCREEN_WIDTH, SCREEN_HEIGHT, LOGDB_FUTURE_TOKEN,
             "Loading LogDB...");
         // render message box
@@ -222,10 +296,70 @@ int main() {
             button_result != -1) {
             PxlsDialog::ReleaseToken(LOAD_PALETTE_FAILURE_TOKEN);
         }
+        if (PxlsDialog::MessageBox(SCREEN_WIDTH, SCREEN_HEIGHT, DUMP_TRACE_FAILURE_TOKEN,
+            "Save failed", "Failed to save profiler trace. Please ensure the path is writable.", button_result) &&
+            button_result != -1) {
+            PxlsDialog::ReleaseToken(DUMP_TRACE_FAILURE_TOKEN);
+        }
+        if (PxlsDialog::MessageBox(SCREEN_WIDTH, SCREEN_HEIGHT, PALETTE_MISMATCH_TOKEN,
+            "Palette mismatch", "The LogDB was created with a different palette. Its color indices will be rendered with the current palette.", button_result) &&
+            button_result != -1) {
+            PxlsDialog::ReleaseToken(PALETTE_MISMATCH_TOKEN);
+        }
+        // the playback panel may be hidden, so the failure of filtering is shown here
+        if (PxlsDialog::MessageBox(SCREEN_WIDTH, SCREEN_HEIGHT, PxlsPlaybackPanel::FILTER_FAILURE_TOKEN,
+            "Filter failed", "Failed to filter records. Please ensure the LogDB has an up-to-date columnar sidecar.", button_result) &&
+            button_result != -1) {
+            PxlsDialog::ReleaseToken(PxlsPlaybackPanel::FILTER_FAILURE_TOKEN);
+        }
+        // render region input box
+        if (std::string region_str; PxlsDialog::TextInputBox(SCREEN_WIDTH, SCREEN_HEIGHT, REGION_INPUT_TOKEN, "Set region of interest",
+            "Input region(x,y,width,height), leave empty to clear:", region_str, button_result) && button_result != -1) {
+            if (button_result == 1) {
+                std::vector<std::string> region_fields;
+                boost::split(region_fields, region_str, boost::is_any_of(","));
+                if (region_fields.size() == 4) {
+                    try {
+                        playback_panel.Region(PxlsRegion {
+                            static_cast<unsigned>(std::stoul(region_fields[0])),
+                            static_cast<unsigned>(std::stoul(region_fields[1])),
+                            static_cast<unsigned>(std::stoul(region_fields[2])),
+                            static_cast<unsigned>(std::stoul(region_fields[3]))
+                        }, db, canvas);
+                    } catch (std::logic_error&) {}
+                } else if (boost::trim_copy(region_str).empty()) {
+                    playback_panel.Region(std::nullopt, db, canvas);
+                }
+            }
+            PxlsDialog::ReleaseToken(REGION_INPUT_TOKEN);
+        }
+        // render filter input box
+        if (std::string filter_str; PxlsDialog::TextInputBox(SCREEN_WIDTH, SCREEN_HEIGHT, FILTER_INPUT_TOKEN, "Filter records by action type",
+            "Input actions to hide(a,b), or =a,b to show only them:", filter_str, button_result) && button_result != -1) {
+            // release the input box first, so that the playback panel can show the progress of filtering
+            PxlsDialog::ReleaseToken(FILTER_INPUT_TOKEN);
+            if (button_result == 1) {
+                boost::trim(filter_str);
+                std::optional<PxlsActionFilter> filter { std::nullopt };
+                if (!filter_str.empty()) {
+                    filter.emplace();
+                    // a leading = means only the actions are shown
+                    filter->only = filter_str.starts_with('=');
+                    if (filter->only)
+                        filter_str.erase(0, 1);
+                    boost::split(filter->actions, filter_str, boost::is_any_of(","));
+                    for (auto &action: filter->actions)
+                        boost::trim(action);
+                }
+                if (!playback_panel.Filter(filter, db, canvas))
+                    PxlsDialog::AcquireToken(PxlsPlaybackPanel::FILTER_FAILURE_TOKEN);
+            }
+        }
         EndDrawing();
         if (exit_flag)
             break;
     }
+    canvas.UnloadTextures();
     CloseWindow();
     return 0;
 }
@@ -0,0 +1,129 @@
+//
+// Test applying record batches with duplicate pixels and a clip rectangle
+//
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include "PxlsApplyKernel.h"
+
+namespace {
+    constexpr unsigned WIDTH { 4 }, HEIGHT { 4 };
+
+    struct Planes {
+        std::vector<std::uint8_t> color_index = std::vector<std::uint8_t>(WIDTH * HEIGHT);
+        std::vector<unsigned> manipulate_count = std::vector<unsigned>(WIDTH * HEIGHT);
+        std::vector<long long> last_time = std::vector<long long>(WIDTH * HEIGHT);
+        std::uint64_t checksum { 0 };
+        [[nodiscard]] PxlsApplyPlanes View() {
+            return { WIDTH, HEIGHT, color_index.data(), manipulate_count.data(), last_time.data(), &checksum };
+        }
+        // recompute the checksum from scratch
+        [[nodiscard]] std::uint64_t FullChecksum() const {
+            std::uint64_t full_checksum = 0;
+            for (unsigned i = 0; i < WIDTH * HEIGHT; i++)
+                full_checksum ^= PxlsApplyKernel::PixelChecksum(i % WIDTH, i / WIDTH, color_index[i], manipulate_count[i]);
+            return full_checksum;
+        }
+    };
+
+    // records in packed arrays, which outlive the batches viewing them
+    struct Records {
+        std::vector<std::uint16_t> x, y;
+        std::vector<std::uint8_t> color_index, action_id, has_prev;
+        std::vector<std::uint32_t> user_id;
+        std::vector<long long> time;
+        void Add(const std::uint16_t record_x, const std::uint16_t record_y, const std::uint8_t record_color,
+                 const long long record_time, const bool record_has_prev = true) {
+            x.push_back(record_x); y.push_back(record_y);
+            color_index.push_back(record_color); action_id.push_back(0); user_id.push_back(0);
+            time.push_back(record_time); has_prev.push_back(record_has_prev);
+        }
+        [[nodiscard]] PxlsRecordBatch Batch(const QueryDirection direction) const {
+            return { direction, x.size(), x.data(), y.data(), color_index.data(), action_id.data(), user_id.data(),
+                time.data(), has_prev.data() };
+        }
+    };
+
+    int failures = 0;
+
+    void Check(const bool condition, const char *description) {
+        if (condition) return;
+        std::cerr << "FAILED: " << description << '\n';
+        failures++;
+    }
+
+    void TestForwardDuplicates() {
+        Planes planes;
+        Records records;
+        // pixel (1, 2) is written three times, across more than one block of records
+        for (std::uint16_t i = 0; i < 20; i++) {
+            if (i == 2 || i == 9 || i == 17)
+                records.Add(1, 2, static_cast<std::uint8_t>(i), i);
+            else
+                records.Add(i % 2 + 2, i % 4, static_cast<std::uint8_t>(i), i);
+        }
+        std::vector<std::uint32_t> indices;
+        std::vector<PxlsApplyResult> results;
+        PxlsApplyKernel::Apply(records.Batch(FORWARD), planes.View(), indices, results);
+        constexpr unsigned index = 2 * WIDTH + 1;
+        Check(planes.color_index[index] == 17, "forward: the last write of a duplicate pixel wins");
+        Check(planes.last_time[index] == 17, "forward: the time of the last write is kept");
+        Check(planes.manipulate_count[index] == 3, "forward: every write of a duplicate pixel is counted");
+        Check(planes.color_index[1 * WIDTH + 3] == 13 && planes.manipulate_count[1 * WIDTH + 3] == 3,
+              "forward: the last write wins on other pixels");
+        Check(planes.checksum == planes.FullChecksum(), "forward: the checksum matches the planes");
+    }
+
+    void TestBackwardDuplicates() {
+        Planes planes;
+        Records forward_records;
+        forward_records.Add(1, 2, 3, 1);
+        forward_records.Add(1, 2, 5, 2);
+        forward_records.Add(1, 2, 7, 3);
+        forward_records.Add(0, 0, 9, 4);
+        std::vector<std::uint32_t> indices;
+        std::vector<PxlsApplyResult> results;
+        PxlsApplyKernel::Apply(forward_records.Batch(FORWARD), planes.View(), indices, results);
+        // undo in reverse order, the arrays hold the values of the previous records
+        Records backward_records;
+        backward_records.Add(0, 0, 0, 0, false);
+        backward_records.Add(1, 2, 5, 2);
+        backward_records.Add(1, 2, 3, 1);
+        PxlsApplyKernel::Apply(backward_records.Batch(BACKWARD), planes.View(), indices, results);
+        constexpr unsigned index = 2 * WIDTH + 1;
+        Check(planes.color_index[index] == 3 && planes.last_time[index] == 1, "backward: the last undo of a duplicate pixel wins");
+        Check(planes.manipulate_count[index] == 1, "backward: every undo of a duplicate pixel is counted");
+        Check(results[0] == APPLY_REVERTED && planes.manipulate_count[0] == 0 && planes.color_index[0] == 0,
+              "backward: a pixel without previous record is reverted");
+        Check(results[1] == APPLY_WRITTEN && results[2] == APPLY_WRITTEN, "backward: undone pixels are written");
+        Check(planes.checksum == planes.FullChecksum(), "backward: the checksum matches the planes");
+    }
+
+    void TestClip() {
+        Planes planes;
+        Records records;
+        records.Add(0, 0, 1, 1);
+        records.Add(2, 2, 2, 2);
+        records.Add(3, 3, 3, 3);
+        auto view = planes.View();
+        view.clip_x = view.clip_y = 1;
+        view.clip_width = view.clip_height = 2;
+        std::vector<std::uint32_t> indices;
+        std::vector<PxlsApplyResult> results;
+        PxlsApplyKernel::Apply(records.Batch(FORWARD), view, indices, results);
+        Check(results[0] == APPLY_SKIPPED && results[1] == APPLY_WRITTEN && results[2] == APPLY_SKIPPED,
+              "clip: only the records inside the clip rectangle are written");
+        Check(planes.manipulate_count[0] == 0 && planes.manipulate_count[3 * WIDTH + 3] == 0,
+              "clip: the pixels outside the clip rectangle are kept");
+        Check(planes.checksum == planes.FullChecksum(), "clip: the checksum matches the planes");
+    }
+}
+
+int main() {
+    TestForwardDuplicates();
+    TestBackwardDuplicates();
+    TestClip();
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
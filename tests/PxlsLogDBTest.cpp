@@ -0,0 +1,190 @@
+//
+// Test converting pxls logs whose last line has no trailing newline, following them afterwards and reopening their logdb
+//
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstdlib>
+#include <iostream>
+#include "PxlsLogDB.h"
+
+namespace {
+    const std::filesystem::path TEST_DIR { std::filesystem::temp_directory_path() / "pxls-logdb-test" };
+
+    // a record placed by its own user on pixel (index, index) at second index, index is less than 60
+    std::string RecordLine(const unsigned index) {
+        const auto number = std::to_string(index);
+        return "2020-09-13 12:26:" + std::string(2 - number.size(), '0') + number + ",000\t" +
+            std::string(64 - number.size(), '0') + number + '\t' + number + '\t' + number + '\t' +
+            std::to_string(index % 32) + "\tuser place";
+    }
+
+    // write the lines of the records in [first, last) to a log, the last line isn't terminated if terminate_last is false
+    void AppendLog(const std::filesystem::path &log_path, const unsigned first, const unsigned last, const bool terminate_last) {
+        std::ofstream file(log_path, std::ios::binary | std::ios::app);
+        for (unsigned i = first; i < last; i++) {
+            file << RecordLine(i);
+            if (i + 1 < last || terminate_last)
+                file << '\n';
+        }
+    }
+
+    std::filesystem::path NewLog(const std::string &name) {
+        const auto log_path = TEST_DIR / name;
+        std::filesystem::remove(log_path);
+        return log_path;
+    }
+
+    // journal mode of a logdb, read without touching it
+    std::string JournalMode(const std::filesystem::path &db_path) {
+        std::string mode;
+        sqlite3 *db = nullptr;
+        if (sqlite3_open_v2(db_path.string().c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK)
+            sqlite3_exec(db, "PRAGMA journal_mode;", [](void *mode_ptr, int, char **argv, char **) -> int {
+                *static_cast<std::string*>(mode_ptr) = argv[0];
+                return 0;
+            }, &mode, nullptr);
+        sqlite3_close(db);
+        return mode;
+    }
+
+    int failures = 0;
+
+    void Check(const bool condition, const char *description) {
+        if (condition) return;
+        std::cerr << "FAILED: " << description << '\n';
+        failures++;
+    }
+
+    void TestConvert() {
+        const auto log_path = NewLog("convert.log");
+        AppendLog(log_path, 0, 3, false);
+        PxlsLogDB db;
+        Check(db.OpenLogRaw(log_path.string()), "convert: the log is converted");
+        Check(db.RecordCount() == 3, "convert: the unterminated last line is converted");
+        db.CloseLogDB();
+        // reopening the same log resumes from the checkpoint, which covers the last line
+        Check(db.OpenLogRaw(log_path.string()) && db.RecordCount() == 3, "convert: resuming doesn't convert the last line again");
+    }
+
+    void TestConvertSharded() {
+        const auto log_path = NewLog("sharded.log");
+        AppendLog(log_path, 0, 5, false);
+        PxlsLogDB db;
+        db.ShardBytes(RecordLine(0).size() * 2);
+        Check(db.OpenLogRaw(log_path.string()), "sharded: the log is converted");
+        Check(db.IsSharded() && db.RecordCount() == 5, "sharded: the unterminated last line is converted");
+        long long time = 0;
+        Check(db.QueryRecordTime(5, time), "sharded: the last record is stored in a shard");
+    }
+
+    void TestFollow() {
+        const auto log_path = NewLog("follow.log");
+        AppendLog(log_path, 0, 3, false);
+        // a stale sidecar of the log is removed
+        std::ofstream(std::filesystem::path(log_path).replace_extension("pxcol")) << "stale";
+        PxlsLogDB db;
+        db.FollowSource(true);
+        Check(db.OpenLogRaw(log_path.string()), "follow: the log is converted");
+        Check(db.RecordCount() == 2, "follow: the unterminated last line is left to the tail");
+        Check(!db.HasColumns() && !std::filesystem::exists(std::filesystem::path(log_path).replace_extension("pxcol")) &&
+              db.CanTail(), "follow: the log is converted without the columnar sidecar");
+        unsigned long appended_count = 0;
+        Check(db.TailLogRaw(appended_count) && appended_count == 0, "follow: the unterminated last line isn't tailed");
+        // the writer finishes the last line
+        std::ofstream(log_path, std::ios::binary | std::ios::app) << '\n';
+        Check(db.TailLogRaw(appended_count) && db.RecordCount() == 3 && appended_count == 1,
+              "follow: the last line is tailed once it is terminated");
+    }
+
+    void TestFollowAfterConvert() {
+        const auto log_path = NewLog("fragment.log");
+        AppendLog(log_path, 0, 3, false);
+        PxlsLogDB db;
+        db.WriteColumns(false);
+        Check(db.OpenLogRaw(log_path.string()) && db.RecordCount() == 3, "fragment: the unterminated last line is converted");
+        // the writer terminates the last line and appends another one
+        std::ofstream(log_path, std::ios::binary | std::ios::app) << '\n' << RecordLine(3) << '\n';
+        unsigned long appended_count = 0;
+        Check(db.TailLogRaw(appended_count) && appended_count == 1 && db.RecordCount() == 4,
+              "fragment: the newline ending the converted line is skipped");
+    }
+
+    void TestFollowGrowth() {
+        const auto log_path = NewLog("growth.log");
+        AppendLog(log_path, 0, 3, true);
+        PxlsLogDB db;
+        db.WriteColumns(false);
+        Check(db.OpenLogRaw(log_path.string()), "growth: the log is converted");
+        constexpr char snapshot_blob[] { 1, 2, 3, 4 };
+        Check(db.CreateSnapshot(2, snapshot_blob, sizeof(snapshot_blob)), "growth: a snapshot is created");
+        // the appended record lies outside the canvas
+        AppendLog(log_path, 40, 41, true);
+        unsigned long appended_count = 0;
+        Check(db.TailLogRaw(appended_count) && db.Width() == 41 && db.Height() == 41, "growth: the canvas grows");
+        const auto info = db.Info();
+        Check(info.width == 41 && info.height == 41 && info.record_count == 4, "growth: the metadata is published");
+        std::vector<unsigned long> snapshot_ids;
+        Check(db.QuerySnapshotIdList(snapshot_ids) && snapshot_ids == std::vector<unsigned long> { 2 },
+              "growth: the snapshots are kept");
+    }
+
+    void TestColumnsCantTail() {
+        const auto log_path = NewLog("columns.log");
+        AppendLog(log_path, 0, 3, true);
+        PxlsLogDB db;
+        Check(db.OpenLogRaw(log_path.string()) && db.HasColumns(), "columns: the columnar sidecar is written");
+        Check(!db.CanTail() && !db.Info().can_tail, "columns: the logdb with the columnar sidecar can't follow the log");
+    }
+
+    void TestOpenReadOnly() {
+        const auto log_path = NewLog("reopen.log");
+        AppendLog(log_path, 0, 3, true);
+        const auto db_path = std::filesystem::path(log_path).replace_extension("logdb");
+        {
+            PxlsLogDB db;
+            db.WriteColumns(false);
+            Check(db.OpenLogRaw(log_path.string()), "reopen: the log is converted");
+        }
+        // switch the logdb to another journal mode, which opening it must not change
+        sqlite3 *db_handle = nullptr;
+        sqlite3_open_v2(db_path.string().c_str(), &db_handle, SQLITE_OPEN_READWRITE, nullptr);
+        sqlite3_exec(db_handle, "PRAGMA journal_mode = DELETE;", nullptr, nullptr, nullptr);
+        sqlite3_close(db_handle);
+        PxlsLogDB db;
+        Check(db.OpenLogDB(db_path.string()) && db.CanTail(), "reopen: the logdb is opened");
+        unsigned long appended_count = 0;
+        Check(db.TailLogRaw(appended_count) && appended_count == 0, "reopen: the log is followed");
+        Check(JournalMode(db_path) == "delete" && !std::filesystem::exists(db_path.string() + "-wal"),
+              "reopen: the logdb isn't written until records are appended");
+        AppendLog(log_path, 3, 4, true);
+        Check(db.TailLogRaw(appended_count) && appended_count == 1 && JournalMode(db_path) == "wal",
+              "reopen: the logdb is switched to wal mode when records are appended");
+    }
+
+    void TestClose() {
+        const auto log_path = NewLog("close.log");
+        AppendLog(log_path, 0, 3, true);
+        PxlsLogDB db;
+        Check(db.OpenLogRaw(log_path.string()) && db.Info().open, "close: the open logdb is published");
+        db.CloseLogDB();
+        Check(!db.Info().open && db.Info().record_count == 0, "close: the closed logdb is published");
+    }
+}
+
+int main() {
+    std::filesystem::remove_all(TEST_DIR);
+    std::filesystem::create_directories(TEST_DIR);
+    TestConvert();
+    TestConvertSharded();
+    TestFollow();
+    TestFollowAfterConvert();
+    TestFollowGrowth();
+    TestColumnsCantTail();
+    TestOpenReadOnly();
+    TestClose();
+    std::filesystem::remove_all(TEST_DIR);
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}